@@ -2,6 +2,7 @@
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_image.h>
 #include <string>
+#include <map>
 #include <stdio.h>
 
 //Screen dimension constants
@@ -11,6 +12,12 @@ const int SCREEN_HEIGHT = 480;
 //Analog joystick dead zone
 const int JOYSTICK_DEAD_ZONE = 8000;
 
+//Bytes of cached textures the cache tries to stay under, only unreferenced ones are evicted to get there
+const size_t TEXTURE_CACHE_BUDGET = 64 * 1024 * 1024;
+
+//Texture cache, defined below
+class LTextureCache;
+
 //Texture wrapper class
 class LTexture
 {
@@ -23,6 +30,9 @@ class LTexture
 
     //Loads image at specified path
     bool loadFromFile( std::string path );
+
+    //Uses the cached texture for a path, sharing it with other users
+    bool loadFromCache( LTextureCache& cache, std::string path );
     
     #if defined(SDL_TTF_MAJOR_VERSION)
     //Creates image from font string
@@ -55,6 +65,74 @@ class LTexture
     //Image dimensions
     int mWidth;
     int mHeight;
+
+    //Cache the texture is shared from
+    LTextureCache* mCache;
+    std::string mCachePath;
+};
+
+//Reference counted textures shared by path
+class LTextureCache
+{
+  public:
+    //Initializes variables
+    LTextureCache();
+
+    //Deallocates memory
+    ~LTextureCache();
+
+    //Gets the texture for a path, loading it on a miss, and adds a reference
+    SDL_Texture* acquire( std::string path, int& width, int& height );
+
+    //Drops a reference, the texture stays resident until evicted
+    void release( std::string path );
+
+    //Loads a texture ahead of use without referencing it
+    bool prefetch( std::string path );
+
+    //Sets the memory budget and evicts down to it
+    void setBudget( size_t bytes );
+
+    //Frees unreferenced textures, least recently used first, until under budget
+    void evict();
+
+    //Deallocates all textures, textures using the cache must be freed first
+    void free();
+
+    //Gets cache stats
+    int getHits();
+    int getMisses();
+    int getEvictions();
+    size_t getMemory();
+
+  private:
+    //A resident texture
+    struct Entry
+    {
+      SDL_Texture* texture;
+      int width, height;
+      size_t bytes;
+      int references;
+      Uint32 lastUsed;
+    };
+
+    //Finds or loads the entry for a path
+    Entry* load( std::string path );
+
+    //Resident textures by path
+    std::map<std::string, Entry> mEntries;
+
+    //Memory budget and estimated texture memory in use
+    size_t mBudget;
+    size_t mMemory;
+
+    //Use counter for least recently used eviction
+    Uint32 mClock;
+
+    //Stats
+    int mHits;
+    int mMisses;
+    int mEvictions;
 };
 
 //Starts up SDL and creates window
@@ -72,8 +150,12 @@ SDL_Window* gWindow = NULL;
 //The window renderer
 SDL_Renderer* gRenderer = NULL;
 
+//Shared texture cache, declared before the textures that use it
+LTextureCache gTextureCache;
+
 //Scene textures
 LTexture gArrowTexture;
+LTexture gCompassTexture;
 
 //Game Controller 1 handler
 SDL_Joystick* gGameController = NULL;
@@ -87,6 +169,7 @@ LTexture::LTexture()
   mTexture = NULL;
   mWidth = 0;
   mHeight = 0;
+  mCache = NULL;
 }
 
 LTexture::~LTexture()
@@ -136,6 +219,23 @@ bool LTexture::loadFromFile( std::string path )
   return mTexture != NULL;
 }
 
+bool LTexture::loadFromCache( LTextureCache& cache, std::string path )
+{
+  //Get rid of preexisting texture
+  free();
+
+  //Share the cached texture
+  mTexture = cache.acquire( path, mWidth, mHeight );
+  if( mTexture != NULL )
+  {
+    mCache = &cache;
+    mCachePath = path;
+  }
+
+  //Return success
+  return mTexture != NULL;
+}
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -175,10 +275,18 @@ bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColo
 
 void LTexture::free()
 {
-  //Free texture if it exists
+  //Free texture if it exists, cached textures are handed back to their cache
   if( mTexture != NULL )
   {
-    SDL_DestroyTexture( mTexture );
+    if( mCache != NULL )
+    {
+      mCache->release( mCachePath );
+      mCache = NULL;
+    }
+    else
+    {
+      SDL_DestroyTexture( mTexture );
+    }
     mTexture = NULL;
     mWidth = 0;
     mHeight = 0;
@@ -229,6 +337,167 @@ int LTexture::getHeight()
   return mHeight;
 }
 
+LTextureCache::LTextureCache()
+{
+  //Initialize
+  mBudget = TEXTURE_CACHE_BUDGET;
+  mMemory = 0;
+  mClock = 0;
+  mHits = 0;
+  mMisses = 0;
+  mEvictions = 0;
+}
+
+LTextureCache::~LTextureCache()
+{
+  //Deallocate
+  free();
+}
+
+LTextureCache::Entry* LTextureCache::load( std::string path )
+{
+  //Already resident
+  std::map<std::string, Entry>::iterator found = mEntries.find( path );
+  if( found != mEntries.end() )
+  {
+    ++mHits;
+    found->second.lastUsed = ++mClock;
+    return &found->second;
+  }
+  ++mMisses;
+
+  //Load image at specified path
+  SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
+  if( loadedSurface == NULL )
+  {
+    printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+    return NULL;
+  }
+
+  //Color key image
+  SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+
+  //Create texture from surface pixels
+  Entry entry;
+  entry.texture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
+  entry.width = loadedSurface->w;
+  entry.height = loadedSurface->h;
+  entry.bytes = (size_t)entry.width * entry.height * 4;
+  entry.references = 0;
+  entry.lastUsed = ++mClock;
+  SDL_FreeSurface( loadedSurface );
+
+  if( entry.texture == NULL )
+  {
+    printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+    return NULL;
+  }
+
+  //Make room for it before adding, so it is never evicted by its own load
+  mMemory += entry.bytes;
+  evict();
+  return &mEntries.insert( std::make_pair( path, entry ) ).first->second;
+}
+
+SDL_Texture* LTextureCache::acquire( std::string path, int& width, int& height )
+{
+  //Find or load the texture
+  Entry* entry = load( path );
+  if( entry == NULL )
+  {
+    return NULL;
+  }
+
+  //Reference it
+  ++entry->references;
+  width = entry->width;
+  height = entry->height;
+  return entry->texture;
+}
+
+void LTextureCache::release( std::string path )
+{
+  //Drop the reference
+  std::map<std::string, Entry>::iterator found = mEntries.find( path );
+  if( found != mEntries.end() && found->second.references > 0 )
+  {
+    --found->second.references;
+    if( found->second.references == 0 )
+    {
+      evict();
+    }
+  }
+}
+
+bool LTextureCache::prefetch( std::string path )
+{
+  return load( path ) != NULL;
+}
+
+void LTextureCache::setBudget( size_t bytes )
+{
+  mBudget = bytes;
+  evict();
+}
+
+void LTextureCache::evict()
+{
+  //Drop least recently used unreferenced textures until under budget
+  while( mMemory > mBudget )
+  {
+    std::map<std::string, Entry>::iterator oldest = mEntries.end();
+    for( std::map<std::string, Entry>::iterator i = mEntries.begin(); i != mEntries.end(); ++i )
+    {
+      if( i->second.references == 0 && ( oldest == mEntries.end() || i->second.lastUsed < oldest->second.lastUsed ) )
+      {
+        oldest = i;
+      }
+    }
+
+    //Everything left is in use
+    if( oldest == mEntries.end() )
+    {
+      break;
+    }
+
+    SDL_DestroyTexture( oldest->second.texture );
+    mMemory -= oldest->second.bytes;
+    mEntries.erase( oldest );
+    ++mEvictions;
+  }
+}
+
+void LTextureCache::free()
+{
+  //Free all textures
+  for( std::map<std::string, Entry>::iterator i = mEntries.begin(); i != mEntries.end(); ++i )
+  {
+    SDL_DestroyTexture( i->second.texture );
+  }
+  mEntries.clear();
+  mMemory = 0;
+}
+
+int LTextureCache::getHits()
+{
+  return mHits;
+}
+
+int LTextureCache::getMisses()
+{
+  return mMisses;
+}
+
+int LTextureCache::getEvictions()
+{
+  return mEvictions;
+}
+
+size_t LTextureCache::getMemory()
+{
+  return mMemory;
+}
+
 bool init()
 {
   //Initialization flag
@@ -317,12 +586,22 @@ bool loadMedia()
     success = false;
   }
 
+  //Warm the cache before the scene needs it
+  gTextureCache.prefetch( "arrow.png" );
+
   //Load arrow texture
-  if( !gArrowTexture.loadFromFile( "arrow.png" ) )
+  if( !gArrowTexture.loadFromCache( gTextureCache, "arrow.png" ) )
   {
     printf( "Failed to load arrow texture!\n" );
     success = false;
   }
+
+  //Load compass texture, sharing the arrow's cache entry instead of loading it again
+  if( !gCompassTexture.loadFromCache( gTextureCache, "arrow.png" ) )
+  {
+    printf( "Failed to load compass texture!\n" );
+    success = false;
+  }
   
   return success;
 }
@@ -331,6 +610,11 @@ void close()
 {
   //Free loaded images
   gArrowTexture.free();
+  gCompassTexture.free();
+
+  //Report and free cached textures
+  printf( "Texture cache: %d hits, %d misses, %d evictions, %d KB resident\n", gTextureCache.getHits(), gTextureCache.getMisses(), gTextureCache.getEvictions(), (int)( gTextureCache.getMemory() / 1024 ) );
+  gTextureCache.free();
 
   //Close game controller
   SDL_JoystickClose( gGameController );
@@ -445,6 +729,9 @@ int main( int argc, char* args[] )
         //Render joystick 8 way angle
         gArrowTexture.render( ( SCREEN_WIDTH - gArrowTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gArrowTexture.getHeight() ) / 2, NULL, joystickAngle );
 
+        //Render compass in the corner pointing back the other way
+        gCompassTexture.render( 0, 0, NULL, joystickAngle + 180.0 );
+
         //Update screen
         SDL_RenderPresent( gRenderer );
       }
@@ -1,16 +1,26 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, standard IO, strings, vectors, and file stats
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <string>
+#include <vector>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Atlas page size limit, padding between packed images, and cache format version
+const int ATLAS_PAGE_SIZE = 2048;
+const int ATLAS_PADDING = 1;
+const int ATLAS_VERSION = 1;
+
+//Texture atlas, defined below
+class LTextureAtlas;
+
 //Texture wrapper class
 class LTexture
 {
@@ -23,6 +33,9 @@ class LTexture
 
 		//Loads image at specified path
 		bool loadFromFile( std::string path );
+
+		//Uses an image packed into an atlas, sharing the atlas page
+		bool loadFromAtlas( LTextureAtlas& atlas, std::string path );
 		
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		//Creates image from font string
@@ -55,6 +68,80 @@ class LTexture
 		//Image dimensions
 		int mWidth;
 		int mHeight;
+
+		//Position of the image inside the hardware texture
+		int mOffsetX, mOffsetY;
+
+		//Whether the hardware texture belongs to an atlas
+		bool mShared;
+
+		//Modulation of a shared texture, applied when rendering
+		SDL_Color mColor;
+};
+
+//Texture atlas class
+class LTextureAtlas
+{
+	public:
+		//Initializes variables
+		LTextureAtlas();
+
+		//Deallocates memory
+		~LTextureAtlas();
+
+		//Queues image at specified path for packing
+		void addImage( std::string path );
+
+		//Packs queued images into pages, reusing the cache when it is up to date
+		bool pack( std::string cachePath );
+
+		//Deallocates pages
+		void free();
+
+		//Gets the page holding an image and the image's area on it
+		SDL_Texture* getImage( std::string path, SDL_Rect& region );
+
+		//Gets packing stats
+		int getPageCount();
+		double getEfficiency();
+
+	private:
+		//Image placed on a page
+		struct Image
+		{
+			std::string path;
+			long modified;
+			int page;
+			SDL_Rect region;
+		};
+
+		//Stretch of the top edge of used space on a page
+		struct Segment
+		{
+			int x, y, w;
+		};
+
+		//Loads pages and layout from the cache
+		bool loadCache( std::string cachePath );
+
+		//Loads queued images and packs them
+		bool build( std::string cachePath );
+
+		//Saves pages and layout to the cache
+		void saveCache( std::string cachePath, std::vector<SDL_Surface*>& pages );
+
+		//Finds the lowest spot on a skyline that fits the given size
+		bool findSpot( std::vector<Segment>& skyline, int pageSize, int w, int h, int& x, int& y, int& segment );
+
+		//Raises the skyline under a placed rectangle
+		void place( std::vector<Segment>& skyline, int segment, int x, int y, int w, int h );
+
+		//The packed images
+		std::vector<Image> mImages;
+
+		//The page textures and their dimensions
+		std::vector<SDL_Texture*> mPages;
+		std::vector<SDL_Point> mPageSizes;
 };
 
 //Starts up SDL and creates window
@@ -79,12 +166,22 @@ LTexture gDownTexture;
 LTexture gLeftTexture;
 LTexture gRightTexture;
 
+//Atlas holding the scene textures
+LTextureAtlas gAtlas;
+
 LTexture::LTexture()
 {
 	//Initialize
 	mTexture = NULL;
 	mWidth = 0;
 	mHeight = 0;
+	mOffsetX = 0;
+	mOffsetY = 0;
+	mShared = false;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
 }
 
 LTexture::~LTexture()
@@ -134,6 +231,37 @@ bool LTexture::loadFromFile( std::string path )
 	return mTexture != NULL;
 }
 
+bool LTexture::loadFromAtlas( LTextureAtlas& atlas, std::string path )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Find the packed image
+	SDL_Rect region;
+	SDL_Texture* page = atlas.getImage( path, region );
+	if( page == NULL )
+	{
+		printf( "Unable to find %s in texture atlas!\n", path.c_str() );
+	}
+	else
+	{
+		//Share the page
+		mTexture = page;
+		mShared = true;
+		mOffsetX = region.x;
+		mOffsetY = region.y;
+		mWidth = region.w;
+		mHeight = region.h;
+		mColor.r = 0xFF;
+		mColor.g = 0xFF;
+		mColor.b = 0xFF;
+		mColor.a = 0xFF;
+	}
+
+	//Return success
+	return mTexture != NULL;
+}
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -173,20 +301,35 @@ bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColo
 
 void LTexture::free()
 {
-	//Free texture if it exists
+	//Free texture if it exists, atlas pages are freed by their atlas
 	if( mTexture != NULL )
 	{
-		SDL_DestroyTexture( mTexture );
+		if( !mShared )
+		{
+			SDL_DestroyTexture( mTexture );
+		}
 		mTexture = NULL;
 		mWidth = 0;
 		mHeight = 0;
+		mOffsetX = 0;
+		mOffsetY = 0;
+		mShared = false;
 	}
 }
 
 void LTexture::setColor( Uint8 red, Uint8 green, Uint8 blue )
 {
-	//Modulate texture rgb
-	SDL_SetTextureColorMod( mTexture, red, green, blue );
+	//Modulate texture rgb, shared pages are modulated when rendering
+	if( mShared )
+	{
+		mColor.r = red;
+		mColor.g = green;
+		mColor.b = blue;
+	}
+	else
+	{
+		SDL_SetTextureColorMod( mTexture, red, green, blue );
+	}
 }
 
 void LTexture::setBlendMode( SDL_BlendMode blending )
@@ -197,8 +340,15 @@ void LTexture::setBlendMode( SDL_BlendMode blending )
 		
 void LTexture::setAlpha( Uint8 alpha )
 {
-	//Modulate texture alpha
-	SDL_SetTextureAlphaMod( mTexture, alpha );
+	//Modulate texture alpha, shared pages are modulated when rendering
+	if( mShared )
+	{
+		mColor.a = alpha;
+	}
+	else
+	{
+		SDL_SetTextureAlphaMod( mTexture, alpha );
+	}
 }
 
 void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
@@ -206,15 +356,30 @@ void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* ce
 	//Set rendering space and render to screen
 	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
 
+	//Area of the hardware texture to show
+	SDL_Rect source = { mOffsetX, mOffsetY, mWidth, mHeight };
+
 	//Set clip rendering dimensions
 	if( clip != NULL )
 	{
 		renderQuad.w = clip->w;
 		renderQuad.h = clip->h;
+
+		source.x += clip->x;
+		source.y += clip->y;
+		source.w = clip->w;
+		source.h = clip->h;
+	}
+
+	//Apply this image's modulation to the shared page
+	if( mShared )
+	{
+		SDL_SetTextureColorMod( mTexture, mColor.r, mColor.g, mColor.b );
+		SDL_SetTextureAlphaMod( mTexture, mColor.a );
 	}
 
 	//Render to screen
-	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
+	SDL_RenderCopyEx( gRenderer, mTexture, &source, &renderQuad, angle, center, flip );
 }
 
 int LTexture::getWidth()
@@ -227,6 +392,459 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+LTextureAtlas::LTextureAtlas()
+{
+}
+
+LTextureAtlas::~LTextureAtlas()
+{
+	//Deallocate
+	free();
+}
+
+void LTextureAtlas::addImage( std::string path )
+{
+	//Remember when the source was last changed
+	Image image;
+	image.path = path;
+	image.modified = 0;
+	image.page = -1;
+	image.region.x = 0;
+	image.region.y = 0;
+	image.region.w = 0;
+	image.region.h = 0;
+
+	struct stat info;
+	if( stat( path.c_str(), &info ) == 0 )
+	{
+		image.modified = info.st_mtime;
+	}
+
+	mImages.push_back( image );
+}
+
+bool LTextureAtlas::pack( std::string cachePath )
+{
+	//Get rid of preexisting pages
+	for( int i = 0; i < mPages.size(); ++i )
+	{
+		SDL_DestroyTexture( mPages[ i ] );
+	}
+	mPages.clear();
+	mPageSizes.clear();
+
+	//Only pack again when the sources changed
+	bool success = loadCache( cachePath );
+	if( !success )
+	{
+		success = build( cachePath );
+	}
+
+	if( success )
+	{
+		printf( "Packed %d images into %d pages, %.1f%% used\n", (int)mImages.size(), getPageCount(), 100.0 * getEfficiency() );
+	}
+
+	return success;
+}
+
+void LTextureAtlas::free()
+{
+	//Free pages
+	for( int i = 0; i < mPages.size(); ++i )
+	{
+		SDL_DestroyTexture( mPages[ i ] );
+	}
+	mPages.clear();
+	mPageSizes.clear();
+	mImages.clear();
+}
+
+SDL_Texture* LTextureAtlas::getImage( std::string path, SDL_Rect& region )
+{
+	//Find the image
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		if( mImages[ i ].path == path && mImages[ i ].page >= 0 && mImages[ i ].page < mPages.size() )
+		{
+			region = mImages[ i ].region;
+			return mPages[ mImages[ i ].page ];
+		}
+	}
+
+	return NULL;
+}
+
+int LTextureAtlas::getPageCount()
+{
+	return mPages.size();
+}
+
+double LTextureAtlas::getEfficiency()
+{
+	//Image area over page area
+	double used = 0, total = 0;
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		used += mImages[ i ].region.w * mImages[ i ].region.h;
+	}
+	for( int i = 0; i < mPageSizes.size(); ++i )
+	{
+		total += mPageSizes[ i ].x * mPageSizes[ i ].y;
+	}
+
+	return total > 0 ? used / total : 0;
+}
+
+bool LTextureAtlas::loadCache( std::string cachePath )
+{
+	//Open the layout
+	FILE* file = fopen( cachePath.c_str(), "r" );
+	if( file == NULL )
+	{
+		return false;
+	}
+
+	//Check version and counts
+	bool success = true;
+	int version = 0, pageCount = 0, imageCount = 0;
+	if( fscanf( file, "%d %d %d", &version, &pageCount, &imageCount ) != 3 || version != ATLAS_VERSION || imageCount != mImages.size() )
+	{
+		success = false;
+	}
+
+	//Read page dimensions
+	std::vector<SDL_Point> sizes;
+	for( int i = 0; success && i < pageCount; ++i )
+	{
+		SDL_Point size;
+		if( fscanf( file, "%d %d", &size.x, &size.y ) != 2 )
+		{
+			success = false;
+		}
+		sizes.push_back( size );
+	}
+
+	//Read image placements, which must match the queued sources
+	std::vector<Image> images = mImages;
+	for( int i = 0; success && i < imageCount; ++i )
+	{
+		Image& image = images[ i ];
+		long modified = 0;
+		char path[ 1024 ];
+		if( fscanf( file, "%d %d %d %d %d %ld %1023[^\n]", &image.page, &image.region.x, &image.region.y, &image.region.w, &image.region.h, &modified, path ) != 7 ||
+			image.path != path || image.modified != modified || image.page < 0 || image.page >= pageCount )
+		{
+			success = false;
+		}
+	}
+	fclose( file );
+
+	//Load the packed pages
+	for( int i = 0; success && i < pageCount; ++i )
+	{
+		char pagePath[ 1100 ];
+		snprintf( pagePath, sizeof( pagePath ), "%s.%d.png", cachePath.c_str(), i );
+		SDL_Texture* page = IMG_LoadTexture( gRenderer, pagePath );
+		if( page == NULL )
+		{
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode( page, SDL_BLENDMODE_BLEND );
+			mPages.push_back( page );
+		}
+	}
+
+	if( success )
+	{
+		mImages = images;
+		mPageSizes = sizes;
+	}
+	else
+	{
+		//Stale or broken cache
+		for( int i = 0; i < mPages.size(); ++i )
+		{
+			SDL_DestroyTexture( mPages[ i ] );
+		}
+		mPages.clear();
+	}
+
+	return success;
+}
+
+bool LTextureAtlas::build( std::string cachePath )
+{
+	//Largest page the renderer can hold
+	int pageSize = ATLAS_PAGE_SIZE;
+	SDL_RendererInfo info;
+	if( SDL_GetRendererInfo( gRenderer, &info ) == 0 && info.max_texture_width > 0 )
+	{
+		pageSize = SDL_min( pageSize, SDL_min( info.max_texture_width, info.max_texture_height ) );
+	}
+
+	//Load the images with the color key turned into alpha
+	bool success = true;
+	std::vector<SDL_Surface*> surfaces( mImages.size(), (SDL_Surface*)NULL );
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		SDL_Surface* loadedSurface = IMG_Load( mImages[ i ].path.c_str() );
+		if( loadedSurface == NULL )
+		{
+			printf( "Unable to load image %s! SDL_image Error: %s\n", mImages[ i ].path.c_str(), IMG_GetError() );
+			success = false;
+		}
+		else
+		{
+			SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+			surfaces[ i ] = SDL_ConvertSurfaceFormat( loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0 );
+			SDL_FreeSurface( loadedSurface );
+
+			if( surfaces[ i ] == NULL )
+			{
+				printf( "Unable to convert image %s! SDL Error: %s\n", mImages[ i ].path.c_str(), SDL_GetError() );
+				success = false;
+			}
+			else if( surfaces[ i ]->w + ATLAS_PADDING > pageSize || surfaces[ i ]->h + ATLAS_PADDING > pageSize )
+			{
+				printf( "Image %s does not fit in a %dx%d atlas page!\n", mImages[ i ].path.c_str(), pageSize, pageSize );
+				success = false;
+			}
+		}
+	}
+
+	//Pack tallest images first
+	std::vector<int> order;
+	for( int i = 0; success && i < mImages.size(); ++i )
+	{
+		int j = order.size();
+		order.push_back( i );
+		while( j > 0 && surfaces[ order[ j - 1 ] ]->h < surfaces[ i ]->h )
+		{
+			order[ j ] = order[ j - 1 ];
+			--j;
+		}
+		order[ j ] = i;
+	}
+
+	//Place each image on the first page with room, opening pages as needed
+	std::vector< std::vector<Segment> > skylines;
+	for( int i = 0; i < order.size(); ++i )
+	{
+		Image& image = mImages[ order[ i ] ];
+		int w = surfaces[ order[ i ] ]->w + ATLAS_PADDING;
+		int h = surfaces[ order[ i ] ]->h + ATLAS_PADDING;
+
+		int x = 0, y = 0, segment = 0;
+		image.page = -1;
+		for( int page = 0; page < skylines.size() && image.page < 0; ++page )
+		{
+			if( findSpot( skylines[ page ], pageSize, w, h, x, y, segment ) )
+			{
+				image.page = page;
+			}
+		}
+		if( image.page < 0 )
+		{
+			Segment ground = { 0, 0, pageSize };
+			skylines.push_back( std::vector<Segment>( 1, ground ) );
+			image.page = skylines.size() - 1;
+			findSpot( skylines.back(), pageSize, w, h, x, y, segment );
+		}
+		place( skylines[ image.page ], segment, x, y, w, h );
+
+		image.region.x = x;
+		image.region.y = y;
+		image.region.w = w - ATLAS_PADDING;
+		image.region.h = h - ATLAS_PADDING;
+	}
+
+	//Trim pages to the used area
+	for( int page = 0; page < skylines.size(); ++page )
+	{
+		SDL_Point size = { 0, 0 };
+		for( int i = 0; i < mImages.size(); ++i )
+		{
+			if( mImages[ i ].page == page )
+			{
+				size.x = SDL_max( size.x, mImages[ i ].region.x + mImages[ i ].region.w );
+				size.y = SDL_max( size.y, mImages[ i ].region.y + mImages[ i ].region.h );
+			}
+		}
+		mPageSizes.push_back( size );
+	}
+
+	//Copy the images onto the pages
+	std::vector<SDL_Surface*> pages;
+	for( int page = 0; success && page < mPageSizes.size(); ++page )
+	{
+		SDL_Surface* pageSurface = SDL_CreateRGBSurfaceWithFormat( 0, mPageSizes[ page ].x, mPageSizes[ page ].y, 32, SDL_PIXELFORMAT_ARGB8888 );
+		if( pageSurface == NULL )
+		{
+			printf( "Unable to create atlas page! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+			break;
+		}
+		SDL_FillRect( pageSurface, NULL, 0 );
+
+		for( int i = 0; i < mImages.size(); ++i )
+		{
+			if( mImages[ i ].page == page )
+			{
+				//Copy alpha as is instead of blending
+				SDL_SetSurfaceBlendMode( surfaces[ i ], SDL_BLENDMODE_NONE );
+				SDL_BlitSurface( surfaces[ i ], NULL, pageSurface, &mImages[ i ].region );
+			}
+		}
+
+		//Create page texture
+		SDL_Texture* pageTexture = SDL_CreateTextureFromSurface( gRenderer, pageSurface );
+		if( pageTexture == NULL )
+		{
+			printf( "Unable to create atlas texture! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode( pageTexture, SDL_BLENDMODE_BLEND );
+			mPages.push_back( pageTexture );
+		}
+		pages.push_back( pageSurface );
+	}
+
+	//Keep the result for the next startup
+	if( success )
+	{
+		saveCache( cachePath, pages );
+	}
+
+	//Get rid of surfaces
+	for( int i = 0; i < pages.size(); ++i )
+	{
+		SDL_FreeSurface( pages[ i ] );
+	}
+	for( int i = 0; i < surfaces.size(); ++i )
+	{
+		if( surfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( surfaces[ i ] );
+		}
+	}
+
+	return success;
+}
+
+void LTextureAtlas::saveCache( std::string cachePath, std::vector<SDL_Surface*>& pages )
+{
+	//Save pages
+	for( int i = 0; i < pages.size(); ++i )
+	{
+		char pagePath[ 1100 ];
+		snprintf( pagePath, sizeof( pagePath ), "%s.%d.png", cachePath.c_str(), i );
+		if( IMG_SavePNG( pages[ i ], pagePath ) != 0 )
+		{
+			printf( "Unable to save atlas page %s! SDL_image Error: %s\n", pagePath, IMG_GetError() );
+			return;
+		}
+	}
+
+	//Save layout
+	FILE* file = fopen( cachePath.c_str(), "w" );
+	if( file == NULL )
+	{
+		printf( "Unable to save atlas layout %s!\n", cachePath.c_str() );
+		return;
+	}
+
+	fprintf( file, "%d %d %d\n", ATLAS_VERSION, (int)mPageSizes.size(), (int)mImages.size() );
+	for( int i = 0; i < mPageSizes.size(); ++i )
+	{
+		fprintf( file, "%d %d\n", mPageSizes[ i ].x, mPageSizes[ i ].y );
+	}
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		Image& image = mImages[ i ];
+		fprintf( file, "%d %d %d %d %d %ld %s\n", image.page, image.region.x, image.region.y, image.region.w, image.region.h, image.modified, image.path.c_str() );
+	}
+	fclose( file );
+}
+
+bool LTextureAtlas::findSpot( std::vector<Segment>& skyline, int pageSize, int w, int h, int& x, int& y, int& segment )
+{
+	//Try resting the rectangle's left edge on each segment
+	bool found = false;
+	for( int i = 0; i < skyline.size(); ++i )
+	{
+		int left = skyline[ i ].x;
+		if( left + w > pageSize )
+		{
+			break;
+		}
+
+		//Rest on the highest segment underneath
+		int top = 0;
+		for( int j = i; j < skyline.size() && skyline[ j ].x < left + w; ++j )
+		{
+			top = SDL_max( top, skyline[ j ].y );
+		}
+
+		//Keep the lowest spot
+		if( top + h <= pageSize && ( !found || top < y ) )
+		{
+			found = true;
+			x = left;
+			y = top;
+			segment = i;
+		}
+	}
+
+	return found;
+}
+
+void LTextureAtlas::place( std::vector<Segment>& skyline, int segment, int x, int y, int w, int h )
+{
+	//New top edge over the rectangle
+	Segment top = { x, y + h, w };
+	skyline.insert( skyline.begin() + segment, top );
+
+	//Cut away the segments it covers
+	for( int i = segment + 1; i < skyline.size(); )
+	{
+		int overlap = x + w - skyline[ i ].x;
+		if( overlap <= 0 )
+		{
+			break;
+		}
+
+		skyline[ i ].x += overlap;
+		skyline[ i ].w -= overlap;
+		if( skyline[ i ].w <= 0 )
+		{
+			skyline.erase( skyline.begin() + i );
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	//Merge neighbours at the same height
+	for( int i = 0; i + 1 < skyline.size(); )
+	{
+		if( skyline[ i ].y == skyline[ i + 1 ].y )
+		{
+			skyline[ i ].w += skyline[ i + 1 ].w;
+			skyline.erase( skyline.begin() + i + 1 );
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
 bool init()
 {
 	//Initialization flag
@@ -286,36 +904,48 @@ bool loadMedia()
 	//Loading success flag
 	bool success = true;
 
+	//Pack the key images into one texture
+	gAtlas.addImage( "18_key_states/press.png" );
+	gAtlas.addImage( "18_key_states/up.png" );
+	gAtlas.addImage( "18_key_states/down.png" );
+	gAtlas.addImage( "18_key_states/left.png" );
+	gAtlas.addImage( "18_key_states/right.png" );
+	if( !gAtlas.pack( "18_key_states/keys.atlas" ) )
+	{
+		printf( "Failed to pack texture atlas!\n" );
+		success = false;
+	}
+
 	//Load press texture
-	if( !gPressTexture.loadFromFile( "18_key_states/press.png" ) )
+	if( !gPressTexture.loadFromAtlas( gAtlas, "18_key_states/press.png" ) )
 	{
 		printf( "Failed to load press texture!\n" );
 		success = false;
 	}
 	
 	//Load up texture
-	if( !gUpTexture.loadFromFile( "18_key_states/up.png" ) )
+	if( !gUpTexture.loadFromAtlas( gAtlas, "18_key_states/up.png" ) )
 	{
 		printf( "Failed to load up texture!\n" );
 		success = false;
 	}
 
 	//Load down texture
-	if( !gDownTexture.loadFromFile( "18_key_states/down.png" ) )
+	if( !gDownTexture.loadFromAtlas( gAtlas, "18_key_states/down.png" ) )
 	{
 		printf( "Failed to load down texture!\n" );
 		success = false;
 	}
 
 	//Load left texture
-	if( !gLeftTexture.loadFromFile( "18_key_states/left.png" ) )
+	if( !gLeftTexture.loadFromAtlas( gAtlas, "18_key_states/left.png" ) )
 	{
 		printf( "Failed to load left texture!\n" );
 		success = false;
 	}
 
 	//Load right texture
-	if( !gRightTexture.loadFromFile( "18_key_states/right.png" ) )
+	if( !gRightTexture.loadFromAtlas( gAtlas, "18_key_states/right.png" ) )
 	{
 		printf( "Failed to load right texture!\n" );
 		success = false;
@@ -332,6 +962,7 @@ void close()
 	gDownTexture.free();
 	gLeftTexture.free();
 	gRightTexture.free();
+	gAtlas.free();
 
 	//Destroy window	
 	SDL_DestroyRenderer( gRenderer );
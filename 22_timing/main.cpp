@@ -1,18 +1,22 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, SDL_ttf, standard IO, strings, and string streams
+//Using SDL, SDL_image, SDL_ttf, standard IO, strings, string streams, and vectors
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <vector>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Glyph atlas dimensions
+const int GLYPH_ATLAS_SIZE = 512;
+
 //Texture wrapper class
 class LTexture
 {
@@ -59,6 +63,65 @@ class LTexture
 		int mHeight;
 };
 
+//Font glyphs rasterized once into an atlas and drawn as quads
+class LGlyphCache
+{
+	public:
+		//Initializes variables
+		LGlyphCache();
+
+		//Deallocates memory
+		~LGlyphCache();
+
+		//Creates the atlas for the font, glyphs are rasterized the first time text uses them
+		bool load( TTF_Font* font );
+
+		//Deallocates atlas
+		void free();
+
+		//Shows text in the given color with one geometry call
+		void renderText( int x, int y, std::string text, SDL_Color color );
+
+		//Gets the dimensions text is shown with
+		int getTextWidth( std::string text );
+		int getHeight();
+
+	private:
+		//Where a glyph is in the atlas and how far it moves the pen
+		struct Glyph
+		{
+			SDL_Rect clip;
+			int advance;
+			bool cached;
+		};
+
+		//Forgets every glyph, used when the font's style changes
+		void reset();
+
+		//Rasterizes a glyph into the atlas on first use
+		void cacheGlyph( Uint8 character );
+
+		//Font and style the glyphs were rasterized with, the font itself carries the size
+		TTF_Font* mFont;
+		int mStyle;
+
+		//The atlas texture
+		SDL_Texture* mAtlas;
+
+		//Next free spot in the atlas, filled row by row
+		int mPenX, mPenY, mRowHeight;
+
+		//Glyphs by Latin-1 character
+		Glyph mGlyphs[ 256 ];
+
+		//Line height
+		int mHeight;
+
+		//Quads reused by every call
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+};
+
 //Starts up SDL and creates window
 bool init();
 
@@ -77,8 +140,10 @@ SDL_Renderer* gRenderer = NULL;
 //Globally used font
 TTF_Font *gFont = NULL;
 
+//Glyphs of the global font
+LGlyphCache gGlyphCache;
+
 //Scene textures
-LTexture gTimeTextTexture;
 LTexture gPromptTextTexture;
 
 LTexture::LTexture()
@@ -229,6 +294,227 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+LGlyphCache::LGlyphCache()
+{
+	//Initialize
+	mFont = NULL;
+	mStyle = TTF_STYLE_NORMAL;
+	mAtlas = NULL;
+	mHeight = 0;
+	reset();
+}
+
+LGlyphCache::~LGlyphCache()
+{
+	//Deallocate
+	free();
+}
+
+bool LGlyphCache::load( TTF_Font* font )
+{
+	//Get rid of preexisting atlas
+	free();
+
+	//Create the atlas, glyphs are copied in so it never gets recreated
+	mAtlas = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE );
+	if( mAtlas == NULL )
+	{
+		printf( "Unable to create glyph atlas! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+	SDL_SetTextureBlendMode( mAtlas, SDL_BLENDMODE_BLEND );
+
+	//Start transparent so filtering at glyph edges blends with nothing
+	std::vector<Uint32> clear( GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0 );
+	SDL_UpdateTexture( mAtlas, NULL, &clear[ 0 ], GLYPH_ATLAS_SIZE * 4 );
+
+	mFont = font;
+	mStyle = TTF_GetFontStyle( font );
+	mHeight = TTF_FontHeight( font );
+	reset();
+
+	return true;
+}
+
+void LGlyphCache::free()
+{
+	//Free atlas if it exists
+	if( mAtlas != NULL )
+	{
+		SDL_DestroyTexture( mAtlas );
+		mAtlas = NULL;
+		mFont = NULL;
+		mHeight = 0;
+	}
+}
+
+void LGlyphCache::renderText( int x, int y, std::string text, SDL_Color color )
+{
+	//No atlas
+	if( mAtlas == NULL )
+	{
+		return;
+	}
+
+	//Restyled glyphs need to be rasterized again
+	if( TTF_GetFontStyle( mFont ) != mStyle )
+	{
+		mStyle = TTF_GetFontStyle( mFont );
+		reset();
+	}
+
+	//Keep the storage from the last call
+	mVertices.clear();
+	mIndices.clear();
+
+	//Go through the text
+	int penX = x;
+	for( int i = 0; i < text.length(); ++i )
+	{
+		Uint8 character = text[ i ];
+		if( !mGlyphs[ character ].cached )
+		{
+			cacheGlyph( character );
+		}
+		Glyph& glyph = mGlyphs[ character ];
+
+		//Add the glyph's quad, corners clockwise from top left
+		if( glyph.clip.w > 0 )
+		{
+			float left = (float)glyph.clip.x / GLYPH_ATLAS_SIZE;
+			float right = (float)( glyph.clip.x + glyph.clip.w ) / GLYPH_ATLAS_SIZE;
+			float top = (float)glyph.clip.y / GLYPH_ATLAS_SIZE;
+			float bottom = (float)( glyph.clip.y + glyph.clip.h ) / GLYPH_ATLAS_SIZE;
+
+			float cornerX[ 4 ] = { (float)penX, (float)( penX + glyph.clip.w ), (float)( penX + glyph.clip.w ), (float)penX };
+			float cornerY[ 4 ] = { (float)y, (float)y, (float)( y + glyph.clip.h ), (float)( y + glyph.clip.h ) };
+			float u[ 4 ] = { left, right, right, left };
+			float v[ 4 ] = { top, top, bottom, bottom };
+
+			int first = mVertices.size();
+			for( int j = 0; j < 4; ++j )
+			{
+				SDL_Vertex vertex;
+				vertex.position.x = cornerX[ j ];
+				vertex.position.y = cornerY[ j ];
+				vertex.color = color;
+				vertex.tex_coord.x = u[ j ];
+				vertex.tex_coord.y = v[ j ];
+				mVertices.push_back( vertex );
+			}
+
+			//Two triangles per quad
+			mIndices.push_back( first );
+			mIndices.push_back( first + 1 );
+			mIndices.push_back( first + 2 );
+			mIndices.push_back( first );
+			mIndices.push_back( first + 2 );
+			mIndices.push_back( first + 3 );
+		}
+
+		//Move the pen
+		penX += glyph.advance;
+	}
+
+	//Draw the string at once
+	if( !mIndices.empty() )
+	{
+		SDL_RenderGeometry( gRenderer, mAtlas, &mVertices[ 0 ], mVertices.size(), &mIndices[ 0 ], mIndices.size() );
+	}
+}
+
+int LGlyphCache::getTextWidth( std::string text )
+{
+	//Add up the advances
+	int width = 0;
+	for( int i = 0; i < text.length() && mAtlas != NULL; ++i )
+	{
+		Uint8 character = text[ i ];
+		if( !mGlyphs[ character ].cached )
+		{
+			cacheGlyph( character );
+		}
+		width += mGlyphs[ character ].advance;
+	}
+
+	return width;
+}
+
+int LGlyphCache::getHeight()
+{
+	return mHeight;
+}
+
+void LGlyphCache::reset()
+{
+	//Start filling the atlas from the top left again
+	mPenX = 0;
+	mPenY = 0;
+	mRowHeight = 0;
+	for( int i = 0; i < 256; ++i )
+	{
+		mGlyphs[ i ].clip.x = 0;
+		mGlyphs[ i ].clip.y = 0;
+		mGlyphs[ i ].clip.w = 0;
+		mGlyphs[ i ].clip.h = 0;
+		mGlyphs[ i ].advance = 0;
+		mGlyphs[ i ].cached = false;
+	}
+}
+
+void LGlyphCache::cacheGlyph( Uint8 character )
+{
+	//Missing glyphs stay empty and are not tried again
+	Glyph& glyph = mGlyphs[ character ];
+	glyph.cached = true;
+
+	//Get how far the glyph moves the pen
+	if( TTF_GlyphMetrics( mFont, character, NULL, NULL, NULL, NULL, &glyph.advance ) != 0 )
+	{
+		return;
+	}
+
+	//Render in white so the color can be applied per vertex
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	SDL_Surface* glyphSurface = TTF_RenderGlyph_Blended( mFont, character, white );
+	if( glyphSurface == NULL )
+	{
+		printf( "Unable to render glyph! SDL_ttf Error: %s\n", TTF_GetError() );
+		return;
+	}
+
+	//Move to the next row when this one is full, leaving a pixel between glyphs
+	if( mPenX + glyphSurface->w > GLYPH_ATLAS_SIZE )
+	{
+		mPenX = 0;
+		mPenY += mRowHeight + 1;
+		mRowHeight = 0;
+	}
+
+	//Copy the glyph into the atlas
+	if( mPenY + glyphSurface->h > GLYPH_ATLAS_SIZE )
+	{
+		printf( "Glyph atlas is full!\n" );
+	}
+	else
+	{
+		glyph.clip.x = mPenX;
+		glyph.clip.y = mPenY;
+		glyph.clip.w = glyphSurface->w;
+		glyph.clip.h = glyphSurface->h;
+		SDL_UpdateTexture( mAtlas, &glyph.clip, glyphSurface->pixels, glyphSurface->pitch );
+
+		mPenX += glyphSurface->w + 1;
+		if( glyphSurface->h > mRowHeight )
+		{
+			mRowHeight = glyphSurface->h;
+		}
+	}
+
+	//Get rid of the glyph surface
+	SDL_FreeSurface( glyphSurface );
+}
+
 bool init()
 {
 	//Initialization flag
@@ -304,6 +590,13 @@ bool loadMedia()
 	}
 	else
 	{
+		//Rasterize glyphs into an atlas as text needs them
+		if( !gGlyphCache.load( gFont ) )
+		{
+			printf( "Unable to create glyph cache!\n" );
+			success = false;
+		}
+
 		//Set text color as black
 		SDL_Color textColor = { 0, 0, 0, 255 };
 		
@@ -321,9 +614,11 @@ bool loadMedia()
 void close()
 {
 	//Free loaded images
-	gTimeTextTexture.free();
 	gPromptTextTexture.free();
 
+	//Free glyphs before their font
+	gGlyphCache.free();
+
 	//Free global font
 	TTF_CloseFont( gFont );
 	gFont = NULL;
@@ -393,19 +688,13 @@ int main( int argc, char* args[] )
 				timeText.str( "" );
 				timeText << "Milliseconds since start time " << SDL_GetTicks() - startTime; 
 
-				//Render text
-				if( !gTimeTextTexture.loadFromRenderedText( timeText.str().c_str(), textColor ) )
-				{
-					printf( "Unable to render time texture!\n" );
-				}
-
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
 				//Render textures
 				gPromptTextTexture.render( ( SCREEN_WIDTH - gPromptTextTexture.getWidth() ) / 2, 0 );
-				gTimeTextTexture.render( ( SCREEN_WIDTH - gPromptTextTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gPromptTextTexture.getHeight() ) / 2 );
+				gGlyphCache.renderText( ( SCREEN_WIDTH - gPromptTextTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gPromptTextTexture.getHeight() ) / 2, timeText.str(), textColor );
 
 				//Update screen
 				SDL_RenderPresent( gRenderer );
@@ -1,18 +1,23 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, SDL_ttf, standard IO, strings, and string streams
+//Using SDL, SDL_image, SDL_ttf, standard IO, strings, string streams, stream formatting, and vectors
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <iomanip>
+#include <vector>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Glyph atlas dimensions
+const int GLYPH_ATLAS_SIZE = 512;
+
 //Texture wrapper class
 class LTexture
 {
@@ -91,6 +96,128 @@ class LTimer
 		bool mStarted;
 };
 
+//Font glyphs rasterized once into an atlas and drawn as quads
+class LGlyphCache
+{
+	public:
+		//Initializes variables
+		LGlyphCache();
+
+		//Deallocates memory
+		~LGlyphCache();
+
+		//Creates the atlas for the font, glyphs are rasterized the first time text uses them
+		bool load( TTF_Font* font );
+
+		//Deallocates atlas
+		void free();
+
+		//Shows text in the given color with one geometry call
+		void renderText( int x, int y, std::string text, SDL_Color color );
+
+		//Adds quads for text starting at the given point, returns the width they cover
+		int layoutText( int x, int y, std::string text, SDL_Color color, std::vector<SDL_Vertex>& vertices, std::vector<int>& indices );
+
+		//Draws quads made by layoutText with one geometry call
+		void renderQuads( std::vector<SDL_Vertex>& vertices, std::vector<int>& indices );
+
+		//Gets a count that changes whenever glyphs move in the atlas, making old quads invalid
+		int getGeneration();
+
+		//Gets the dimensions text is shown with
+		int getTextWidth( std::string text );
+		int getHeight();
+
+	private:
+		//Where a glyph is in the atlas and how far it moves the pen
+		struct Glyph
+		{
+			SDL_Rect clip;
+			int advance;
+			bool cached;
+		};
+
+		//Forgets every glyph, used when the font's style changes
+		void reset();
+
+		//Rasterizes a glyph into the atlas on first use
+		void cacheGlyph( Uint8 character );
+
+		//Font and style the glyphs were rasterized with, the font itself carries the size
+		TTF_Font* mFont;
+		int mStyle;
+
+		//The atlas texture
+		SDL_Texture* mAtlas;
+
+		//Next free spot in the atlas, filled row by row
+		int mPenX, mPenY, mRowHeight;
+
+		//Glyphs by Latin-1 character
+		Glyph mGlyphs[ 256 ];
+
+		//Line height
+		int mHeight;
+
+		//Times the atlas was reset
+		int mGeneration;
+
+		//Quads reused by every call
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+};
+
+//Text that is only laid out again when its string or color changes
+class LText
+{
+	public:
+		//Initializes variables
+		LText();
+
+		//Sets the glyphs the text is drawn with
+		void setGlyphCache( LGlyphCache* cache );
+
+		//Sets the text, skipping the rebuild when nothing changed
+		void setText( std::string text, SDL_Color color );
+
+		//Shows the text, only moving its quads when the point changes
+		void render( int x, int y );
+
+		//Gets text dimensions
+		int getWidth();
+		int getHeight();
+
+		//Gets how many times the text was rebuilt and how many rebuilds were skipped
+		int getRebuilds();
+		int getSkippedRebuilds();
+
+	private:
+		//Glyphs the text is drawn with
+		LGlyphCache* mCache;
+
+		//Last string and color laid out
+		std::string mText;
+		SDL_Color mColor;
+
+		//Glyph cache generation the quads were made with
+		int mGeneration;
+
+		//Quads relative to the origin
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+
+		//Quads moved to the last rendered point
+		std::vector<SDL_Vertex> mPlaced;
+		int mPlacedX, mPlacedY;
+
+		//Text width
+		int mWidth;
+
+		//Rebuild counters
+		int mRebuilds;
+		int mSkippedRebuilds;
+};
+
 //Starts up SDL and creates window
 bool init();
 
@@ -109,8 +236,11 @@ SDL_Renderer* gRenderer = NULL;
 //Globally used font
 TTF_Font* gFont = NULL;
 
-//Scene textures
-LTexture gFPSTextTexture;
+//Glyphs of the global font
+LGlyphCache gGlyphCache;
+
+//Scene text
+LText gFPSText;
 
 LTexture::LTexture()
 {
@@ -362,6 +492,345 @@ bool LTimer::isPaused()
     return mPaused && mStarted;
 }
 
+LGlyphCache::LGlyphCache()
+{
+	//Initialize
+	mFont = NULL;
+	mStyle = TTF_STYLE_NORMAL;
+	mAtlas = NULL;
+	mHeight = 0;
+	mGeneration = 0;
+	reset();
+}
+
+LGlyphCache::~LGlyphCache()
+{
+	//Deallocate
+	free();
+}
+
+bool LGlyphCache::load( TTF_Font* font )
+{
+	//Get rid of preexisting atlas
+	free();
+
+	//Create the atlas, glyphs are copied in so it never gets recreated
+	mAtlas = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE );
+	if( mAtlas == NULL )
+	{
+		printf( "Unable to create glyph atlas! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+	SDL_SetTextureBlendMode( mAtlas, SDL_BLENDMODE_BLEND );
+
+	//Start transparent so filtering at glyph edges blends with nothing
+	std::vector<Uint32> clear( GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0 );
+	SDL_UpdateTexture( mAtlas, NULL, &clear[ 0 ], GLYPH_ATLAS_SIZE * 4 );
+
+	mFont = font;
+	mStyle = TTF_GetFontStyle( font );
+	mHeight = TTF_FontHeight( font );
+	reset();
+
+	return true;
+}
+
+void LGlyphCache::free()
+{
+	//Free atlas if it exists
+	if( mAtlas != NULL )
+	{
+		SDL_DestroyTexture( mAtlas );
+		mAtlas = NULL;
+		mFont = NULL;
+		mHeight = 0;
+	}
+}
+
+void LGlyphCache::renderText( int x, int y, std::string text, SDL_Color color )
+{
+	//Keep the storage from the last call
+	mVertices.clear();
+	mIndices.clear();
+
+	//Draw the string at once
+	layoutText( x, y, text, color, mVertices, mIndices );
+	renderQuads( mVertices, mIndices );
+}
+
+int LGlyphCache::layoutText( int x, int y, std::string text, SDL_Color color, std::vector<SDL_Vertex>& vertices, std::vector<int>& indices )
+{
+	//No atlas
+	if( mAtlas == NULL )
+	{
+		return 0;
+	}
+
+	//Restyled glyphs need to be rasterized again
+	if( TTF_GetFontStyle( mFont ) != mStyle )
+	{
+		mStyle = TTF_GetFontStyle( mFont );
+		reset();
+	}
+
+	//Go through the text
+	int penX = x;
+	for( int i = 0; i < text.length(); ++i )
+	{
+		Uint8 character = text[ i ];
+		if( !mGlyphs[ character ].cached )
+		{
+			cacheGlyph( character );
+		}
+		Glyph& glyph = mGlyphs[ character ];
+
+		//Add the glyph's quad, corners clockwise from top left
+		if( glyph.clip.w > 0 )
+		{
+			float left = (float)glyph.clip.x / GLYPH_ATLAS_SIZE;
+			float right = (float)( glyph.clip.x + glyph.clip.w ) / GLYPH_ATLAS_SIZE;
+			float top = (float)glyph.clip.y / GLYPH_ATLAS_SIZE;
+			float bottom = (float)( glyph.clip.y + glyph.clip.h ) / GLYPH_ATLAS_SIZE;
+
+			float cornerX[ 4 ] = { (float)penX, (float)( penX + glyph.clip.w ), (float)( penX + glyph.clip.w ), (float)penX };
+			float cornerY[ 4 ] = { (float)y, (float)y, (float)( y + glyph.clip.h ), (float)( y + glyph.clip.h ) };
+			float u[ 4 ] = { left, right, right, left };
+			float v[ 4 ] = { top, top, bottom, bottom };
+
+			int first = vertices.size();
+			for( int j = 0; j < 4; ++j )
+			{
+				SDL_Vertex vertex;
+				vertex.position.x = cornerX[ j ];
+				vertex.position.y = cornerY[ j ];
+				vertex.color = color;
+				vertex.tex_coord.x = u[ j ];
+				vertex.tex_coord.y = v[ j ];
+				vertices.push_back( vertex );
+			}
+
+			//Two triangles per quad
+			indices.push_back( first );
+			indices.push_back( first + 1 );
+			indices.push_back( first + 2 );
+			indices.push_back( first );
+			indices.push_back( first + 2 );
+			indices.push_back( first + 3 );
+		}
+
+		//Move the pen
+		penX += glyph.advance;
+	}
+
+	return penX - x;
+}
+
+void LGlyphCache::renderQuads( std::vector<SDL_Vertex>& vertices, std::vector<int>& indices )
+{
+	if( mAtlas != NULL && !indices.empty() )
+	{
+		SDL_RenderGeometry( gRenderer, mAtlas, &vertices[ 0 ], vertices.size(), &indices[ 0 ], indices.size() );
+	}
+}
+
+int LGlyphCache::getGeneration()
+{
+	return mGeneration;
+}
+
+int LGlyphCache::getTextWidth( std::string text )
+{
+	//Add up the advances
+	int width = 0;
+	for( int i = 0; i < text.length() && mAtlas != NULL; ++i )
+	{
+		Uint8 character = text[ i ];
+		if( !mGlyphs[ character ].cached )
+		{
+			cacheGlyph( character );
+		}
+		width += mGlyphs[ character ].advance;
+	}
+
+	return width;
+}
+
+int LGlyphCache::getHeight()
+{
+	return mHeight;
+}
+
+void LGlyphCache::reset()
+{
+	//Quads made before now point at the wrong spots
+	++mGeneration;
+
+	//Start filling the atlas from the top left again
+	mPenX = 0;
+	mPenY = 0;
+	mRowHeight = 0;
+	for( int i = 0; i < 256; ++i )
+	{
+		mGlyphs[ i ].clip.x = 0;
+		mGlyphs[ i ].clip.y = 0;
+		mGlyphs[ i ].clip.w = 0;
+		mGlyphs[ i ].clip.h = 0;
+		mGlyphs[ i ].advance = 0;
+		mGlyphs[ i ].cached = false;
+	}
+}
+
+void LGlyphCache::cacheGlyph( Uint8 character )
+{
+	//Missing glyphs stay empty and are not tried again
+	Glyph& glyph = mGlyphs[ character ];
+	glyph.cached = true;
+
+	//Get how far the glyph moves the pen
+	if( TTF_GlyphMetrics( mFont, character, NULL, NULL, NULL, NULL, &glyph.advance ) != 0 )
+	{
+		return;
+	}
+
+	//Render in white so the color can be applied per vertex
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	SDL_Surface* glyphSurface = TTF_RenderGlyph_Blended( mFont, character, white );
+	if( glyphSurface == NULL )
+	{
+		printf( "Unable to render glyph! SDL_ttf Error: %s\n", TTF_GetError() );
+		return;
+	}
+
+	//Move to the next row when this one is full, leaving a pixel between glyphs
+	if( mPenX + glyphSurface->w > GLYPH_ATLAS_SIZE )
+	{
+		mPenX = 0;
+		mPenY += mRowHeight + 1;
+		mRowHeight = 0;
+	}
+
+	//Copy the glyph into the atlas
+	if( mPenY + glyphSurface->h > GLYPH_ATLAS_SIZE )
+	{
+		printf( "Glyph atlas is full!\n" );
+	}
+	else
+	{
+		glyph.clip.x = mPenX;
+		glyph.clip.y = mPenY;
+		glyph.clip.w = glyphSurface->w;
+		glyph.clip.h = glyphSurface->h;
+		SDL_UpdateTexture( mAtlas, &glyph.clip, glyphSurface->pixels, glyphSurface->pitch );
+
+		mPenX += glyphSurface->w + 1;
+		if( glyphSurface->h > mRowHeight )
+		{
+			mRowHeight = glyphSurface->h;
+		}
+	}
+
+	//Get rid of the glyph surface
+	SDL_FreeSurface( glyphSurface );
+}
+
+LText::LText()
+{
+	//Initialize
+	mCache = NULL;
+	mColor.r = 0;
+	mColor.g = 0;
+	mColor.b = 0;
+	mColor.a = 0;
+	mGeneration = -1;
+	mPlacedX = 0;
+	mPlacedY = 0;
+	mWidth = 0;
+	mRebuilds = 0;
+	mSkippedRebuilds = 0;
+}
+
+void LText::setGlyphCache( LGlyphCache* cache )
+{
+	mCache = cache;
+
+	//Force the next setText to rebuild
+	mGeneration = -1;
+}
+
+void LText::setText( std::string text, SDL_Color color )
+{
+	//No glyphs to draw with
+	if( mCache == NULL )
+	{
+		return;
+	}
+
+	//Same text, color, and glyphs as last time
+	if( mGeneration == mCache->getGeneration() &&
+		color.r == mColor.r && color.g == mColor.g && color.b == mColor.b && color.a == mColor.a &&
+		text == mText )
+	{
+		++mSkippedRebuilds;
+		return;
+	}
+
+	//Lay out again, keeping the storage
+	mText = text;
+	mColor = color;
+	mVertices.clear();
+	mIndices.clear();
+	mPlaced.clear();
+	mWidth = mCache->layoutText( 0, 0, mText, mColor, mVertices, mIndices );
+
+	//Laying out may have reset the atlas, in which case this is the first layout of the new generation
+	mGeneration = mCache->getGeneration();
+	++mRebuilds;
+}
+
+void LText::render( int x, int y )
+{
+	//No glyphs to draw with
+	if( mCache == NULL )
+	{
+		return;
+	}
+
+	//Only move the quads when the point changes
+	if( mPlaced.size() != mVertices.size() || x != mPlacedX || y != mPlacedY )
+	{
+		mPlaced = mVertices;
+		for( int i = 0; i < mPlaced.size(); ++i )
+		{
+			mPlaced[ i ].position.x += x;
+			mPlaced[ i ].position.y += y;
+		}
+		mPlacedX = x;
+		mPlacedY = y;
+	}
+
+	mCache->renderQuads( mPlaced, mIndices );
+}
+
+int LText::getWidth()
+{
+	return mWidth;
+}
+
+int LText::getHeight()
+{
+	return mCache != NULL ? mCache->getHeight() : 0;
+}
+
+int LText::getRebuilds()
+{
+	return mRebuilds;
+}
+
+int LText::getSkippedRebuilds()
+{
+	return mSkippedRebuilds;
+}
+
 bool init()
 {
 	//Initialization flag
@@ -435,14 +904,29 @@ bool loadMedia()
 		printf( "Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError() );
 		success = false;
 	}
+	else
+	{
+		//Rasterize glyphs into an atlas as text needs them
+		if( !gGlyphCache.load( gFont ) )
+		{
+			printf( "Unable to create glyph cache!\n" );
+			success = false;
+		}
+
+		//Draw scene text with the cached glyphs
+		gFPSText.setGlyphCache( &gGlyphCache );
+	}
 
 	return success;
 }
 
 void close()
 {
-	//Free loaded images
-	gFPSTextTexture.free();
+	//Report how often the FPS text really changed
+	printf( "FPS text rebuilt %d times, %d rebuilds skipped\n", gFPSText.getRebuilds(), gFPSText.getSkippedRebuilds() );
+
+	//Free glyphs before their font
+	gGlyphCache.free();
 
 	//Free global font
 	TTF_CloseFont( gFont );
@@ -515,22 +999,17 @@ int main( int argc, char* args[] )
 					avgFPS = 0;
 				}
 				
-				//Set text to be rendered
+				//Set text to be rendered, whole frames only so the text stays the same between most frames and isn't rebuilt
 				timeText.str( "" );
-				timeText << "Average Frames Per Second " << avgFPS; 
-
-				//Render text
-				if( !gFPSTextTexture.loadFromRenderedText( timeText.str().c_str(), textColor ) )
-				{
-					printf( "Unable to render FPS texture!\n" );
-				}
+				timeText << "Average Frames Per Second " << std::fixed << std::setprecision( 0 ) << avgFPS;
+				gFPSText.setText( timeText.str(), textColor );
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
 				//Render textures
-				gFPSTextTexture.render( ( SCREEN_WIDTH - gFPSTextTexture.getWidth() ) / 2, ( SCREEN_HEIGHT - gFPSTextTexture.getHeight() ) / 2 );
+				gFPSText.render( ( SCREEN_WIDTH - gFPSText.getWidth() ) / 2, ( SCREEN_HEIGHT - gFPSText.getHeight() ) / 2 );
 
 				//Update screen
 				SDL_RenderPresent( gRenderer );
@@ -1,16 +1,52 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL_image, standard IO, math, strings, and vectors
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <string.h>
+#include <cmath>
 #include <string>
+#include <vector>
+
+//SIMD collision kernels are only built for x86
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#define COLLISION_SIMD
+#include <immintrin.h>
+#endif
+
+//Lets GCC and Clang build SSE2 and AVX2 functions without raising the target of the whole program
+#if defined( COLLISION_SIMD ) && defined( __GNUC__ )
+#define TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Broadphase cells are 1 << SPATIAL_CELL_SHIFT pixels wide, about twice the size of a body
+const int SPATIAL_CELL_SHIFT = 5;
+
+//Body counts the benchmark runs, spacing giving each body a fixed share of the world, and frames timed
+const int BENCHMARK_BODIES[] = { 1000, 10000, 100000 };
+const int BENCHMARK_SPACING = 40;
+const int BENCHMARK_FRAMES = 10;
+
+//Rects in the batch benchmark and rects tested against all of them
+const int BENCHMARK_BATCH = 4096;
+const int BENCHMARK_QUERIES = 4096;
+
+//Two bodies that may be colliding
+struct BodyPair
+{
+	int a, b;
+};
+
 //Texture wrapper class
 class LTexture
 {
@@ -57,6 +93,16 @@ class LTexture
 		int mHeight;
 };
 
+//Where a moving shape first touches another
+struct Contact
+{
+	//Fraction of the move made before touching
+	float time;
+
+	//Direction pointing out of the surface that was touched
+	float normalX, normalY;
+};
+
 //The dot that will move around on the screen
 class Dot
 {
@@ -74,7 +120,7 @@ class Dot
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
 
-		//Moves the dot and checks collision
+		//Moves the dot until it touches the wall, then slides along it
 		void move( SDL_Rect& wall );
 
 		//Shows the dot on the screen
@@ -91,6 +137,100 @@ class Dot
 		SDL_Rect mCollider;
 };
 
+//Uniform grid broadphase hashed by cell so the world has no bounds
+class LSpatialHash
+{
+    public:
+		//Initializes variables with the cell size as a power of two
+		LSpatialHash( int cellShift = SPATIAL_CELL_SHIFT );
+
+		//Removes all bodies, keeping memory for the next frame
+		void clear();
+
+		//Adds a body to every cell its box covers
+		void insert( int id, const SDL_Rect& box );
+
+		//Gets each pair of bodies sharing a cell once
+		void findPairs( std::vector<BodyPair>& pairs );
+
+    private:
+		//A body in one cell
+		struct Entry
+		{
+			int cellX, cellY;
+			int id;
+		};
+
+		//Gets the bucket a cell falls in
+		int getBucket( int cellX, int cellY, int mask );
+
+		//The cell size
+		int mCellShift;
+
+		//Boxes by body id
+		std::vector<SDL_Rect> mBoxes;
+
+		//Bodies in each cell they cover, and the same grouped by bucket
+		std::vector<Entry> mEntries;
+		std::vector<Entry> mSorted;
+
+		//Where each bucket ends in the grouped entries
+		std::vector<int> mBucketEnds;
+};
+
+//Instruction sets the batch tests can use
+enum CollisionPath
+{
+	COLLISION_PATH_SCALAR,
+	COLLISION_PATH_SSE2,
+	COLLISION_PATH_AVX2,
+	COLLISION_PATH_TOTAL
+};
+
+//Names of the collision paths
+const char* COLLISION_PATH_NAMES[ COLLISION_PATH_TOTAL ] = { "Scalar", "SSE2", "AVX2" };
+
+//Tests a rect against count rects given by their sides, setting a bit in hits for each overlap, hits has a word per 32 rects
+typedef void (*RectKernel)( const SDL_Rect& rect, const int* left, const int* top, const int* right, const int* bottom, Uint32* hits, int count );
+
+//Gets the kernel for a path, NULL if this build or CPU can't run it
+RectKernel getRectKernel( CollisionPath path );
+
+//Rects stored as one array per side so one rect can be tested against all of them at once
+class LRectBatch
+{
+    public:
+		//Initializes variables
+		LRectBatch();
+
+		//Removes all rects, keeping memory
+		void clear();
+
+		//Adds a rect
+		void add( const SDL_Rect& rect );
+
+		//Tests a rect against every rect in the batch, bit i % 32 of hits[ i / 32 ] is set if it overlaps rect i
+		void collide( const SDL_Rect& rect, std::vector<Uint32>& hits );
+
+		//Picks the instruction set used by collide, returns false if it's not available
+		bool setPath( CollisionPath path );
+		CollisionPath getPath();
+
+		//Gets the number of rects
+		int getCount();
+
+    private:
+		//Sides of each rect
+		std::vector<int> mLeft;
+		std::vector<int> mTop;
+		std::vector<int> mRight;
+		std::vector<int> mBottom;
+
+		//Kernel for the chosen instruction set
+		RectKernel mKernel;
+		CollisionPath mPath;
+};
+
 //Starts up SDL and creates window
 bool init();
 
@@ -103,6 +243,12 @@ void close();
 //Box collision detector
 bool checkCollision( SDL_Rect a, SDL_Rect b );
 
+//Swept box collision detector, finds when a box moving by the velocity first touches another, contact is left alone on a miss
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact );
+
+//Times naive pair testing against the broadphase
+void runBenchmark();
+
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
 
@@ -266,7 +412,9 @@ Dot::Dot()
     mPosX = 0;
     mPosY = 0;
 
-	//Set collision box dimension
+	//Set collision box
+	mCollider.x = mPosX;
+	mCollider.y = mPosY;
 	mCollider.w = DOT_WIDTH;
 	mCollider.h = DOT_HEIGHT;
 
@@ -305,28 +453,28 @@ void Dot::handleEvent( SDL_Event& e )
 
 void Dot::move( SDL_Rect& wall )
 {
-    //Move the dot left or right
-    mPosX += mVelX;
-	mCollider.x = mPosX;
+    //Keep the move inside the screen
+    int velX = SDL_max( -mPosX, SDL_min( mVelX, SCREEN_WIDTH - DOT_WIDTH - mPosX ) );
+    int velY = SDL_max( -mPosY, SDL_min( mVelY, SCREEN_HEIGHT - DOT_HEIGHT - mPosY ) );
 
-    //If the dot collided or went too far to the left or right
-    if( ( mPosX < 0 ) || ( mPosX + DOT_WIDTH > SCREEN_WIDTH ) || checkCollision( mCollider, wall ) )
+    //Move until the wall is touched, then slide along it with the rest of the move
+    for( int pass = 0; pass < 2 && ( velX != 0 || velY != 0 ); ++pass )
     {
-        //Move back
-        mPosX -= mVelX;
-		mCollider.x = mPosX;
-    }
-
-    //Move the dot up or down
-    mPosY += mVelY;
-	mCollider.y = mPosY;
-
-    //If the dot collided or went too far up or down
-    if( ( mPosY < 0 ) || ( mPosY + DOT_HEIGHT > SCREEN_HEIGHT ) || checkCollision( mCollider, wall ) )
-    {
-        //Move back
-        mPosY -= mVelY;
-		mCollider.y = mPosY;
+        //Find when the dot touches the wall, if it does
+        Contact contact = { 1.f, 0.f, 0.f };
+        sweepCollision( mCollider, velX, velY, wall, contact );
+
+        //Move up to it, rounding can't push the box in since every side is on a whole pixel
+        int moveX = (int)std::lround( velX * contact.time );
+        int moveY = (int)std::lround( velY * contact.time );
+        mPosX += moveX;
+        mPosY += moveY;
+        mCollider.x = mPosX;
+        mCollider.y = mPosY;
+
+        //Drop the part of what's left going into the wall
+        velX = contact.normalX != 0.f ? 0 : velX - moveX;
+        velY = contact.normalY != 0.f ? 0 : velY - moveY;
     }
 }
 
@@ -466,6 +614,489 @@ bool checkCollision( SDL_Rect a, SDL_Rect b )
     return true;
 }
 
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact )
+{
+    //The velocity and sides of both boxes by axis
+    int velocity[ 2 ] = { velX, velY };
+    int startA[ 2 ] = { a.x, a.y };
+    int endA[ 2 ] = { a.x + a.w, a.y + a.h };
+    int startB[ 2 ] = { b.x, b.y };
+    int endB[ 2 ] = { b.x + b.w, b.y + b.h };
+
+    //When the boxes start and stop overlapping on each axis
+    float enter[ 2 ], leave[ 2 ];
+    for( int axis = 0; axis < 2; ++axis )
+    {
+        if( velocity[ axis ] > 0 )
+        {
+            enter[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+        }
+        else if( velocity[ axis ] < 0 )
+        {
+            enter[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+        }
+        //Not moving on this axis, so it has to overlap the whole time
+        else if( startA[ axis ] < endB[ axis ] && endA[ axis ] > startB[ axis ] )
+        {
+            enter[ axis ] = -INFINITY;
+            leave[ axis ] = INFINITY;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    //The boxes overlap once they overlap on both axes
+    float enterBoth = SDL_max( enter[ 0 ], enter[ 1 ] );
+    float leaveBoth = SDL_min( leave[ 0 ], leave[ 1 ] );
+
+    //If they never overlap, only touch, already overlap, or don't reach each other this move
+    if( enterBoth >= leaveBoth || enterBoth < 0.f || enterBoth >= 1.f )
+    {
+        return false;
+    }
+
+    //The axis that started overlapping last is the one that was hit
+    contact.time = enterBoth;
+    contact.normalX = 0.f;
+    contact.normalY = 0.f;
+    if( enter[ 0 ] > enter[ 1 ] )
+    {
+        contact.normalX = velX > 0 ? -1.f : 1.f;
+    }
+    else
+    {
+        contact.normalY = velY > 0 ? -1.f : 1.f;
+    }
+
+    return true;
+}
+
+LSpatialHash::LSpatialHash( int cellShift )
+{
+	//Initialize the cell size
+	mCellShift = cellShift;
+}
+
+void LSpatialHash::clear()
+{
+	//Keep capacity, bodies are inserted again every frame
+	mEntries.clear();
+}
+
+void LSpatialHash::insert( int id, const SDL_Rect& box )
+{
+	//Empty boxes can't collide
+	if( box.w <= 0 || box.h <= 0 )
+	{
+		return;
+	}
+
+	//Remember the box for dropping duplicate pairs
+	if( id >= (int)mBoxes.size() )
+	{
+		mBoxes.resize( id + 1 );
+	}
+	mBoxes[ id ] = box;
+
+	//Cells the box covers
+	int left = box.x >> mCellShift;
+	int right = ( box.x + box.w - 1 ) >> mCellShift;
+	int top = box.y >> mCellShift;
+	int bottom = ( box.y + box.h - 1 ) >> mCellShift;
+
+	//Add the body to each of them
+	for( int y = top; y <= bottom; ++y )
+	{
+		for( int x = left; x <= right; ++x )
+		{
+			Entry entry = { x, y, id };
+			mEntries.push_back( entry );
+		}
+	}
+}
+
+int LSpatialHash::getBucket( int cellX, int cellY, int mask )
+{
+	//Mix the cell coordinates so neighboring cells land far apart
+	Uint32 hash = ( (Uint32)cellX * 73856093u ) ^ ( (Uint32)cellY * 19349663u );
+	return hash & mask;
+}
+
+void LSpatialHash::findPairs( std::vector<BodyPair>& pairs )
+{
+	pairs.clear();
+
+	//Use at least twice as many buckets as entries so few cells share one
+	int entryCount = mEntries.size();
+	int bucketCount = 1;
+	while( bucketCount < entryCount * 2 )
+	{
+		bucketCount <<= 1;
+	}
+	int mask = bucketCount - 1;
+
+	//Count the entries in each bucket
+	mBucketEnds.assign( bucketCount, 0 );
+	for( int i = 0; i < entryCount; ++i )
+	{
+		++mBucketEnds[ getBucket( mEntries[ i ].cellX, mEntries[ i ].cellY, mask ) ];
+	}
+
+	//Turn the counts into where each bucket starts
+	int start = 0;
+	for( int i = 0; i < bucketCount; ++i )
+	{
+		int count = mBucketEnds[ i ];
+		mBucketEnds[ i ] = start;
+		start += count;
+	}
+
+	//Group the entries by bucket, moving each start to the bucket's end
+	mSorted.resize( entryCount );
+	for( int i = 0; i < entryCount; ++i )
+	{
+		mSorted[ mBucketEnds[ getBucket( mEntries[ i ].cellX, mEntries[ i ].cellY, mask ) ]++ ] = mEntries[ i ];
+	}
+
+	//Pair up the bodies in each bucket
+	int begin = 0;
+	for( int bucket = 0; bucket < bucketCount; ++bucket )
+	{
+		int end = mBucketEnds[ bucket ];
+		for( int i = begin; i < end; ++i )
+		{
+			const Entry& first = mSorted[ i ];
+			const SDL_Rect& a = mBoxes[ first.id ];
+			for( int j = i + 1; j < end; ++j )
+			{
+				//Buckets can hold more than one cell
+				const Entry& second = mSorted[ j ];
+				if( second.cellX != first.cellX || second.cellY != first.cellY )
+				{
+					continue;
+				}
+
+				//Only report the pair from the cell where their boxes start overlapping, bodies can share several cells
+				const SDL_Rect& b = mBoxes[ second.id ];
+				if( ( SDL_max( a.x, b.x ) >> mCellShift ) == first.cellX && ( SDL_max( a.y, b.y ) >> mCellShift ) == first.cellY )
+				{
+					BodyPair pair = { first.id, second.id };
+					pairs.push_back( pair );
+				}
+			}
+		}
+		begin = end;
+	}
+}
+
+void collideRectsScalar( const SDL_Rect& rect, const int* left, const int* top, const int* right, const int* bottom, Uint32* hits, int count )
+{
+	int rectRight = rect.x + rect.w;
+	int rectBottom = rect.y + rect.h;
+
+	for( int word = 0; word * 32 < count; ++word )
+	{
+		//Test up to 32 rects, each overlaps if it starts before the rect ends and ends after it starts on both axes
+		Uint32 mask = 0;
+		int end = SDL_min( 32, count - word * 32 );
+		for( int bit = 0; bit < end; ++bit )
+		{
+			int i = word * 32 + bit;
+			mask |= (Uint32)( left[ i ] < rectRight && right[ i ] > rect.x && top[ i ] < rectBottom && bottom[ i ] > rect.y ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+}
+
+#ifdef COLLISION_SIMD
+TARGET_SSE2 void collideRectsSSE2( const SDL_Rect& rect, const int* left, const int* top, const int* right, const int* bottom, Uint32* hits, int count )
+{
+	//The rect's sides in every lane
+	const __m128i rectLeft = _mm_set1_epi32( rect.x );
+	const __m128i rectTop = _mm_set1_epi32( rect.y );
+	const __m128i rectRight = _mm_set1_epi32( rect.x + rect.w );
+	const __m128i rectBottom = _mm_set1_epi32( rect.y + rect.h );
+
+	//Whole words 4 rects at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 4 )
+		{
+			int i = word * 32 + bit;
+			__m128i overlapX = _mm_and_si128( _mm_cmpgt_epi32( rectRight, _mm_loadu_si128( (const __m128i*)( left + i ) ) ), _mm_cmpgt_epi32( _mm_loadu_si128( (const __m128i*)( right + i ) ), rectLeft ) );
+			__m128i overlapY = _mm_and_si128( _mm_cmpgt_epi32( rectBottom, _mm_loadu_si128( (const __m128i*)( top + i ) ) ), _mm_cmpgt_epi32( _mm_loadu_si128( (const __m128i*)( bottom + i ) ), rectTop ) );
+			mask |= (Uint32)_mm_movemask_ps( _mm_castsi128_ps( _mm_and_si128( overlapX, overlapY ) ) ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+
+	//Leftovers
+	collideRectsScalar( rect, left + full, top + full, right + full, bottom + full, hits + full / 32, count - full );
+}
+
+TARGET_AVX2 void collideRectsAVX2( const SDL_Rect& rect, const int* left, const int* top, const int* right, const int* bottom, Uint32* hits, int count )
+{
+	//The rect's sides in every lane
+	const __m256i rectLeft = _mm256_set1_epi32( rect.x );
+	const __m256i rectTop = _mm256_set1_epi32( rect.y );
+	const __m256i rectRight = _mm256_set1_epi32( rect.x + rect.w );
+	const __m256i rectBottom = _mm256_set1_epi32( rect.y + rect.h );
+
+	//Whole words 8 rects at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 8 )
+		{
+			int i = word * 32 + bit;
+			__m256i overlapX = _mm256_and_si256( _mm256_cmpgt_epi32( rectRight, _mm256_loadu_si256( (const __m256i*)( left + i ) ) ), _mm256_cmpgt_epi32( _mm256_loadu_si256( (const __m256i*)( right + i ) ), rectLeft ) );
+			__m256i overlapY = _mm256_and_si256( _mm256_cmpgt_epi32( rectBottom, _mm256_loadu_si256( (const __m256i*)( top + i ) ) ), _mm256_cmpgt_epi32( _mm256_loadu_si256( (const __m256i*)( bottom + i ) ), rectTop ) );
+			mask |= (Uint32)_mm256_movemask_ps( _mm256_castsi256_ps( _mm256_and_si256( overlapX, overlapY ) ) ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+
+	//Leftovers
+	collideRectsScalar( rect, left + full, top + full, right + full, bottom + full, hits + full / 32, count - full );
+}
+#endif
+
+RectKernel getRectKernel( CollisionPath path )
+{
+	switch( path )
+	{
+		case COLLISION_PATH_SCALAR:
+		return collideRectsScalar;
+
+#ifdef COLLISION_SIMD
+		case COLLISION_PATH_SSE2:
+		return SDL_HasSSE2() ? collideRectsSSE2 : NULL;
+
+		case COLLISION_PATH_AVX2:
+		return SDL_HasAVX2() ? collideRectsAVX2 : NULL;
+#endif
+
+		default:
+		return NULL;
+	}
+}
+
+LRectBatch::LRectBatch()
+{
+	//Use the widest instruction set the CPU has
+	mKernel = NULL;
+	mPath = COLLISION_PATH_SCALAR;
+	for( int path = COLLISION_PATH_TOTAL - 1; path >= 0; --path )
+	{
+		if( setPath( (CollisionPath)path ) )
+		{
+			break;
+		}
+	}
+}
+
+void LRectBatch::clear()
+{
+	mLeft.clear();
+	mTop.clear();
+	mRight.clear();
+	mBottom.clear();
+}
+
+void LRectBatch::add( const SDL_Rect& rect )
+{
+	mLeft.push_back( rect.x );
+	mTop.push_back( rect.y );
+	mRight.push_back( rect.x + rect.w );
+	mBottom.push_back( rect.y + rect.h );
+}
+
+void LRectBatch::collide( const SDL_Rect& rect, std::vector<Uint32>& hits )
+{
+	int count = mLeft.size();
+	hits.resize( ( count + 31 ) / 32 );
+	if( count > 0 )
+	{
+		mKernel( rect, &mLeft[ 0 ], &mTop[ 0 ], &mRight[ 0 ], &mBottom[ 0 ], &hits[ 0 ], count );
+	}
+}
+
+bool LRectBatch::setPath( CollisionPath path )
+{
+	//Not built or not supported by this CPU
+	RectKernel kernel = getRectKernel( path );
+	if( kernel == NULL )
+	{
+		return false;
+	}
+
+	mKernel = kernel;
+	mPath = path;
+	return true;
+}
+
+CollisionPath LRectBatch::getPath()
+{
+	return mPath;
+}
+
+int LRectBatch::getCount()
+{
+	return mLeft.size();
+}
+
+void runBenchmark()
+{
+	//Reused between frames
+	std::vector<SDL_Rect> bodies;
+	std::vector<BodyPair> pairs;
+	LSpatialHash broadphase;
+
+	for( int size = 0; size < (int)SDL_arraysize( BENCHMARK_BODIES ); ++size )
+	{
+		//Scatter dots over a world that grows with the body count
+		int count = BENCHMARK_BODIES[ size ];
+		int worldSize = (int)( std::sqrt( (double)count ) * BENCHMARK_SPACING );
+		bodies.resize( count );
+		for( int i = 0; i < count; ++i )
+		{
+			bodies[ i ].x = rand() % worldSize;
+			bodies[ i ].y = rand() % worldSize;
+			bodies[ i ].w = Dot::DOT_WIDTH;
+			bodies[ i ].h = Dot::DOT_HEIGHT;
+		}
+
+		//Move the bodies, insert them, and test the candidate pairs every frame
+		Uint64 broadTime = 0;
+		int candidates = 0, broadHits = 0;
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			for( int i = 0; i < count; ++i )
+			{
+				bodies[ i ].x += rand() % 3 - 1;
+				bodies[ i ].y += rand() % 3 - 1;
+			}
+
+			Uint64 start = SDL_GetPerformanceCounter();
+			broadphase.clear();
+			for( int i = 0; i < count; ++i )
+			{
+				broadphase.insert( i, bodies[ i ] );
+			}
+			broadphase.findPairs( pairs );
+
+			broadHits = 0;
+			for( int i = 0; i < (int)pairs.size(); ++i )
+			{
+				if( checkCollision( bodies[ pairs[ i ].a ], bodies[ pairs[ i ].b ] ) )
+				{
+					++broadHits;
+				}
+			}
+			broadTime += SDL_GetPerformanceCounter() - start;
+			candidates = pairs.size();
+		}
+
+		//Test every pair of the last frame once
+		Uint64 start = SDL_GetPerformanceCounter();
+		int naiveHits = 0;
+		for( int i = 0; i < count; ++i )
+		{
+			for( int j = i + 1; j < count; ++j )
+			{
+				if( checkCollision( bodies[ i ], bodies[ j ] ) )
+				{
+					++naiveHits;
+				}
+			}
+		}
+		Uint64 naiveTime = SDL_GetPerformanceCounter() - start;
+
+		//Hits have to match, the broadphase only skips pairs that can't touch
+		double frequency = SDL_GetPerformanceFrequency();
+		double naiveMs = 1000.0 * naiveTime / frequency;
+		double broadMs = 1000.0 * broadTime / frequency / BENCHMARK_FRAMES;
+		printf( "%d bodies: naive %.3f ms %d hits, broadphase %.3f ms %d candidates %d hits, %.1fx\n",
+			count,
+			naiveMs,
+			naiveHits,
+			broadMs,
+			candidates,
+			broadHits,
+			naiveMs / broadMs );
+	}
+
+	//Dots to test against and dots tested against them, scattered over the screen
+	std::vector<SDL_Rect> targets( BENCHMARK_BATCH );
+	std::vector<SDL_Rect> queries( BENCHMARK_QUERIES );
+	LRectBatch batch;
+	for( int i = 0; i < BENCHMARK_BATCH; ++i )
+	{
+		SDL_Rect rect = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, Dot::DOT_WIDTH, Dot::DOT_HEIGHT };
+		targets[ i ] = rect;
+		batch.add( rect );
+	}
+	for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+	{
+		SDL_Rect rect = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, Dot::DOT_WIDTH, Dot::DOT_HEIGHT };
+		queries[ i ] = rect;
+	}
+
+	//One rect at a time through checkCollision
+	Uint64 start = SDL_GetPerformanceCounter();
+	int expected = 0;
+	for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+	{
+		for( int j = 0; j < BENCHMARK_BATCH; ++j )
+		{
+			if( checkCollision( queries[ i ], targets[ j ] ) )
+			{
+				++expected;
+			}
+		}
+	}
+	double tests = (double)BENCHMARK_QUERIES * BENCHMARK_BATCH;
+	double frequency = SDL_GetPerformanceFrequency();
+	double checkNs = 1000000000.0 * ( SDL_GetPerformanceCounter() - start ) / frequency;
+	printf( "checkCollision: %.3f ns per test, %d hits\n", checkNs / tests, expected );
+
+	//The whole batch at once with each instruction set
+	std::vector<Uint32> hits;
+	for( int path = 0; path < COLLISION_PATH_TOTAL; ++path )
+	{
+		if( !batch.setPath( (CollisionPath)path ) )
+		{
+			printf( "%s batch: not supported\n", COLLISION_PATH_NAMES[ path ] );
+			continue;
+		}
+
+		start = SDL_GetPerformanceCounter();
+		int found = 0;
+		for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+		{
+			batch.collide( queries[ i ], hits );
+
+			//Count the hits so the work can't be skipped
+			for( int word = 0; word < hits.size(); ++word )
+			{
+				for( Uint32 mask = hits[ word ]; mask != 0; mask &= mask - 1 )
+				{
+					++found;
+				}
+			}
+		}
+		double batchNs = 1000000000.0 * ( SDL_GetPerformanceCounter() - start ) / frequency;
+		printf( "%s batch: %.3f ns per test, %d hits, %.1fx\n", COLLISION_PATH_NAMES[ path ], batchNs / tests, found, checkNs / batchNs );
+	}
+}
+
 int main( int argc, char* args[] )
 {
 	//Start up SDL and create window
@@ -480,6 +1111,11 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
+		//Time naive pair testing against the broadphase
+		else if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+		{
+			runBenchmark();
+		}
 		else
 		{	
 			//Main loop flag
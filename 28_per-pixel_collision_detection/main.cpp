@@ -1,10 +1,12 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, vectors, and strings
+//Using SDL, SDL_image, standard IO, math, strings, and vectors
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <string.h>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -12,6 +14,55 @@ and may not be redistributed without written permission.*/
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Pixels at least this opaque are solid in collision masks
+const int MASK_ALPHA_THRESHOLD = 0x80;
+
+//Pixels tree boxes are grown by so small moves don't touch the tree
+const int AABB_TREE_MARGIN = 4;
+
+//Level boxes, moving boxes, world size, and frames the benchmark runs
+const int BENCHMARK_STATIC = 10000;
+const int BENCHMARK_MOVING = 1000;
+const int BENCHMARK_WORLD = 4096;
+const int BENCHMARK_FRAMES = 100;
+const int BENCHMARK_MASK_TESTS = 1000000;
+
+//One bit per pixel of a sprite, set where the sprite is solid
+class LCollisionMask
+{
+    public:
+		//Initializes variables
+		LCollisionMask();
+
+		//Builds the mask from a surface's alpha and color key
+		bool loadFromSurface( SDL_Surface* surface );
+
+		//Deallocates the mask
+		void free();
+
+		//Checks if any solid pixels overlap the other mask's when the masks are placed at the given points
+		bool overlaps( int x, int y, LCollisionMask& other, int otherX, int otherY );
+
+		//Checks a single pixel
+		bool isSolid( int x, int y );
+
+		//Gets mask dimensions
+		int getWidth();
+		int getHeight();
+
+    private:
+		//Gets the 64 pixels of a row starting at the given column
+		Uint64 getBits( const Uint64* row, int column );
+
+		//Rows of 64 pixel words, the lowest bit is the leftmost pixel
+		std::vector<Uint64> mBits;
+
+		//Mask dimensions and words in each row
+		int mWidth;
+		int mHeight;
+		int mWordsPerRow;
+};
+
 //Texture wrapper class
 class LTexture
 {
@@ -49,15 +100,115 @@ class LTexture
 		int getWidth();
 		int getHeight();
 
+		//Gets the solid pixels of the loaded image
+		LCollisionMask& getMask();
+
 	private:
 		//The actual hardware texture
 		SDL_Texture* mTexture;
 
+		//Solid pixels, built when the image is loaded
+		LCollisionMask mMask;
+
 		//Image dimensions
 		int mWidth;
 		int mHeight;
 };
 
+//Dynamic bounding box tree indexing static and moving boxes together
+class LAABBTree
+{
+    public:
+		//Initializes variables with the margin boxes are fattened by
+		LAABBTree( int margin = AABB_TREE_MARGIN );
+
+		//Adds a box, returns the proxy that refers to it
+		int insert( const SDL_Rect& box, void* data );
+
+		//Removes a proxy
+		void remove( int proxy );
+
+		//Updates a proxy's box, returns true if it left its fattened box and had to be reinserted
+		bool move( int proxy, const SDL_Rect& box );
+
+		//Gets the data of every proxy whose box overlaps the given box
+		void query( const SDL_Rect& box, std::vector<void*>& hits );
+
+		//Gets the data of the first box the segment hits and how far along it the hit is, NULL if none
+		void* rayCast( float x1, float y1, float x2, float y2, float* fraction = NULL );
+
+		//Gets a proxy's data and box
+		void* getData( int proxy );
+		SDL_Rect getBox( int proxy );
+
+		//Gets the number of proxies and the height of the tree
+		int getProxyCount();
+		int getHeight();
+
+    private:
+		//Leaves hold proxies, branches bound their two children
+		struct Node
+		{
+			//Box grown by the margin, for branches the union of the children
+			SDL_Rect fatBox;
+
+			//The proxy's box
+			SDL_Rect box;
+			void* data;
+
+			//Parent, or the next free node once freed
+			int parent;
+
+			//Children, -1 for leaves
+			int left, right;
+
+			//Leaves are 0, -1 once freed
+			int height;
+		};
+
+		//Takes a node from the free list
+		int allocateNode();
+
+		//Returns a node to the free list
+		void freeNode( int node );
+
+		//Links a leaf in next to the sibling that grows the least
+		void insertLeaf( int leaf );
+
+		//Unlinks a leaf, its parent takes the sibling's place
+		void removeLeaf( int leaf );
+
+		//Rotates the taller grandchild up, returns the node now in this place
+		int balance( int node );
+
+		//Refits and balances each node from here to the root
+		void refit( int node );
+
+		//All nodes, proxies are indices into it
+		std::vector<Node> mNodes;
+
+		//Top node and first free node
+		int mRoot;
+		int mFreeList;
+
+		//Fattening margin and proxies held
+		int mMargin;
+		int mProxyCount;
+
+		//Nodes left to visit during queries
+		std::vector<int> mStack;
+};
+
+//Where a moving shape first touches another
+struct Contact
+{
+	//Fraction of the move made before touching
+	float time;
+
+	//Direction pointing out of the surface that was touched
+	float normalX, normalY;
+};
+
 //The dot that will move around on the screen
 class Dot
 {
@@ -75,14 +226,20 @@ class Dot
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
 
-		//Moves the dot and checks collision
-		void move( std::vector<SDL_Rect>& otherColliders );
+		//Adds the dot to the collision tree
+		void addTo( LAABBTree& tree );
+
+		//Moves the dot until its pixels touch another dot in the tree, then slides along it
+		void move( LAABBTree& tree );
 
 		//Shows the dot on the screen
 		void render();
 
-		//Gets the collision boxes
-		std::vector<SDL_Rect>& getColliders();
+		//Gets the solid pixels of the dot
+		LCollisionMask& getMask();
+
+		//Gets the box around the whole dot
+		SDL_Rect getBox();
 
     private:
 		//The X and Y offsets of the dot
@@ -91,11 +248,17 @@ class Dot
 		//The velocity of the dot
 		int mVelX, mVelY;
 		
-		//Dot's collision boxes
-	    std::vector<SDL_Rect> mColliders;
+		//The dot's proxy in the collision tree
+		int mProxy;
+
+		//Dots the last tree query found
+		std::vector<void*> mNearby;
 
-		//Moves the collision boxes relative to the dot's offset
-		void shiftColliders();
+		//Finds how far the dot's pixels get through a move before touching a dot in the tree, contact is left alone on a miss
+		bool sweepTree( LAABBTree& tree, int velX, int velY, Contact& contact );
+
+		//Checks the dot's pixels at a position against the dots in the tree
+		bool collidesAt( LAABBTree& tree, int x, int y );
 };
 
 //Starts up SDL and creates window
@@ -107,8 +270,14 @@ bool loadMedia();
 //Frees media and shuts down SDL
 void close();
 
-//Box set collision detector
-bool checkCollision( std::vector<SDL_Rect>& a, std::vector<SDL_Rect>& b );
+//Swept box collision detector, finds when a box moving by the velocity first touches another, contact is left alone on a miss
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact );
+
+//Finds how far along a segment it first enters a box, returns false if it misses within maxFraction
+bool intersectRay( const SDL_Rect& box, float x1, float y1, float dx, float dy, float maxFraction, float* fraction );
+
+//Times tree updates and queries against checking every box
+void runBenchmark();
 
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
@@ -152,6 +321,12 @@ bool LTexture::loadFromFile( std::string path )
 		//Color key image
 		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
 
+		//Keep which pixels are solid for collision
+		if( !mMask.loadFromSurface( loadedSurface ) )
+		{
+			printf( "Unable to build collision mask for %s!\n", path.c_str() );
+		}
+
 		//Create texture from surface pixels
         newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
 		if( newTexture == NULL )
@@ -221,6 +396,9 @@ void LTexture::free()
 		mWidth = 0;
 		mHeight = 0;
 	}
+
+	//Free the mask with it
+	mMask.free();
 }
 
 void LTexture::setColor( Uint8 red, Uint8 green, Uint8 blue )
@@ -267,55 +445,163 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
-Dot::Dot( int x, int y )
+LCollisionMask& LTexture::getMask()
 {
-    //Initialize the offsets
-    mPosX = x;
-    mPosY = y;
+	return mMask;
+}
+
+LCollisionMask::LCollisionMask()
+{
+	//Initialize
+	mWidth = 0;
+	mHeight = 0;
+	mWordsPerRow = 0;
+}
 
-    //Create the necessary SDL_Rects
-    mColliders.resize( 11 );
+bool LCollisionMask::loadFromSurface( SDL_Surface* surface )
+{
+	//Get rid of preexisting mask
+	free();
 
-    //Initialize the velocity
-    mVelX = 0;
-    mVelY = 0;
+	//Read the pixels in one known format
+	SDL_Surface* formattedSurface = SDL_ConvertSurfaceFormat( surface, SDL_PIXELFORMAT_ARGB8888, 0 );
+	if( formattedSurface == NULL )
+	{
+		printf( "Unable to convert surface for collision mask! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	//Color keyed pixels are empty as well as transparent ones
+	Uint32 colorKey = 0;
+	bool keyed = SDL_GetColorKey( surface, &colorKey ) == 0;
+	Uint8 keyRed = 0, keyGreen = 0, keyBlue = 0;
+	if( keyed )
+	{
+		SDL_GetRGB( colorKey, surface->format, &keyRed, &keyGreen, &keyBlue );
+	}
+	Uint32 keyPixel = ( keyRed << 16 ) | ( keyGreen << 8 ) | keyBlue;
+
+	//An extra empty word on each row lets overlap tests read past the last pixel
+	mWidth = formattedSurface->w;
+	mHeight = formattedSurface->h;
+	mWordsPerRow = ( mWidth + 63 ) / 64 + 1;
+	mBits.assign( mWordsPerRow * mHeight, 0 );
+
+	//Set the bit of every solid pixel
+	SDL_LockSurface( formattedSurface );
+	for( int y = 0; y < mHeight; ++y )
+	{
+		Uint32* pixels = (Uint32*)( (Uint8*)formattedSurface->pixels + y * formattedSurface->pitch );
+		Uint64* bits = &mBits[ y * mWordsPerRow ];
+		for( int x = 0; x < mWidth; ++x )
+		{
+			Uint32 pixel = pixels[ x ];
+			if( ( pixel >> 24 ) >= MASK_ALPHA_THRESHOLD && !( keyed && ( pixel & 0xFFFFFF ) == keyPixel ) )
+			{
+				bits[ x >> 6 ] |= (Uint64)1 << ( x & 63 );
+			}
+		}
+	}
+	SDL_UnlockSurface( formattedSurface );
+
+	//Get rid of the converted copy
+	SDL_FreeSurface( formattedSurface );
+
+	return true;
+}
+
+void LCollisionMask::free()
+{
+	mBits.clear();
+	mWidth = 0;
+	mHeight = 0;
+	mWordsPerRow = 0;
+}
+
+bool LCollisionMask::overlaps( int x, int y, LCollisionMask& other, int otherX, int otherY )
+{
+	//The area both masks cover
+	int left = SDL_max( x, otherX );
+	int right = SDL_min( x + mWidth, otherX + other.mWidth );
+	int top = SDL_max( y, otherY );
+	int bottom = SDL_min( y + mHeight, otherY + other.mHeight );
+	if( left >= right || top >= bottom )
+	{
+		return false;
+	}
+
+	//Where the area starts in each mask
+	int columnA = left - x;
+	int columnB = left - otherX;
+	int width = right - left;
+
+	for( int row = top; row < bottom; ++row )
+	{
+		const Uint64* bitsA = &mBits[ ( row - y ) * mWordsPerRow ];
+		const Uint64* bitsB = &other.mBits[ ( row - otherY ) * other.mWordsPerRow ];
 
-    //Initialize the collision boxes' width and height
-    mColliders[ 0 ].w = 6;
-    mColliders[ 0 ].h = 1;
+		//Compare 64 pixels at a time
+		for( int column = 0; column < width; column += 64 )
+		{
+			//Ignore pixels past the area on the last word
+			int remaining = width - column;
+			Uint64 used = remaining >= 64 ? ~(Uint64)0 : ( (Uint64)1 << remaining ) - 1;
 
-    mColliders[ 1 ].w = 10;
-    mColliders[ 1 ].h = 1;
+			if( getBits( bitsA, columnA + column ) & getBits( bitsB, columnB + column ) & used )
+			{
+				return true;
+			}
+		}
+	}
 
-    mColliders[ 2 ].w = 14;
-    mColliders[ 2 ].h = 1;
+	return false;
+}
 
-    mColliders[ 3 ].w = 16;
-    mColliders[ 3 ].h = 2;
+bool LCollisionMask::isSolid( int x, int y )
+{
+	if( x < 0 || y < 0 || x >= mWidth || y >= mHeight )
+	{
+		return false;
+	}
 
-    mColliders[ 4 ].w = 18;
-    mColliders[ 4 ].h = 2;
+	return ( mBits[ y * mWordsPerRow + ( x >> 6 ) ] >> ( x & 63 ) ) & 1;
+}
 
-    mColliders[ 5 ].w = 20;
-    mColliders[ 5 ].h = 6;
+int LCollisionMask::getWidth()
+{
+	return mWidth;
+}
 
-    mColliders[ 6 ].w = 18;
-    mColliders[ 6 ].h = 2;
+int LCollisionMask::getHeight()
+{
+	return mHeight;
+}
 
-    mColliders[ 7 ].w = 16;
-    mColliders[ 7 ].h = 2;
+Uint64 LCollisionMask::getBits( const Uint64* row, int column )
+{
+	//Join the two words the 64 pixels straddle
+	int word = column >> 6;
+	int shift = column & 63;
+	if( shift == 0 )
+	{
+		return row[ word ];
+	}
 
-    mColliders[ 8 ].w = 14;
-    mColliders[ 8 ].h = 1;
+	return ( row[ word ] >> shift ) | ( row[ word + 1 ] << ( 64 - shift ) );
+}
 
-    mColliders[ 9 ].w = 10;
-    mColliders[ 9 ].h = 1;
+Dot::Dot( int x, int y )
+{
+    //Initialize the offsets
+    mPosX = x;
+    mPosY = y;
 
-    mColliders[ 10 ].w = 6;
-    mColliders[ 10 ].h = 1;
+    //Initialize the velocity
+    mVelX = 0;
+    mVelY = 0;
 
-	//Initialize colliders relative to position
-	shiftColliders();
+    //Not in a tree yet
+    mProxy = -1;
 }
 
 void Dot::handleEvent( SDL_Event& e )
@@ -346,31 +632,143 @@ void Dot::handleEvent( SDL_Event& e )
     }
 }
 
-void Dot::move( std::vector<SDL_Rect>& otherColliders )
+void Dot::addTo( LAABBTree& tree )
 {
-    //Move the dot left or right
-    mPosX += mVelX;
-    shiftColliders();
+	mProxy = tree.insert( getBox(), this );
+}
+
+void Dot::move( LAABBTree& tree )
+{
+    //Keep the move on the screen
+    int velX = SDL_max( -mPosX, SDL_min( mVelX, SCREEN_WIDTH - DOT_WIDTH - mPosX ) );
+    int velY = SDL_max( -mPosY, SDL_min( mVelY, SCREEN_HEIGHT - DOT_HEIGHT - mPosY ) );
 
-    //If the dot collided or went too far to the left or right
-    if( ( mPosX < 0 ) || ( mPosX + DOT_WIDTH > SCREEN_WIDTH ) || checkCollision( mColliders, otherColliders ) )
+    //Move until the pixels touch, then slide along with the rest of the move
+    for( int pass = 0; pass < 2 && ( velX != 0 || velY != 0 ); ++pass )
     {
-        //Move back
-        mPosX -= mVelX;
-		shiftColliders();
+        //Find when the dot touches the first dot, if it does
+        Contact contact = { 1.f, 0.f, 0.f };
+        sweepTree( tree, velX, velY, contact );
+
+        //Move up to it
+        int moveX = (int)std::lround( velX * contact.time );
+        int moveY = (int)std::lround( velY * contact.time );
+        mPosX += moveX;
+        mPosY += moveY;
+
+        //Drop the part of what's left going into the other dot
+        velX = contact.normalX != 0.f ? 0 : velX - moveX;
+        velY = contact.normalY != 0.f ? 0 : velY - moveY;
     }
 
-    //Move the dot up or down
-    mPosY += mVelY;
-	shiftColliders();
+    //Keep the tree up to date with the new position
+    tree.move( mProxy, getBox() );
+}
 
-    //If the dot collided or went too far up or down
-    if( ( mPosY < 0 ) || ( mPosY + DOT_HEIGHT > SCREEN_HEIGHT ) || checkCollision( mColliders, otherColliders ) )
-    {
-        //Move back
-        mPosY -= mVelY;
-		shiftColliders();
-    }
+bool Dot::sweepTree( LAABBTree& tree, int velX, int velY, Contact& contact )
+{
+	//Pixels can't be swept exactly, so the move is walked a pixel at a time along its longer axis
+	int steps = SDL_max( abs( velX ), abs( velY ) );
+	if( steps == 0 )
+	{
+		return false;
+	}
+
+	//Get the dots near the whole move
+	SDL_Rect box = getBox();
+	SDL_Rect swept = { SDL_min( box.x, box.x + velX ), SDL_min( box.y, box.y + velY ), box.w + abs( velX ), box.h + abs( velY ) };
+	tree.query( swept, mNearby );
+
+	//The last step the pixels are free at
+	int freeSteps = steps;
+	for( int i = 0; i < mNearby.size(); ++i )
+	{
+		Dot* other = (Dot*)mNearby[ i ];
+		if( other == this )
+		{
+			continue;
+		}
+
+		//Only walk the pixels from where the boxes start to overlap, with a pixel to spare for rounding
+		SDL_Rect otherBox = other->getBox();
+		otherBox.x -= 1;
+		otherBox.y -= 1;
+		otherBox.w += 2;
+		otherBox.h += 2;
+		Contact boxContact;
+		int firstStep = 1;
+		if( sweepCollision( box, velX, velY, otherBox, boxContact ) )
+		{
+			firstStep = SDL_max( 1, (int)( boxContact.time * steps ) );
+		}
+		else if( !SDL_HasIntersection( &box, &otherBox ) )
+		{
+			continue;
+		}
+
+		for( int step = firstStep; step <= freeSteps; ++step )
+		{
+			float time = (float)step / steps;
+			if( getMask().overlaps( mPosX + (int)std::lround( velX * time ), mPosY + (int)std::lround( velY * time ), other->getMask(), other->mPosX, other->mPosY ) )
+			{
+				freeSteps = step - 1;
+				break;
+			}
+		}
+	}
+
+	//If the whole move is free
+	if( freeSteps == steps )
+	{
+		return false;
+	}
+
+	//Where the dot stops
+	contact.time = (float)freeSteps / steps;
+	int x = mPosX + (int)std::lround( velX * contact.time );
+	int y = mPosY + (int)std::lround( velY * contact.time );
+
+	//The normal points back along every axis the next pixel over is blocked on
+	contact.normalX = 0.f;
+	contact.normalY = 0.f;
+	int signX = velX > 0 ? 1 : -1;
+	int signY = velY > 0 ? 1 : -1;
+	bool blockedX = velX != 0 && collidesAt( tree, x + signX, y );
+	bool blockedY = velY != 0 && collidesAt( tree, x, y + signY );
+
+	//Only the diagonal is blocked, so stop on both
+	if( !blockedX && !blockedY )
+	{
+		blockedX = velX != 0;
+		blockedY = velY != 0;
+	}
+	if( blockedX )
+	{
+		contact.normalX = (float)-signX;
+	}
+	if( blockedY )
+	{
+		contact.normalY = (float)-signY;
+	}
+
+	return true;
+}
+
+bool Dot::collidesAt( LAABBTree& tree, int x, int y )
+{
+	//Only compare pixels with the dots whose boxes overlap
+	SDL_Rect box = { x, y, DOT_WIDTH, DOT_HEIGHT };
+	tree.query( box, mNearby );
+	for( int i = 0; i < mNearby.size(); ++i )
+	{
+		Dot* other = (Dot*)mNearby[ i ];
+		if( other != this && getMask().overlaps( x, y, other->getMask(), other->mPosX, other->mPosY ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void Dot::render()
@@ -379,28 +777,455 @@ void Dot::render()
 	gDotTexture.render( mPosX, mPosY );
 }
 
-void Dot::shiftColliders()
+LCollisionMask& Dot::getMask()
 {
-    //The row offset
-    int r = 0;
+	//Every dot shares the texture's mask
+	return gDotTexture.getMask();
+}
 
-    //Go through the dot's collision boxes
-    for( int set = 0; set < mColliders.size(); ++set )
-    {
-        //Center the collision box
-        mColliders[ set ].x = mPosX + ( DOT_WIDTH - mColliders[ set ].w ) / 2;
+SDL_Rect Dot::getBox()
+{
+	SDL_Rect box = { mPosX, mPosY, DOT_WIDTH, DOT_HEIGHT };
+	return box;
+}
 
-        //Set the collision box at its row offset
-        mColliders[ set ].y = mPosY + r;
+LAABBTree::LAABBTree( int margin )
+{
+	//Initialize the variables
+	mRoot = -1;
+	mFreeList = -1;
+	mMargin = margin;
+	mProxyCount = 0;
+}
 
-        //Move the row offset down the height of the collision box
-        r += mColliders[ set ].h;
-    }
+int LAABBTree::insert( const SDL_Rect& box, void* data )
+{
+	//Make a leaf with room to move
+	int proxy = allocateNode();
+	Node& leaf = mNodes[ proxy ];
+	leaf.box = box;
+	leaf.fatBox.x = box.x - mMargin;
+	leaf.fatBox.y = box.y - mMargin;
+	leaf.fatBox.w = box.w + mMargin * 2;
+	leaf.fatBox.h = box.h + mMargin * 2;
+	leaf.data = data;
+	leaf.height = 0;
+
+	insertLeaf( proxy );
+	++mProxyCount;
+
+	return proxy;
 }
 
-std::vector<SDL_Rect>& Dot::getColliders()
+void LAABBTree::remove( int proxy )
 {
-	return mColliders;
+	removeLeaf( proxy );
+	freeNode( proxy );
+	--mProxyCount;
+}
+
+bool LAABBTree::move( int proxy, const SDL_Rect& box )
+{
+	Node& leaf = mNodes[ proxy ];
+	leaf.box = box;
+
+	//Nothing changes while the box stays inside its fattened box
+	const SDL_Rect& fat = leaf.fatBox;
+	if( box.x >= fat.x && box.y >= fat.y && box.x + box.w <= fat.x + fat.w && box.y + box.h <= fat.y + fat.h )
+	{
+		return false;
+	}
+
+	//Grow a new fattened box and put the leaf back where it fits now
+	removeLeaf( proxy );
+	leaf.fatBox.x = box.x - mMargin;
+	leaf.fatBox.y = box.y - mMargin;
+	leaf.fatBox.w = box.w + mMargin * 2;
+	leaf.fatBox.h = box.h + mMargin * 2;
+	insertLeaf( proxy );
+
+	return true;
+}
+
+void LAABBTree::query( const SDL_Rect& box, std::vector<void*>& hits )
+{
+	hits.clear();
+	if( mRoot == -1 )
+	{
+		return;
+	}
+
+	//Walk down every branch the box overlaps
+	mStack.clear();
+	mStack.push_back( mRoot );
+	while( !mStack.empty() )
+	{
+		const Node& node = mNodes[ mStack.back() ];
+		mStack.pop_back();
+
+		if( !SDL_HasIntersection( &node.fatBox, &box ) )
+		{
+			continue;
+		}
+
+		if( node.left == -1 )
+		{
+			//Leaves are tested with their real box
+			if( SDL_HasIntersection( &node.box, &box ) )
+			{
+				hits.push_back( node.data );
+			}
+		}
+		else
+		{
+			mStack.push_back( node.left );
+			mStack.push_back( node.right );
+		}
+	}
+}
+
+void* LAABBTree::rayCast( float x1, float y1, float x2, float y2, float* fraction )
+{
+	void* closest = NULL;
+	float closestFraction = 1.f;
+	if( mRoot == -1 )
+	{
+		return NULL;
+	}
+
+	//Walk down every branch the segment enters before the closest hit so far
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+	mStack.clear();
+	mStack.push_back( mRoot );
+	while( !mStack.empty() )
+	{
+		const Node& node = mNodes[ mStack.back() ];
+		mStack.pop_back();
+
+		float hit;
+		if( !intersectRay( node.fatBox, x1, y1, dx, dy, closestFraction, &hit ) )
+		{
+			continue;
+		}
+
+		if( node.left == -1 )
+		{
+			//Leaves are tested with their real box, a hit shortens the segment
+			if( intersectRay( node.box, x1, y1, dx, dy, closestFraction, &hit ) )
+			{
+				closest = node.data;
+				closestFraction = hit;
+			}
+		}
+		else
+		{
+			mStack.push_back( node.left );
+			mStack.push_back( node.right );
+		}
+	}
+
+	if( fraction != NULL )
+	{
+		*fraction = closestFraction;
+	}
+	return closest;
+}
+
+void* LAABBTree::getData( int proxy )
+{
+	return mNodes[ proxy ].data;
+}
+
+SDL_Rect LAABBTree::getBox( int proxy )
+{
+	return mNodes[ proxy ].box;
+}
+
+int LAABBTree::getProxyCount()
+{
+	return mProxyCount;
+}
+
+int LAABBTree::getHeight()
+{
+	return mRoot == -1 ? 0 : mNodes[ mRoot ].height;
+}
+
+int LAABBTree::allocateNode()
+{
+	//Grow the node array when every node is in use
+	int node = mFreeList;
+	if( node == -1 )
+	{
+		node = mNodes.size();
+		mNodes.resize( node + 1 );
+	}
+	else
+	{
+		mFreeList = mNodes[ node ].parent;
+	}
+
+	//Start unlinked
+	mNodes[ node ].parent = -1;
+	mNodes[ node ].left = -1;
+	mNodes[ node ].right = -1;
+	mNodes[ node ].height = 0;
+	mNodes[ node ].data = NULL;
+
+	return node;
+}
+
+void LAABBTree::freeNode( int node )
+{
+	mNodes[ node ].parent = mFreeList;
+	mNodes[ node ].height = -1;
+	mFreeList = node;
+}
+
+void LAABBTree::insertLeaf( int leaf )
+{
+	//First leaf is the whole tree
+	if( mRoot == -1 )
+	{
+		mRoot = leaf;
+		mNodes[ leaf ].parent = -1;
+		return;
+	}
+
+	//Walk down to the node whose perimeter grows the least by taking the leaf
+	SDL_Rect leafBox = mNodes[ leaf ].fatBox;
+	int index = mRoot;
+	while( mNodes[ index ].left != -1 )
+	{
+		const Node& node = mNodes[ index ];
+
+		SDL_Rect combined;
+		SDL_UnionRect( &node.fatBox, &leafBox, &combined );
+		int perimeter = node.fatBox.w + node.fatBox.h;
+		int combinedPerimeter = combined.w + combined.h;
+
+		//Cost of pairing the leaf with this node, and the growth every node below inherits
+		int cost = 2 * combinedPerimeter;
+		int inherited = 2 * ( combinedPerimeter - perimeter );
+
+		//Cost of going down each side
+		int childCost[ 2 ];
+		int children[ 2 ] = { node.left, node.right };
+		for( int i = 0; i < 2; ++i )
+		{
+			const Node& child = mNodes[ children[ i ] ];
+			SDL_UnionRect( &child.fatBox, &leafBox, &combined );
+			childCost[ i ] = combined.w + combined.h + inherited;
+			if( child.left != -1 )
+			{
+				childCost[ i ] -= child.fatBox.w + child.fatBox.h;
+			}
+		}
+
+		//Stop when pairing here is cheapest
+		if( cost < childCost[ 0 ] && cost < childCost[ 1 ] )
+		{
+			break;
+		}
+
+		index = childCost[ 0 ] < childCost[ 1 ] ? children[ 0 ] : children[ 1 ];
+	}
+
+	//Put a new branch over the sibling and the leaf
+	int sibling = index;
+	int oldParent = mNodes[ sibling ].parent;
+	int newParent = allocateNode();
+	mNodes[ newParent ].parent = oldParent;
+	SDL_UnionRect( &leafBox, &mNodes[ sibling ].fatBox, &mNodes[ newParent ].fatBox );
+	mNodes[ newParent ].height = mNodes[ sibling ].height + 1;
+	mNodes[ newParent ].left = sibling;
+	mNodes[ newParent ].right = leaf;
+	mNodes[ sibling ].parent = newParent;
+	mNodes[ leaf ].parent = newParent;
+
+	if( oldParent == -1 )
+	{
+		mRoot = newParent;
+	}
+	else if( mNodes[ oldParent ].left == sibling )
+	{
+		mNodes[ oldParent ].left = newParent;
+	}
+	else
+	{
+		mNodes[ oldParent ].right = newParent;
+	}
+
+	//Grow the boxes above
+	refit( oldParent );
+}
+
+void LAABBTree::removeLeaf( int leaf )
+{
+	//Last leaf empties the tree
+	if( leaf == mRoot )
+	{
+		mRoot = -1;
+		return;
+	}
+
+	int parent = mNodes[ leaf ].parent;
+	int grandParent = mNodes[ parent ].parent;
+	int sibling = mNodes[ parent ].left == leaf ? mNodes[ parent ].right : mNodes[ parent ].left;
+
+	//The sibling takes the parent's place
+	if( grandParent == -1 )
+	{
+		mRoot = sibling;
+	}
+	else if( mNodes[ grandParent ].left == parent )
+	{
+		mNodes[ grandParent ].left = sibling;
+	}
+	else
+	{
+		mNodes[ grandParent ].right = sibling;
+	}
+	mNodes[ sibling ].parent = grandParent;
+	freeNode( parent );
+
+	//Shrink the boxes above
+	refit( grandParent );
+}
+
+void LAABBTree::refit( int index )
+{
+	while( index != -1 )
+	{
+		index = balance( index );
+
+		Node& node = mNodes[ index ];
+		const Node& left = mNodes[ node.left ];
+		const Node& right = mNodes[ node.right ];
+		node.height = 1 + SDL_max( left.height, right.height );
+		SDL_UnionRect( &left.fatBox, &right.fatBox, &node.fatBox );
+
+		index = node.parent;
+	}
+}
+
+int LAABBTree::balance( int iA )
+{
+	//Leaves and nodes right above them can't be rotated
+	Node& a = mNodes[ iA ];
+	if( a.left == -1 || a.height < 2 )
+	{
+		return iA;
+	}
+
+	int iB = a.left;
+	int iC = a.right;
+	Node& b = mNodes[ iB ];
+	Node& c = mNodes[ iC ];
+	int difference = c.height - b.height;
+
+	//Rotate the right child up
+	if( difference > 1 )
+	{
+		int iF = c.left;
+		int iG = c.right;
+		Node& f = mNodes[ iF ];
+		Node& g = mNodes[ iG ];
+
+		//A becomes a child of C
+		c.left = iA;
+		c.parent = a.parent;
+		a.parent = iC;
+		if( c.parent == -1 )
+		{
+			mRoot = iC;
+		}
+		else if( mNodes[ c.parent ].left == iA )
+		{
+			mNodes[ c.parent ].left = iC;
+		}
+		else
+		{
+			mNodes[ c.parent ].right = iC;
+		}
+
+		//C keeps its taller child, A takes the other
+		if( f.height > g.height )
+		{
+			c.right = iF;
+			a.right = iG;
+			g.parent = iA;
+			SDL_UnionRect( &b.fatBox, &g.fatBox, &a.fatBox );
+			SDL_UnionRect( &a.fatBox, &f.fatBox, &c.fatBox );
+			a.height = 1 + SDL_max( b.height, g.height );
+			c.height = 1 + SDL_max( a.height, f.height );
+		}
+		else
+		{
+			c.right = iG;
+			a.right = iF;
+			f.parent = iA;
+			SDL_UnionRect( &b.fatBox, &f.fatBox, &a.fatBox );
+			SDL_UnionRect( &a.fatBox, &g.fatBox, &c.fatBox );
+			a.height = 1 + SDL_max( b.height, f.height );
+			c.height = 1 + SDL_max( a.height, g.height );
+		}
+
+		return iC;
+	}
+
+	//Rotate the left child up
+	if( difference < -1 )
+	{
+		int iD = b.left;
+		int iE = b.right;
+		Node& d = mNodes[ iD ];
+		Node& e = mNodes[ iE ];
+
+		//A becomes a child of B
+		b.left = iA;
+		b.parent = a.parent;
+		a.parent = iB;
+		if( b.parent == -1 )
+		{
+			mRoot = iB;
+		}
+		else if( mNodes[ b.parent ].left == iA )
+		{
+			mNodes[ b.parent ].left = iB;
+		}
+		else
+		{
+			mNodes[ b.parent ].right = iB;
+		}
+
+		//B keeps its taller child, A takes the other
+		if( d.height > e.height )
+		{
+			b.right = iD;
+			a.left = iE;
+			e.parent = iA;
+			SDL_UnionRect( &c.fatBox, &e.fatBox, &a.fatBox );
+			SDL_UnionRect( &a.fatBox, &d.fatBox, &b.fatBox );
+			a.height = 1 + SDL_max( c.height, e.height );
+			b.height = 1 + SDL_max( a.height, d.height );
+		}
+		else
+		{
+			b.right = iE;
+			a.left = iD;
+			d.parent = iA;
+			SDL_UnionRect( &c.fatBox, &d.fatBox, &a.fatBox );
+			SDL_UnionRect( &a.fatBox, &e.fatBox, &b.fatBox );
+			a.height = 1 + SDL_max( c.height, d.height );
+			b.height = 1 + SDL_max( a.height, e.height );
+		}
+
+		return iB;
+	}
+
+	return iA;
 }
 
 bool init()
@@ -488,43 +1313,259 @@ void close()
 	SDL_Quit();
 }
 
-bool checkCollision( std::vector<SDL_Rect>& a, std::vector<SDL_Rect>& b )
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact )
 {
-    //The sides of the rectangles
-    int leftA, leftB;
-    int rightA, rightB;
-    int topA, topB;
-    int bottomA, bottomB;
-
-    //Go through the A boxes
-    for( int Abox = 0; Abox < a.size(); Abox++ )
+    //The velocity and sides of both boxes by axis
+    int velocity[ 2 ] = { velX, velY };
+    int startA[ 2 ] = { a.x, a.y };
+    int endA[ 2 ] = { a.x + a.w, a.y + a.h };
+    int startB[ 2 ] = { b.x, b.y };
+    int endB[ 2 ] = { b.x + b.w, b.y + b.h };
+
+    //When the boxes start and stop overlapping on each axis
+    float enter[ 2 ], leave[ 2 ];
+    for( int axis = 0; axis < 2; ++axis )
     {
-        //Calculate the sides of rect A
-        leftA = a[ Abox ].x;
-        rightA = a[ Abox ].x + a[ Abox ].w;
-        topA = a[ Abox ].y;
-        bottomA = a[ Abox ].y + a[ Abox ].h;
-
-        //Go through the B boxes
-        for( int Bbox = 0; Bbox < b.size(); Bbox++ )
+        if( velocity[ axis ] > 0 )
+        {
+            enter[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+        }
+        else if( velocity[ axis ] < 0 )
+        {
+            enter[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+        }
+        //Not moving on this axis, so it has to overlap the whole time
+        else if( startA[ axis ] < endB[ axis ] && endA[ axis ] > startB[ axis ] )
         {
-            //Calculate the sides of rect B
-            leftB = b[ Bbox ].x;
-            rightB = b[ Bbox ].x + b[ Bbox ].w;
-            topB = b[ Bbox ].y;
-            bottomB = b[ Bbox ].y + b[ Bbox ].h;
-
-            //If no sides from A are outside of B
-            if( ( ( bottomA <= topB ) || ( topA >= bottomB ) || ( rightA <= leftB ) || ( leftA >= rightB ) ) == false )
-            {
-                //A collision is detected
-                return true;
-            }
+            enter[ axis ] = -INFINITY;
+            leave[ axis ] = INFINITY;
         }
+        else
+        {
+            return false;
+        }
+    }
+
+    //The boxes overlap once they overlap on both axes
+    float enterBoth = SDL_max( enter[ 0 ], enter[ 1 ] );
+    float leaveBoth = SDL_min( leave[ 0 ], leave[ 1 ] );
+
+    //If they never overlap, only touch, already overlap, or don't reach each other this move
+    if( enterBoth >= leaveBoth || enterBoth < 0.f || enterBoth >= 1.f )
+    {
+        return false;
+    }
+
+    //The axis that started overlapping last is the one that was hit
+    contact.time = enterBoth;
+    contact.normalX = 0.f;
+    contact.normalY = 0.f;
+    if( enter[ 0 ] > enter[ 1 ] )
+    {
+        contact.normalX = velX > 0 ? -1.f : 1.f;
+    }
+    else
+    {
+        contact.normalY = velY > 0 ? -1.f : 1.f;
     }
 
-    //If neither set of collision boxes touched
-    return false;
+    return true;
+}
+
+bool intersectRay( const SDL_Rect& box, float x1, float y1, float dx, float dy, float maxFraction, float* fraction )
+{
+	//The segment and the box by axis
+	float start[ 2 ] = { x1, y1 };
+	float delta[ 2 ] = { dx, dy };
+	float low[ 2 ] = { (float)box.x, (float)box.y };
+	float high[ 2 ] = { (float)( box.x + box.w ), (float)( box.y + box.h ) };
+
+	//Clip the segment to the box's sides one axis at a time
+	float enter = 0.f;
+	float leave = maxFraction;
+	for( int axis = 0; axis < 2; ++axis )
+	{
+		if( delta[ axis ] == 0.f )
+		{
+			//A segment parallel to the sides has to start between them
+			if( start[ axis ] < low[ axis ] || start[ axis ] > high[ axis ] )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			float enterAxis = ( low[ axis ] - start[ axis ] ) / delta[ axis ];
+			float leaveAxis = ( high[ axis ] - start[ axis ] ) / delta[ axis ];
+			if( enterAxis > leaveAxis )
+			{
+				float swap = enterAxis;
+				enterAxis = leaveAxis;
+				leaveAxis = swap;
+			}
+
+			enter = SDL_max( enter, enterAxis );
+			leave = SDL_min( leave, leaveAxis );
+			if( enter > leave )
+			{
+				return false;
+			}
+		}
+	}
+
+	*fraction = enter;
+	return true;
+}
+
+void runBenchmark()
+{
+	//Level boxes of mixed sizes, then dot sized boxes that wander
+	int count = BENCHMARK_STATIC + BENCHMARK_MOVING;
+	std::vector<SDL_Rect> boxes( count );
+	std::vector<SDL_Point> velocities( count );
+	for( int i = 0; i < count; ++i )
+	{
+		bool moving = i >= BENCHMARK_STATIC;
+		boxes[ i ].x = rand() % BENCHMARK_WORLD;
+		boxes[ i ].y = rand() % BENCHMARK_WORLD;
+		boxes[ i ].w = moving ? Dot::DOT_WIDTH : 8 + rand() % 56;
+		boxes[ i ].h = moving ? Dot::DOT_HEIGHT : 8 + rand() % 56;
+		velocities[ i ].x = moving ? rand() % 7 - 3 : 0;
+		velocities[ i ].y = moving ? rand() % 7 - 3 : 0;
+	}
+
+	//Both kinds go in the same tree
+	Uint64 start = SDL_GetPerformanceCounter();
+	LAABBTree tree;
+	std::vector<int> proxies( count );
+	for( int i = 0; i < count; ++i )
+	{
+		proxies[ i ] = tree.insert( boxes[ i ], &boxes[ i ] );
+	}
+	Uint64 buildTime = SDL_GetPerformanceCounter() - start;
+
+	Uint64 updateTime = 0, treeQueryTime = 0, bruteQueryTime = 0, treeRayTime = 0, bruteRayTime = 0;
+	int reinserts = 0, treeHits = 0, bruteHits = 0, treeRayHits = 0, bruteRayHits = 0;
+	std::vector<void*> hits;
+	std::vector<SDL_Rect> rays( BENCHMARK_MOVING );
+	for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+	{
+		//Move the wandering boxes
+		start = SDL_GetPerformanceCounter();
+		for( int i = BENCHMARK_STATIC; i < count; ++i )
+		{
+			boxes[ i ].x += velocities[ i ].x;
+			boxes[ i ].y += velocities[ i ].y;
+			if( tree.move( proxies[ i ], boxes[ i ] ) )
+			{
+				++reinserts;
+			}
+		}
+		updateTime += SDL_GetPerformanceCounter() - start;
+
+		//Find what each wandering box touches
+		start = SDL_GetPerformanceCounter();
+		for( int i = BENCHMARK_STATIC; i < count; ++i )
+		{
+			tree.query( boxes[ i ], hits );
+			treeHits += hits.size();
+		}
+		treeQueryTime += SDL_GetPerformanceCounter() - start;
+
+		start = SDL_GetPerformanceCounter();
+		for( int i = BENCHMARK_STATIC; i < count; ++i )
+		{
+			for( int j = 0; j < count; ++j )
+			{
+				if( SDL_HasIntersection( &boxes[ i ], &boxes[ j ] ) )
+				{
+					++bruteHits;
+				}
+			}
+		}
+		bruteQueryTime += SDL_GetPerformanceCounter() - start;
+
+		//Cast rays from random points in random directions
+		for( int i = 0; i < BENCHMARK_MOVING; ++i )
+		{
+			rays[ i ].x = rand() % BENCHMARK_WORLD;
+			rays[ i ].y = rand() % BENCHMARK_WORLD;
+			rays[ i ].w = rand() % 1025 - 512;
+			rays[ i ].h = rand() % 1025 - 512;
+		}
+
+		start = SDL_GetPerformanceCounter();
+		for( int i = 0; i < BENCHMARK_MOVING; ++i )
+		{
+			const SDL_Rect& ray = rays[ i ];
+			if( tree.rayCast( ray.x, ray.y, ray.x + ray.w, ray.y + ray.h ) != NULL )
+			{
+				++treeRayHits;
+			}
+		}
+		treeRayTime += SDL_GetPerformanceCounter() - start;
+
+		start = SDL_GetPerformanceCounter();
+		for( int i = 0; i < BENCHMARK_MOVING; ++i )
+		{
+			const SDL_Rect& ray = rays[ i ];
+			float closest = 1.f;
+			bool hit = false;
+			for( int j = 0; j < count; ++j )
+			{
+				float fraction;
+				if( intersectRay( boxes[ j ], ray.x, ray.y, ray.w, ray.h, closest, &fraction ) )
+				{
+					closest = fraction;
+					hit = true;
+				}
+			}
+			if( hit )
+			{
+				++bruteRayHits;
+			}
+		}
+		bruteRayTime += SDL_GetPerformanceCounter() - start;
+	}
+
+	//Average per frame, hits have to match checking every box
+	double frequency = SDL_GetPerformanceFrequency();
+	double updateMs = 1000.0 * updateTime / frequency / BENCHMARK_FRAMES;
+	double treeQueryMs = 1000.0 * treeQueryTime / frequency / BENCHMARK_FRAMES;
+	double bruteQueryMs = 1000.0 * bruteQueryTime / frequency / BENCHMARK_FRAMES;
+	double treeRayMs = 1000.0 * treeRayTime / frequency / BENCHMARK_FRAMES;
+	double bruteRayMs = 1000.0 * bruteRayTime / frequency / BENCHMARK_FRAMES;
+	printf( "Build: %d boxes, %.3f ms, height %d\n", tree.getProxyCount(), 1000.0 * buildTime / frequency, tree.getHeight() );
+	printf( "Update: %d moves, %.3f ms, %.1f moves/ms, %.1f%% reinserted\n",
+		BENCHMARK_MOVING,
+		updateMs,
+		BENCHMARK_MOVING / updateMs,
+		100.0 * reinserts / BENCHMARK_MOVING / BENCHMARK_FRAMES );
+	printf( "Rect query: tree %.3f ms %d hits, every box %.3f ms %d hits, %.1fx\n", treeQueryMs, treeHits, bruteQueryMs, bruteHits, bruteQueryMs / treeQueryMs );
+	printf( "Ray cast: tree %.3f ms %d hits, every box %.3f ms %d hits, %.1fx\n", treeRayMs, treeRayHits, bruteRayMs, bruteRayHits, bruteRayMs / treeRayMs );
+
+	//Test the dot's pixels against another dot placed anywhere its box overlaps
+	LCollisionMask& mask = gDotTexture.getMask();
+	std::vector<SDL_Point> offsets( BENCHMARK_MASK_TESTS );
+	for( int i = 0; i < BENCHMARK_MASK_TESTS; ++i )
+	{
+		offsets[ i ].x = rand() % ( Dot::DOT_WIDTH * 2 - 1 ) - Dot::DOT_WIDTH + 1;
+		offsets[ i ].y = rand() % ( Dot::DOT_HEIGHT * 2 - 1 ) - Dot::DOT_HEIGHT + 1;
+	}
+
+	start = SDL_GetPerformanceCounter();
+	int maskHits = 0;
+	for( int i = 0; i < BENCHMARK_MASK_TESTS; ++i )
+	{
+		if( mask.overlaps( 0, 0, mask, offsets[ i ].x, offsets[ i ].y ) )
+		{
+			++maskHits;
+		}
+	}
+	double maskNs = 1000000000.0 * ( SDL_GetPerformanceCounter() - start ) / frequency;
+	printf( "Mask overlap: %d tests, %.1f ns per test, %d hits\n", BENCHMARK_MASK_TESTS, maskNs / BENCHMARK_MASK_TESTS, maskHits );
 }
 
 int main( int argc, char* args[] )
@@ -541,6 +1582,11 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
+		//Time tree updates and queries
+		else if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+		{
+			runBenchmark();
+		}
 		else
 		{	
 			//Main loop flag
@@ -554,6 +1600,11 @@ int main( int argc, char* args[] )
 			
 			//The dot that will be collided against
 			Dot otherDot( SCREEN_WIDTH / 4, SCREEN_HEIGHT / 4 );
+
+			//Both dots share one collision tree
+			LAABBTree tree;
+			dot.addTo( tree );
+			otherDot.addTo( tree );
 			
 			//While application is running
 			while( !quit )
@@ -572,7 +1623,7 @@ int main( int argc, char* args[] )
 				}
 
 				//Move the dot and check collision
-				dot.move( otherDot.getColliders() );
+				dot.move( tree );
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
@@ -1,16 +1,52 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, vectors, and strings
+//Using SDL, SDL_image, standard IO, math, strings, and vectors
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <string.h>
+#include <cmath>
 #include <string>
+#include <vector>
+
+//SIMD collision kernels are only built for x86
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#define COLLISION_SIMD
+#include <immintrin.h>
+#endif
+
+//Lets GCC and Clang build SSE2 and AVX2 functions without raising the target of the whole program
+#if defined( COLLISION_SIMD ) && defined( __GNUC__ )
+#define TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Broadphase cells are 1 << SPATIAL_CELL_SHIFT pixels wide, about twice the size of a body
+const int SPATIAL_CELL_SHIFT = 5;
+
+//Body counts the benchmark runs, spacing giving each body a fixed share of the world, and frames timed
+const int BENCHMARK_BODIES[] = { 1000, 10000, 100000 };
+const int BENCHMARK_SPACING = 40;
+const int BENCHMARK_FRAMES = 10;
+
+//Circles in the batch benchmark and circles tested against all of them
+const int BENCHMARK_BATCH = 4096;
+const int BENCHMARK_QUERIES = 4096;
+
+//Two bodies that may be colliding
+struct BodyPair
+{
+	int a, b;
+};
+
 //A circle stucture
 struct Circle
 {
@@ -64,6 +100,16 @@ class LTexture
 		int mHeight;
 };
 
+//Where a moving shape first touches another
+struct Contact
+{
+	//Fraction of the move made before touching
+	float time;
+
+	//Direction pointing out of the surface that was touched
+	float normalX, normalY;
+};
+
 //The dot that will move around on the screen
 class Dot
 {
@@ -81,7 +127,7 @@ class Dot
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
 
-		//Moves the dot and checks collision
+		//Moves the dot until it touches a shape, then slides along it
 		void move( SDL_Rect& square, Circle& circle );
 
 		//Shows the dot on the screen
@@ -102,6 +148,103 @@ class Dot
 
 		//Moves the collision circle relative to the dot's offset
 		void shiftColliders();
+
+		//Checks the dot's collision circle centered at a position against the shapes
+		bool collidesAt( int x, int y, SDL_Rect& square, Circle& circle );
+};
+
+//Uniform grid broadphase hashed by cell so the world has no bounds
+class LSpatialHash
+{
+    public:
+		//Initializes variables with the cell size as a power of two
+		LSpatialHash( int cellShift = SPATIAL_CELL_SHIFT );
+
+		//Removes all bodies, keeping memory for the next frame
+		void clear();
+
+		//Adds a body to every cell its box covers
+		void insert( int id, const SDL_Rect& box );
+		void insert( int id, const Circle& circle );
+
+		//Gets each pair of bodies sharing a cell once
+		void findPairs( std::vector<BodyPair>& pairs );
+
+    private:
+		//A body in one cell
+		struct Entry
+		{
+			int cellX, cellY;
+			int id;
+		};
+
+		//Gets the bucket a cell falls in
+		int getBucket( int cellX, int cellY, int mask );
+
+		//The cell size
+		int mCellShift;
+
+		//Boxes by body id
+		std::vector<SDL_Rect> mBoxes;
+
+		//Bodies in each cell they cover, and the same grouped by bucket
+		std::vector<Entry> mEntries;
+		std::vector<Entry> mSorted;
+
+		//Where each bucket ends in the grouped entries
+		std::vector<int> mBucketEnds;
+};
+
+//Instruction sets the batch tests can use
+enum CollisionPath
+{
+	COLLISION_PATH_SCALAR,
+	COLLISION_PATH_SSE2,
+	COLLISION_PATH_AVX2,
+	COLLISION_PATH_TOTAL
+};
+
+//Names of the collision paths
+const char* COLLISION_PATH_NAMES[ COLLISION_PATH_TOTAL ] = { "Scalar", "SSE2", "AVX2" };
+
+//Tests a circle against count circles, setting a bit in hits for each overlap, hits has a word per 32 circles
+typedef void (*CircleKernel)( const Circle& circle, const int* x, const int* y, const int* r, Uint32* hits, int count );
+
+//Gets the kernel for a path, NULL if this build or CPU can't run it
+CircleKernel getCircleKernel( CollisionPath path );
+
+//Circles stored as one array per field so one circle can be tested against all of them at once
+class LCircleBatch
+{
+    public:
+		//Initializes variables
+		LCircleBatch();
+
+		//Removes all circles, keeping memory
+		void clear();
+
+		//Adds a circle, the SIMD paths are exact while two radii add up to at most 32767
+		void add( const Circle& circle );
+
+		//Tests a circle against every circle in the batch, bit i % 32 of hits[ i / 32 ] is set if it overlaps circle i
+		void collide( const Circle& circle, std::vector<Uint32>& hits );
+
+		//Picks the instruction set used by collide, returns false if it's not available
+		bool setPath( CollisionPath path );
+		CollisionPath getPath();
+
+		//Gets the number of circles
+		int getCount();
+
+    private:
+		//Centers and radii
+		std::vector<int> mX;
+		std::vector<int> mY;
+		std::vector<int> mR;
+
+		//Kernel for the chosen instruction set
+		CircleKernel mKernel;
+		CollisionPath mPath;
 };
 
 //Starts up SDL and creates window
@@ -119,9 +262,21 @@ bool checkCollision( Circle& a, Circle& b );
 //Circle/Box collision detector
 bool checkCollision( Circle& a, SDL_Rect& b );
 
+//Swept box collision detector, finds when a box moving by the velocity first touches another, contact is left alone on a miss
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact );
+
+//Swept circle/circle collision detector, contact is left alone on a miss or if they already overlap
+bool sweepCollision( Circle& a, int velX, int velY, Circle& b, Contact& contact );
+
+//Swept circle/box collision detector, contact is left alone on a miss or if they already overlap
+bool sweepCollision( Circle& a, int velX, int velY, SDL_Rect& b, Contact& contact );
+
 //Calculates distance squared between two points
 double distanceSquared( int x1, int y1, int x2, int y2 );
 
+//Times naive pair testing against the broadphase
+void runBenchmark();
+
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
 
@@ -326,28 +481,67 @@ void Dot::handleEvent( SDL_Event& e )
 
 void Dot::move( SDL_Rect& square, Circle& circle )
 {
-    //Move the dot left or right
-    mPosX += mVelX;
-	shiftColliders();
-
-    //If the dot collided or went too far to the left or right
-	if( ( mPosX - mCollider.r < 0 ) || ( mPosX + mCollider.r > SCREEN_WIDTH ) || checkCollision( mCollider, square ) || checkCollision( mCollider, circle ) )
+    //Move until a shape is touched, then slide along it with the rest of the move
+    int velX = mVelX;
+    int velY = mVelY;
+    for( int pass = 0; pass < 2 && ( velX != 0 || velY != 0 ); ++pass )
     {
-        //Move back
-        mPosX -= mVelX;
-		shiftColliders();
-    }
+        //Keep the move on the screen, sliding can turn it toward an edge
+        velX = SDL_max( mCollider.r - mPosX, SDL_min( velX, SCREEN_WIDTH - mCollider.r - mPosX ) );
+        velY = SDL_max( mCollider.r - mPosY, SDL_min( velY, SCREEN_HEIGHT - mCollider.r - mPosY ) );
+
+        //Find when the dot touches the first shape, if it does
+        Contact contact = { 1.f, 0.f, 0.f };
+        Contact circleContact;
+        sweepCollision( mCollider, velX, velY, square, contact );
+        if( sweepCollision( mCollider, velX, velY, circle, circleContact ) && circleContact.time < contact.time )
+        {
+            contact = circleContact;
+        }
 
-    //Move the dot up or down
-    mPosY += mVelY;
-	shiftColliders();
+        //Move up to it, backing off a pixel at a time if rounding pushed the dot in
+        int moveX = (int)std::lround( velX * contact.time );
+        int moveY = (int)std::lround( velY * contact.time );
+        while( ( moveX != 0 || moveY != 0 ) && collidesAt( mPosX + moveX, mPosY + moveY, square, circle ) )
+        {
+            if( abs( moveX ) >= abs( moveY ) )
+            {
+                moveX -= moveX > 0 ? 1 : -1;
+            }
+            else
+            {
+                moveY -= moveY > 0 ? 1 : -1;
+            }
+        }
+        mPosX += moveX;
+        mPosY += moveY;
+        shiftColliders();
+
+        //Drop the part of what's left going into the shape
+        float restX = (float)( velX - moveX );
+        float restY = (float)( velY - moveY );
+        float into = restX * contact.normalX + restY * contact.normalY;
+        if( into < 0.f )
+        {
+            restX -= into * contact.normalX;
+            restY -= into * contact.normalY;
+        }
+        //Round rather than truncate, a slide along a curve is often under a pixel per axis
+        velX = (int)std::lround( restX );
+        velY = (int)std::lround( restY );
 
-    //If the dot collided or went too far up or down
-    if( ( mPosY - mCollider.r < 0 ) || ( mPosY + mCollider.r > SCREEN_HEIGHT ) || checkCollision( mCollider, square ) || checkCollision( mCollider, circle ) )
-    {
-        //Move back
-        mPosY -= mVelY;
-		shiftColliders();
+        //If the rounded slide still cuts into the curve, step along its larger axis only
+        if( velX != 0 && velY != 0 && collidesAt( mPosX + velX, mPosY + velY, square, circle ) )
+        {
+            if( fabs( restX ) >= fabs( restY ) )
+            {
+                velY = 0;
+            }
+            else
+            {
+                velX = 0;
+            }
+        }
     }
 }
 
@@ -369,6 +563,12 @@ void Dot::shiftColliders()
 	mCollider.y = mPosY;
 }
 
+bool Dot::collidesAt( int x, int y, SDL_Rect& square, Circle& circle )
+{
+	Circle collider = { x, y, mCollider.r };
+	return checkCollision( collider, square ) || checkCollision( collider, circle );
+}
+
 bool init()
 {
 	//Initialization flag
@@ -515,6 +715,141 @@ bool checkCollision( Circle& a, SDL_Rect& b )
     return false;
 }
 
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact )
+{
+    //The velocity and sides of both boxes by axis
+    int velocity[ 2 ] = { velX, velY };
+    int startA[ 2 ] = { a.x, a.y };
+    int endA[ 2 ] = { a.x + a.w, a.y + a.h };
+    int startB[ 2 ] = { b.x, b.y };
+    int endB[ 2 ] = { b.x + b.w, b.y + b.h };
+
+    //When the boxes start and stop overlapping on each axis
+    float enter[ 2 ], leave[ 2 ];
+    for( int axis = 0; axis < 2; ++axis )
+    {
+        if( velocity[ axis ] > 0 )
+        {
+            enter[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+        }
+        else if( velocity[ axis ] < 0 )
+        {
+            enter[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+        }
+        //Not moving on this axis, so it has to overlap the whole time
+        else if( startA[ axis ] < endB[ axis ] && endA[ axis ] > startB[ axis ] )
+        {
+            enter[ axis ] = -INFINITY;
+            leave[ axis ] = INFINITY;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    //The boxes overlap once they overlap on both axes
+    float enterBoth = SDL_max( enter[ 0 ], enter[ 1 ] );
+    float leaveBoth = SDL_min( leave[ 0 ], leave[ 1 ] );
+
+    //If they never overlap, only touch, already overlap, or don't reach each other this move
+    if( enterBoth >= leaveBoth || enterBoth < 0.f || enterBoth >= 1.f )
+    {
+        return false;
+    }
+
+    //The axis that started overlapping last is the one that was hit
+    contact.time = enterBoth;
+    contact.normalX = 0.f;
+    contact.normalY = 0.f;
+    if( enter[ 0 ] > enter[ 1 ] )
+    {
+        contact.normalX = velX > 0 ? -1.f : 1.f;
+    }
+    else
+    {
+        contact.normalY = velY > 0 ? -1.f : 1.f;
+    }
+
+    return true;
+}
+
+bool sweepCollision( Circle& a, int velX, int velY, Circle& b, Contact& contact )
+{
+    //Where a is from b and the distance they touch at
+    double offsetX = a.x - b.x;
+    double offsetY = a.y - b.y;
+    double totalRadius = a.r + b.r;
+
+    //Solve for when the distance between the centers is the sum of the radii
+    double qa = (double)velX * velX + (double)velY * velY;
+    double qb = 2.0 * ( offsetX * velX + offsetY * velY );
+    double qc = offsetX * offsetX + offsetY * offsetY - totalRadius * totalRadius;
+
+    //If they already overlap, aren't moving closer, or pass without touching
+    double discriminant = qb * qb - 4.0 * qa * qc;
+    if( qc < 0.0 || qb >= 0.0 || discriminant <= 0.0 )
+    {
+        return false;
+    }
+
+    //The first root is when they start to touch
+    double time = ( -qb - sqrt( discriminant ) ) / ( 2.0 * qa );
+    if( time < 0.0 || time >= 1.0 )
+    {
+        return false;
+    }
+
+    //The normal points from b's center to a's center at the time they touch
+    contact.time = (float)time;
+    contact.normalX = (float)( ( offsetX + velX * time ) / totalRadius );
+    contact.normalY = (float)( ( offsetY + velY * time ) / totalRadius );
+
+    return true;
+}
+
+bool sweepCollision( Circle& a, int velX, int velY, SDL_Rect& b, Contact& contact )
+{
+    //Shapes that already overlap are left for the caller
+    if( checkCollision( a, b ) )
+    {
+        return false;
+    }
+
+    //The circle's center touches the box grown by the radius, which is the box stretched out on each axis plus a circle on every corner
+    SDL_Rect center = { a.x, a.y, 0, 0 };
+    SDL_Rect wide = { b.x - a.r, b.y, b.w + a.r * 2, b.h };
+    SDL_Rect tall = { b.x, b.y - a.r, b.w, b.h + a.r * 2 };
+    Circle point = { a.x, a.y, 0 };
+    Circle corners[ 4 ] = { { b.x, b.y, a.r }, { b.x + b.w, b.y, a.r }, { b.x, b.y + b.h, a.r }, { b.x + b.w, b.y + b.h, a.r } };
+
+    //Keep the first of them the center touches
+    bool hit = false;
+    Contact partContact;
+    if( sweepCollision( center, velX, velY, wide, partContact ) )
+    {
+        contact = partContact;
+        hit = true;
+    }
+    if( sweepCollision( center, velX, velY, tall, partContact ) && ( !hit || partContact.time < contact.time ) )
+    {
+        contact = partContact;
+        hit = true;
+    }
+    for( int i = 0; i < 4; ++i )
+    {
+        if( sweepCollision( point, velX, velY, corners[ i ], partContact ) && ( !hit || partContact.time < contact.time ) )
+        {
+            contact = partContact;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
 double distanceSquared( int x1, int y1, int x2, int y2 )
 {
 	int deltaX = x2 - x1;
@@ -522,6 +857,455 @@ double distanceSquared( int x1, int y1, int x2, int y2 )
 	return deltaX*deltaX + deltaY*deltaY;
 }
 
+LSpatialHash::LSpatialHash( int cellShift )
+{
+	//Initialize the cell size
+	mCellShift = cellShift;
+}
+
+void LSpatialHash::clear()
+{
+	//Keep capacity, bodies are inserted again every frame
+	mEntries.clear();
+}
+
+void LSpatialHash::insert( int id, const SDL_Rect& box )
+{
+	//Empty boxes can't collide
+	if( box.w <= 0 || box.h <= 0 )
+	{
+		return;
+	}
+
+	//Remember the box for dropping duplicate pairs
+	if( id >= (int)mBoxes.size() )
+	{
+		mBoxes.resize( id + 1 );
+	}
+	mBoxes[ id ] = box;
+
+	//Cells the box covers
+	int left = box.x >> mCellShift;
+	int right = ( box.x + box.w - 1 ) >> mCellShift;
+	int top = box.y >> mCellShift;
+	int bottom = ( box.y + box.h - 1 ) >> mCellShift;
+
+	//Add the body to each of them
+	for( int y = top; y <= bottom; ++y )
+	{
+		for( int x = left; x <= right; ++x )
+		{
+			Entry entry = { x, y, id };
+			mEntries.push_back( entry );
+		}
+	}
+}
+
+void LSpatialHash::insert( int id, const Circle& circle )
+{
+	//Circles are added by the box around them
+	SDL_Rect box = { circle.x - circle.r, circle.y - circle.r, circle.r * 2, circle.r * 2 };
+	insert( id, box );
+}
+
+int LSpatialHash::getBucket( int cellX, int cellY, int mask )
+{
+	//Mix the cell coordinates so neighboring cells land far apart
+	Uint32 hash = ( (Uint32)cellX * 73856093u ) ^ ( (Uint32)cellY * 19349663u );
+	return hash & mask;
+}
+
+void LSpatialHash::findPairs( std::vector<BodyPair>& pairs )
+{
+	pairs.clear();
+
+	//Use at least twice as many buckets as entries so few cells share one
+	int entryCount = mEntries.size();
+	int bucketCount = 1;
+	while( bucketCount < entryCount * 2 )
+	{
+		bucketCount <<= 1;
+	}
+	int mask = bucketCount - 1;
+
+	//Count the entries in each bucket
+	mBucketEnds.assign( bucketCount, 0 );
+	for( int i = 0; i < entryCount; ++i )
+	{
+		++mBucketEnds[ getBucket( mEntries[ i ].cellX, mEntries[ i ].cellY, mask ) ];
+	}
+
+	//Turn the counts into where each bucket starts
+	int start = 0;
+	for( int i = 0; i < bucketCount; ++i )
+	{
+		int count = mBucketEnds[ i ];
+		mBucketEnds[ i ] = start;
+		start += count;
+	}
+
+	//Group the entries by bucket, moving each start to the bucket's end
+	mSorted.resize( entryCount );
+	for( int i = 0; i < entryCount; ++i )
+	{
+		mSorted[ mBucketEnds[ getBucket( mEntries[ i ].cellX, mEntries[ i ].cellY, mask ) ]++ ] = mEntries[ i ];
+	}
+
+	//Pair up the bodies in each bucket
+	int begin = 0;
+	for( int bucket = 0; bucket < bucketCount; ++bucket )
+	{
+		int end = mBucketEnds[ bucket ];
+		for( int i = begin; i < end; ++i )
+		{
+			const Entry& first = mSorted[ i ];
+			const SDL_Rect& a = mBoxes[ first.id ];
+			for( int j = i + 1; j < end; ++j )
+			{
+				//Buckets can hold more than one cell
+				const Entry& second = mSorted[ j ];
+				if( second.cellX != first.cellX || second.cellY != first.cellY )
+				{
+					continue;
+				}
+
+				//Only report the pair from the cell where their boxes start overlapping, bodies can share several cells
+				const SDL_Rect& b = mBoxes[ second.id ];
+				if( ( SDL_max( a.x, b.x ) >> mCellShift ) == first.cellX && ( SDL_max( a.y, b.y ) >> mCellShift ) == first.cellY )
+				{
+					BodyPair pair = { first.id, second.id };
+					pairs.push_back( pair );
+				}
+			}
+		}
+		begin = end;
+	}
+}
+
+void collideCirclesScalar( const Circle& circle, const int* x, const int* y, const int* r, Uint32* hits, int count )
+{
+	for( int word = 0; word * 32 < count; ++word )
+	{
+		//Test up to 32 circles, each overlaps if its center is closer than the sum of the radii
+		Uint32 mask = 0;
+		int end = SDL_min( 32, count - word * 32 );
+		for( int bit = 0; bit < end; ++bit )
+		{
+			int i = word * 32 + bit;
+			Sint64 deltaX = x[ i ] - circle.x;
+			Sint64 deltaY = y[ i ] - circle.y;
+			Sint64 radii = r[ i ] + circle.r;
+			mask |= (Uint32)( deltaX * deltaX + deltaY * deltaY < radii * radii ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+}
+
+#ifdef COLLISION_SIMD
+TARGET_SSE2 void collideCirclesSSE2( const Circle& circle, const int* x, const int* y, const int* r, Uint32* hits, int count )
+{
+	//The circle in every lane
+	const __m128i circleX = _mm_set1_epi32( circle.x );
+	const __m128i circleY = _mm_set1_epi32( circle.y );
+	const __m128i circleR = _mm_set1_epi32( circle.r );
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowest = _mm_set1_epi16( -32767 );
+
+	//Whole words 4 circles at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 4 )
+		{
+			int i = word * 32 + bit;
+			__m128i deltaX = _mm_sub_epi32( _mm_loadu_si128( (const __m128i*)( x + i ) ), circleX );
+			__m128i deltaY = _mm_sub_epi32( _mm_loadu_si128( (const __m128i*)( y + i ) ), circleY );
+			__m128i radii = _mm_add_epi32( _mm_loadu_si128( (const __m128i*)( r + i ) ), circleR );
+
+			//Saturate the offsets to 16 bits and interleave them, far apart circles still come out too far apart to touch
+			//-32768 is left out so two squares can't add up past the largest 32 bit value
+			__m128i deltas = _mm_max_epi16( _mm_packs_epi32( deltaX, deltaY ), lowest );
+			deltas = _mm_unpacklo_epi16( deltas, _mm_srli_si128( deltas, 8 ) );
+
+			//Square and add pairs of 16 bit values into 32 bits without overflowing
+			__m128i distance = _mm_madd_epi16( deltas, deltas );
+			radii = _mm_unpacklo_epi16( _mm_packs_epi32( radii, zero ), zero );
+			__m128i reach = _mm_madd_epi16( radii, radii );
+
+			mask |= (Uint32)_mm_movemask_ps( _mm_castsi128_ps( _mm_cmplt_epi32( distance, reach ) ) ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+
+	//Leftovers
+	collideCirclesScalar( circle, x + full, y + full, r + full, hits + full / 32, count - full );
+}
+
+TARGET_AVX2 void collideCirclesAVX2( const Circle& circle, const int* x, const int* y, const int* r, Uint32* hits, int count )
+{
+	//The circle in every lane
+	const __m256i circleX = _mm256_set1_epi32( circle.x );
+	const __m256i circleY = _mm256_set1_epi32( circle.y );
+	const __m256i circleR = _mm256_set1_epi32( circle.r );
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lowest = _mm256_set1_epi16( -32767 );
+
+	//Whole words 8 circles at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 8 )
+		{
+			int i = word * 32 + bit;
+			__m256i deltaX = _mm256_sub_epi32( _mm256_loadu_si256( (const __m256i*)( x + i ) ), circleX );
+			__m256i deltaY = _mm256_sub_epi32( _mm256_loadu_si256( (const __m256i*)( y + i ) ), circleY );
+			__m256i radii = _mm256_add_epi32( _mm256_loadu_si256( (const __m256i*)( r + i ) ), circleR );
+
+			//Same as SSE2, packing and unpacking stay within each 128 bit half so lanes keep their order
+			__m256i deltas = _mm256_max_epi16( _mm256_packs_epi32( deltaX, deltaY ), lowest );
+			deltas = _mm256_unpacklo_epi16( deltas, _mm256_srli_si256( deltas, 8 ) );
+			__m256i distance = _mm256_madd_epi16( deltas, deltas );
+			radii = _mm256_unpacklo_epi16( _mm256_packs_epi32( radii, zero ), zero );
+			__m256i reach = _mm256_madd_epi16( radii, radii );
+
+			mask |= (Uint32)_mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpgt_epi32( reach, distance ) ) ) << bit;
+		}
+		hits[ word ] = mask;
+	}
+
+	//Leftovers
+	collideCirclesScalar( circle, x + full, y + full, r + full, hits + full / 32, count - full );
+}
+#endif
+
+CircleKernel getCircleKernel( CollisionPath path )
+{
+	switch( path )
+	{
+		case COLLISION_PATH_SCALAR:
+		return collideCirclesScalar;
+
+#ifdef COLLISION_SIMD
+		case COLLISION_PATH_SSE2:
+		return SDL_HasSSE2() ? collideCirclesSSE2 : NULL;
+
+		case COLLISION_PATH_AVX2:
+		return SDL_HasAVX2() ? collideCirclesAVX2 : NULL;
+#endif
+
+		default:
+		return NULL;
+	}
+}
+
+LCircleBatch::LCircleBatch()
+{
+	//Use the widest instruction set the CPU has
+	mKernel = NULL;
+	mPath = COLLISION_PATH_SCALAR;
+	for( int path = COLLISION_PATH_TOTAL - 1; path >= 0; --path )
+	{
+		if( setPath( (CollisionPath)path ) )
+		{
+			break;
+		}
+	}
+}
+
+void LCircleBatch::clear()
+{
+	mX.clear();
+	mY.clear();
+	mR.clear();
+}
+
+void LCircleBatch::add( const Circle& circle )
+{
+	mX.push_back( circle.x );
+	mY.push_back( circle.y );
+	mR.push_back( circle.r );
+}
+
+void LCircleBatch::collide( const Circle& circle, std::vector<Uint32>& hits )
+{
+	int count = mX.size();
+	hits.resize( ( count + 31 ) / 32 );
+	if( count > 0 )
+	{
+		mKernel( circle, &mX[ 0 ], &mY[ 0 ], &mR[ 0 ], &hits[ 0 ], count );
+	}
+}
+
+bool LCircleBatch::setPath( CollisionPath path )
+{
+	//Not built or not supported by this CPU
+	CircleKernel kernel = getCircleKernel( path );
+	if( kernel == NULL )
+	{
+		return false;
+	}
+
+	mKernel = kernel;
+	mPath = path;
+	return true;
+}
+
+CollisionPath LCircleBatch::getPath()
+{
+	return mPath;
+}
+
+int LCircleBatch::getCount()
+{
+	return mX.size();
+}
+
+void runBenchmark()
+{
+	//Reused between frames
+	std::vector<Circle> bodies;
+	std::vector<BodyPair> pairs;
+	LSpatialHash broadphase;
+
+	for( int size = 0; size < (int)SDL_arraysize( BENCHMARK_BODIES ); ++size )
+	{
+		//Scatter dots over a world that grows with the body count
+		int count = BENCHMARK_BODIES[ size ];
+		int worldSize = (int)( std::sqrt( (double)count ) * BENCHMARK_SPACING );
+		bodies.resize( count );
+		for( int i = 0; i < count; ++i )
+		{
+			bodies[ i ].x = rand() % worldSize;
+			bodies[ i ].y = rand() % worldSize;
+			bodies[ i ].r = Dot::DOT_WIDTH / 2;
+		}
+
+		//Move the bodies, insert them, and test the candidate pairs every frame
+		Uint64 broadTime = 0;
+		int candidates = 0, broadHits = 0;
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			for( int i = 0; i < count; ++i )
+			{
+				bodies[ i ].x += rand() % 3 - 1;
+				bodies[ i ].y += rand() % 3 - 1;
+			}
+
+			Uint64 start = SDL_GetPerformanceCounter();
+			broadphase.clear();
+			for( int i = 0; i < count; ++i )
+			{
+				broadphase.insert( i, bodies[ i ] );
+			}
+			broadphase.findPairs( pairs );
+
+			broadHits = 0;
+			for( int i = 0; i < (int)pairs.size(); ++i )
+			{
+				if( checkCollision( bodies[ pairs[ i ].a ], bodies[ pairs[ i ].b ] ) )
+				{
+					++broadHits;
+				}
+			}
+			broadTime += SDL_GetPerformanceCounter() - start;
+			candidates = pairs.size();
+		}
+
+		//Test every pair of the last frame once
+		Uint64 start = SDL_GetPerformanceCounter();
+		int naiveHits = 0;
+		for( int i = 0; i < count; ++i )
+		{
+			for( int j = i + 1; j < count; ++j )
+			{
+				if( checkCollision( bodies[ i ], bodies[ j ] ) )
+				{
+					++naiveHits;
+				}
+			}
+		}
+		Uint64 naiveTime = SDL_GetPerformanceCounter() - start;
+
+		//Hits have to match, the broadphase only skips pairs that can't touch
+		double frequency = SDL_GetPerformanceFrequency();
+		double naiveMs = 1000.0 * naiveTime / frequency;
+		double broadMs = 1000.0 * broadTime / frequency / BENCHMARK_FRAMES;
+		printf( "%d bodies: naive %.3f ms %d hits, broadphase %.3f ms %d candidates %d hits, %.1fx\n",
+			count,
+			naiveMs,
+			naiveHits,
+			broadMs,
+			candidates,
+			broadHits,
+			naiveMs / broadMs );
+	}
+
+	//Dots to test against and dots tested against them, scattered over the screen
+	std::vector<Circle> targets( BENCHMARK_BATCH );
+	std::vector<Circle> queries( BENCHMARK_QUERIES );
+	LCircleBatch batch;
+	for( int i = 0; i < BENCHMARK_BATCH; ++i )
+	{
+		Circle circle = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, Dot::DOT_WIDTH / 2 };
+		targets[ i ] = circle;
+		batch.add( circle );
+	}
+	for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+	{
+		Circle circle = { rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT, Dot::DOT_WIDTH / 2 };
+		queries[ i ] = circle;
+	}
+
+	//One circle at a time through checkCollision
+	Uint64 start = SDL_GetPerformanceCounter();
+	int expected = 0;
+	for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+	{
+		for( int j = 0; j < BENCHMARK_BATCH; ++j )
+		{
+			if( checkCollision( queries[ i ], targets[ j ] ) )
+			{
+				++expected;
+			}
+		}
+	}
+	double tests = (double)BENCHMARK_QUERIES * BENCHMARK_BATCH;
+	double frequency = SDL_GetPerformanceFrequency();
+	double checkNs = 1000000000.0 * ( SDL_GetPerformanceCounter() - start ) / frequency;
+	printf( "checkCollision: %.3f ns per test, %d hits\n", checkNs / tests, expected );
+
+	//The whole batch at once with each instruction set
+	std::vector<Uint32> hits;
+	for( int path = 0; path < COLLISION_PATH_TOTAL; ++path )
+	{
+		if( !batch.setPath( (CollisionPath)path ) )
+		{
+			printf( "%s batch: not supported\n", COLLISION_PATH_NAMES[ path ] );
+			continue;
+		}
+
+		start = SDL_GetPerformanceCounter();
+		int found = 0;
+		for( int i = 0; i < BENCHMARK_QUERIES; ++i )
+		{
+			batch.collide( queries[ i ], hits );
+
+			//Count the hits so the work can't be skipped
+			for( int word = 0; word < hits.size(); ++word )
+			{
+				for( Uint32 mask = hits[ word ]; mask != 0; mask &= mask - 1 )
+				{
+					++found;
+				}
+			}
+		}
+		double batchNs = 1000000000.0 * ( SDL_GetPerformanceCounter() - start ) / frequency;
+		printf( "%s batch: %.3f ns per test, %d hits, %.1fx\n", COLLISION_PATH_NAMES[ path ], batchNs / tests, found, checkNs / batchNs );
+	}
+}
+
 int main( int argc, char* args[] )
 {
 	//Start up SDL and create window
@@ -536,6 +1320,11 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
+		//Time naive pair testing against the broadphase
+		else if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+		{
+			runBenchmark();
+		}
 		else
 		{	
 			//Main loop flag
@@ -1,18 +1,63 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, and strings
+//Using SDL, SDL Threads, SDL_image, standard IO, math, strings, vectors, and file stats
 #include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <cmath>
 #include <string>
+#include <vector>
+
+//SIMD particle kernels are only built for x86
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#define PARTICLE_SIMD
+#include <immintrin.h>
+#endif
+
+//Lets GCC and Clang build SSE2 and AVX2 functions without raising the target of the whole program
+#if defined( PARTICLE_SIMD ) && defined( __GNUC__ )
+#define TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
-//Particle count
-const int TOTAL_PARTICLES = 20;
+//Particles each dot starts with, particles the scene can hold, and frames a particle lives
+const int DOT_PARTICLES = 20;
+const int PARTICLE_CAPACITY = 65536;
+const int PARTICLE_LIFETIME = 10;
+
+//Particle colors
+const int PARTICLE_TYPES = 3;
+
+//Fastest a particle drifts in pixels per frame
+const float PARTICLE_DRIFT = 0.5f;
+
+//Slots per update job, a multiple of 32 so ranges start on a dead mask word, and most threads used for updating
+const int PARTICLE_RANGE = 16384;
+const int MAX_UPDATE_THREADS = 8;
+
+//Atlas page size limit, padding between packed images, and cache format version
+const int ATLAS_PAGE_SIZE = 2048;
+const int ATLAS_PADDING = 1;
+const int ATLAS_VERSION = 1;
+
+//Benchmark sprite, simulated particle, and frame counts
+const int BENCHMARK_SPRITES = 10000;
+const int BENCHMARK_PARTICLES = 1000000;
+const int BENCHMARK_FRAMES = 300;
+
+//Texture atlas, defined below
+class LTextureAtlas;
 
 //Texture wrapper class
 class LTexture
@@ -26,6 +71,9 @@ class LTexture
 
 		//Loads image at specified path
 		bool loadFromFile( std::string path );
+
+		//Uses an image packed into an atlas, sharing the atlas page
+		bool loadFromAtlas( LTextureAtlas& atlas, std::string path );
 		
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		//Creates image from font string
@@ -47,6 +95,15 @@ class LTexture
 		//Renders texture at given point
 		void render( int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
+		//Gets color and alpha modulation
+		SDL_Color getColor();
+
+		//Gets the hardware texture
+		SDL_Texture* getTexture();
+
+		//Gets the position of the image inside the hardware texture
+		SDL_Point getOffset();
+
 		//Gets image dimensions
 		int getWidth();
 		int getHeight();
@@ -58,31 +115,320 @@ class LTexture
 		//Image dimensions
 		int mWidth;
 		int mHeight;
+
+		//Position of the image inside the hardware texture
+		int mOffsetX, mOffsetY;
+
+		//Whether the hardware texture belongs to an atlas
+		bool mShared;
+
+		//Modulation of a shared texture, applied when rendering
+		SDL_Color mColor;
+};
+
+//Texture atlas class
+class LTextureAtlas
+{
+	public:
+		//Initializes variables
+		LTextureAtlas();
+
+		//Deallocates memory
+		~LTextureAtlas();
+
+		//Queues image at specified path for packing
+		void addImage( std::string path );
+
+		//Packs queued images into pages, reusing the cache when it is up to date
+		bool pack( std::string cachePath );
+
+		//Deallocates pages
+		void free();
+
+		//Gets the page holding an image and the image's area on it
+		SDL_Texture* getImage( std::string path, SDL_Rect& region );
+
+		//Gets packing stats
+		int getPageCount();
+		double getEfficiency();
+
+	private:
+		//Image placed on a page
+		struct Image
+		{
+			std::string path;
+			long modified;
+			int page;
+			SDL_Rect region;
+		};
+
+		//Stretch of the top edge of used space on a page
+		struct Segment
+		{
+			int x, y, w;
+		};
+
+		//Loads pages and layout from the cache
+		bool loadCache( std::string cachePath );
+
+		//Loads queued images and packs them
+		bool build( std::string cachePath );
+
+		//Saves pages and layout to the cache
+		void saveCache( std::string cachePath, std::vector<SDL_Surface*>& pages );
+
+		//Finds the lowest spot on a skyline that fits the given size
+		bool findSpot( std::vector<Segment>& skyline, int pageSize, int w, int h, int& x, int& y, int& segment );
+
+		//Raises the skyline under a placed rectangle
+		void place( std::vector<Segment>& skyline, int segment, int x, int y, int w, int h );
+
+		//The packed images
+		std::vector<Image> mImages;
+
+		//The page textures and their dimensions
+		std::vector<SDL_Texture*> mPages;
+		std::vector<SDL_Point> mPageSizes;
 };
 
-class Particle
+//Sprite batch class
+class LSpriteBatch
 {
 	public:
-		//Initialize position and animation
-		Particle( int x, int y );
+		//Initializes variables
+		LSpriteBatch();
+
+		//Set color modulation of sprites added after this
+		void setColor( Uint8 red, Uint8 green, Uint8 blue );
 
-		//Shows the particle
+		//Set alpha modulation of sprites added after this
+		void setAlpha( Uint8 alpha );
+
+		//Queues texture at given point, same arguments as LTexture::render
+		void add( LTexture* texture, int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
+
+		//Renders queued sprites with one geometry call per texture and empties the batch
 		void render();
 
-		//Checks if particle is dead
-		bool isDead();
+		//Gets the number of geometry calls made by the last render
+		int getDrawCalls();
 
 	private:
-		//Offsets
-		int mPosX, mPosY;
+		//Queued quads sharing one hardware texture
+		struct Bucket
+		{
+			SDL_Texture* texture;
+			int width, height;
+			std::vector<SDL_Vertex> vertices;
+			std::vector<int> indices;
+		};
+
+		//Buckets in order of first use, kept between frames to reuse their storage
+		std::vector<Bucket> mBuckets;
+
+		//Bucket of the last added sprite
+		int mLastBucket;
+
+		//Color modulation
+		SDL_Color mColor;
+
+		//Geometry calls made by the last render
+		int mDrawCalls;
+};
+
+//Runs numbered jobs across a pool of threads
+class LJobPool
+{
+	public:
+		//Initializes variables
+		LJobPool();
+
+		//Deallocates memory
+		~LJobPool();
+
+		//Starts the pool, the calling thread also runs jobs so threadCount - 1 threads are created
+		bool start( int threadCount );
+
+		//Stops the worker threads
+		void stop();
+
+		//Calls function( data, job ) for jobs 0 to jobCount - 1 and returns once all are done
+		void run( void (*function)( void*, int ), void* data, int jobCount );
 
-		//Current frame of animation
-		int mFrame;
+		//Gets threads working on jobs, including the caller
+		int getThreadCount();
 
-		//Type of particle
-		LTexture *mTexture;
+	private:
+		//Worker thread function
+		static int work( void* data );
+
+		//Runs jobs until none are left, returns how many this thread ran
+		int runJobs();
+
+		//Worker threads
+		std::vector<SDL_Thread*> mThreads;
+
+		//Guards the job setup and counters
+		SDL_mutex* mLock;
+
+		//Signals a new set of jobs and finished workers
+		SDL_cond* mStart;
+		SDL_cond* mDone;
+
+		//Current jobs
+		void (*mFunction)( void*, int );
+		void* mData;
+		int mJobCount;
+
+		//Next job to take
+		SDL_atomic_t mNextJob;
+
+		//Jobs finished and workers still running jobs
+		int mFinished;
+		int mActive;
+
+		//Counts job sets so workers know when a new one starts
+		int mGeneration;
+
+		//Tells workers to exit
+		bool mQuit;
+};
+
+//Instruction sets the particle update can use
+enum ParticlePath
+{
+	PARTICLE_PATH_SCALAR,
+	PARTICLE_PATH_SSE2,
+	PARTICLE_PATH_AVX2,
+	PARTICLE_PATH_TOTAL
+};
+
+//Names of the particle paths
+const char* PARTICLE_PATH_NAMES[ PARTICLE_PATH_TOTAL ] = { "Scalar", "SSE2", "AVX2" };
+
+//Moves and ages count particles, setting a bit in dead for each one whose life ran out, dead has a word per 32 particles
+typedef void (*ParticleKernel)( float* posX, float* posY, const float* velX, const float* velY, float* life, Uint32* dead, int count );
+
+//Gets the kernel for a path, NULL if this build or CPU can't run it
+ParticleKernel getParticleKernel( ParticlePath path );
+
+//Pooled particles stored as one array per field
+class LParticleSystem
+{
+	public:
+		//Initializes variables
+		LParticleSystem();
+
+		//Allocates slots for a fixed number of particles
+		void allocate( int capacity );
+
+		//Adds an emitter, returns its id
+		int addEmitter();
+
+		//Gets how many particles an emitter has alive
+		int getAlive( int emitter );
+
+		//Takes a free slot for a particle near a point, returns false when the pool is full
+		bool spawn( int emitter, int x, int y );
+
+		//Moves and ages particles, then compacts out dead ones, split across the pool's threads if one is given
+		void update( LJobPool* jobs = NULL );
+
+		//Shows live particles, queued in the batch if one is given
+		void render( LSpriteBatch* batch = NULL );
+
+		//Picks the instruction set used by update, returns false if it's not available
+		bool setPath( ParticlePath path );
+		ParticlePath getPath();
+
+		//Gets live particle count and pool size
+		int getCount();
+		int getCapacity();
+
+	private:
+		//Job function that updates one range
+		static void updateJob( void* data, int range );
+
+		//Moves, ages, and compacts one range
+		void updateRange( int range );
+
+		//Gets the number of ranges the slots are split into
+		int getRangeCount();
+
+		//Offsets and velocity in pixels per frame
+		std::vector<float> mPosX, mPosY;
+		std::vector<float> mVelX, mVelY;
+
+		//Frames left to live
+		std::vector<float> mLife;
+
+		//Type of particle, which picks its color
+		std::vector<Uint8> mType;
+
+		//Emitter that owns the particle
+		std::vector<int> mEmitter;
+
+		//Dead particle bits written by the kernel
+		std::vector<Uint32> mDead;
+
+		//Live particles in each range, always packed at the start of the range
+		std::vector<int> mRangeCount;
+
+		//First range that may have room for a new particle
+		int mSpawnRange;
+
+		//Emitters of culled particles, each range gets PARTICLE_RANGE + 1 entries so it can write one past its last entry without branching
+		std::vector<int> mFreed;
+		std::vector<int> mRangeFreed;
+
+		//Update kernel and the path it came from
+		ParticleKernel mKernel;
+		ParticlePath mPath;
+
+		//Live particles per emitter
+		std::vector<int> mEmitterAlive;
+
+		//Live particles
+		int mCount;
+
+		//Random state, rand() is too slow for respawning a large pool every frame
+		Uint32 mRandom;
+
+		//Gets the next random number
+		Uint32 random();
 };
 
+//Keeps a number of particles alive around a point
+class LParticleEmitter
+{
+	public:
+		//Initializes variables
+		LParticleEmitter();
+
+		//Registers with the system that holds the particles
+		void attach( LParticleSystem* system );
+
+		//Sets how many particles are kept alive
+		void setCount( int count );
+		int getCount();
+
+		//Moves the emitter
+		void setPosition( int x, int y );
+
+		//Replaces dead particles
+		void emit();
+
+	private:
+		//System holding the particles and id within it
+		LParticleSystem* mSystem;
+		int mId;
+
+		//Particles kept alive
+		int mCount;
+
+		//Offsets
+		int mPosX, mPosY;
+};
 
 //The dot that will move around on the screen
 class Dot
@@ -95,11 +441,8 @@ class Dot
 		//Maximum axis velocity of the dot
 		static const int DOT_VEL = 10;
 
-		//Initializes the variables and allocates particles
-		Dot();
-
-		//Deallocates particles
-		~Dot();
+		//Initializes the variables and attaches the emitter to the particle system
+		Dot( LParticleSystem& particles );
 
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
@@ -107,232 +450,1537 @@ class Dot
 		//Moves the dot
 		void move();
 
-		//Shows the dot on the screen
-		void render();
+		//Replaces the dot's dead particles
+		void emit();
+
+		//Shows the dot on the screen
+		void render();
+
+		//Gets how many particles the dot keeps alive
+		int getParticleCount();
+
+    private:
+		//The particle emitter
+		LParticleEmitter mEmitter;
+
+		//The X and Y offsets of the dot
+		int mPosX, mPosY;
+
+		//The velocity of the dot
+		int mVelX, mVelY;
+};
+
+//Starts up SDL and creates window
+bool init();
+
+//Loads media
+bool loadMedia();
+
+//Frees media and shuts down SDL
+void close();
+
+//Renders particles with and without batching and prints the timings
+void runBenchmark();
+
+//The window we'll be rendering to
+SDL_Window* gWindow = NULL;
+
+//The window renderer
+SDL_Renderer* gRenderer = NULL;
+
+//Scene textures
+LTexture gDotTexture;
+LTexture gRedTexture;
+LTexture gGreenTexture;
+LTexture gBlueTexture;
+LTexture gShimmerTexture;
+
+//Atlas holding the scene textures
+LTextureAtlas gAtlas;
+
+//Particle pool
+LParticleSystem gParticles;
+
+//Threads updating particles
+LJobPool gJobs;
+
+//Unbatched render calls, counted for the benchmark
+int gTextureRenders = 0;
+
+LTexture::LTexture()
+{
+	//Initialize
+	mTexture = NULL;
+	mWidth = 0;
+	mHeight = 0;
+	mOffsetX = 0;
+	mOffsetY = 0;
+	mShared = false;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+}
+
+LTexture::~LTexture()
+{
+	//Deallocate
+	free();
+}
+
+bool LTexture::loadFromFile( std::string path )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//The final texture
+	SDL_Texture* newTexture = NULL;
+
+	//Load image at specified path
+	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
+	if( loadedSurface == NULL )
+	{
+		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+	}
+	else
+	{
+		//Color key image
+		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+
+		//Create texture from surface pixels
+        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
+		if( newTexture == NULL )
+		{
+			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+		}
+		else
+		{
+			//Get image dimensions
+			mWidth = loadedSurface->w;
+			mHeight = loadedSurface->h;
+		}
+
+		//Get rid of old loaded surface
+		SDL_FreeSurface( loadedSurface );
+	}
+
+	//Return success
+	mTexture = newTexture;
+	return mTexture != NULL;
+}
+
+bool LTexture::loadFromAtlas( LTextureAtlas& atlas, std::string path )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Find the packed image
+	SDL_Rect region;
+	SDL_Texture* page = atlas.getImage( path, region );
+	if( page == NULL )
+	{
+		printf( "Unable to find %s in texture atlas!\n", path.c_str() );
+	}
+	else
+	{
+		//Share the page
+		mTexture = page;
+		mShared = true;
+		mOffsetX = region.x;
+		mOffsetY = region.y;
+		mWidth = region.w;
+		mHeight = region.h;
+		mColor.r = 0xFF;
+		mColor.g = 0xFF;
+		mColor.b = 0xFF;
+		mColor.a = 0xFF;
+	}
+
+	//Return success
+	return mTexture != NULL;
+}
+
+#if defined(SDL_TTF_MAJOR_VERSION)
+bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Render text surface
+	SDL_Surface* textSurface = TTF_RenderText_Solid( gFont, textureText.c_str(), textColor );
+	if( textSurface != NULL )
+	{
+		//Create texture from surface pixels
+        mTexture = SDL_CreateTextureFromSurface( gRenderer, textSurface );
+		if( mTexture == NULL )
+		{
+			printf( "Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError() );
+		}
+		else
+		{
+			//Get image dimensions
+			mWidth = textSurface->w;
+			mHeight = textSurface->h;
+		}
+
+		//Get rid of old surface
+		SDL_FreeSurface( textSurface );
+	}
+	else
+	{
+		printf( "Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError() );
+	}
+
+	
+	//Return success
+	return mTexture != NULL;
+}
+#endif
+
+void LTexture::free()
+{
+	//Free texture if it exists, atlas pages are freed by their atlas
+	if( mTexture != NULL )
+	{
+		if( !mShared )
+		{
+			SDL_DestroyTexture( mTexture );
+		}
+		mTexture = NULL;
+		mWidth = 0;
+		mHeight = 0;
+		mOffsetX = 0;
+		mOffsetY = 0;
+		mShared = false;
+	}
+}
+
+void LTexture::setColor( Uint8 red, Uint8 green, Uint8 blue )
+{
+	//Modulate texture rgb, shared pages are modulated when rendering
+	if( mShared )
+	{
+		mColor.r = red;
+		mColor.g = green;
+		mColor.b = blue;
+	}
+	else
+	{
+		SDL_SetTextureColorMod( mTexture, red, green, blue );
+	}
+}
+
+void LTexture::setBlendMode( SDL_BlendMode blending )
+{
+	//Set blending function
+	SDL_SetTextureBlendMode( mTexture, blending );
+}
+		
+void LTexture::setAlpha( Uint8 alpha )
+{
+	//Modulate texture alpha, shared pages are modulated when rendering
+	if( mShared )
+	{
+		mColor.a = alpha;
+	}
+	else
+	{
+		SDL_SetTextureAlphaMod( mTexture, alpha );
+	}
+}
+
+void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+{
+	//Set rendering space and render to screen
+	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+
+	//Area of the hardware texture to show
+	SDL_Rect source = { mOffsetX, mOffsetY, mWidth, mHeight };
+
+	//Set clip rendering dimensions
+	if( clip != NULL )
+	{
+		renderQuad.w = clip->w;
+		renderQuad.h = clip->h;
+
+		source.x += clip->x;
+		source.y += clip->y;
+		source.w = clip->w;
+		source.h = clip->h;
+	}
+
+	//Apply this image's modulation to the shared page
+	if( mShared )
+	{
+		SDL_SetTextureColorMod( mTexture, mColor.r, mColor.g, mColor.b );
+		SDL_SetTextureAlphaMod( mTexture, mColor.a );
+	}
+
+	//Render to screen
+	SDL_RenderCopyEx( gRenderer, mTexture, &source, &renderQuad, angle, center, flip );
+	++gTextureRenders;
+}
+
+int LTexture::getWidth()
+{
+	return mWidth;
+}
+
+int LTexture::getHeight()
+{
+	return mHeight;
+}
+
+SDL_Color LTexture::getColor()
+{
+	//Read texture modulation
+	SDL_Color color = { 0xFF, 0xFF, 0xFF, 0xFF };
+	if( mShared )
+	{
+		color = mColor;
+	}
+	else if( mTexture != NULL )
+	{
+		SDL_GetTextureColorMod( mTexture, &color.r, &color.g, &color.b );
+		SDL_GetTextureAlphaMod( mTexture, &color.a );
+	}
+
+	return color;
+}
+
+SDL_Texture* LTexture::getTexture()
+{
+	return mTexture;
+}
+
+SDL_Point LTexture::getOffset()
+{
+	SDL_Point offset = { mOffsetX, mOffsetY };
+	return offset;
+}
+
+LTextureAtlas::LTextureAtlas()
+{
+}
+
+LTextureAtlas::~LTextureAtlas()
+{
+	//Deallocate
+	free();
+}
+
+void LTextureAtlas::addImage( std::string path )
+{
+	//Remember when the source was last changed
+	Image image;
+	image.path = path;
+	image.modified = 0;
+	image.page = -1;
+	image.region.x = 0;
+	image.region.y = 0;
+	image.region.w = 0;
+	image.region.h = 0;
+
+	struct stat info;
+	if( stat( path.c_str(), &info ) == 0 )
+	{
+		image.modified = info.st_mtime;
+	}
+
+	mImages.push_back( image );
+}
+
+bool LTextureAtlas::pack( std::string cachePath )
+{
+	//Get rid of preexisting pages
+	for( int i = 0; i < mPages.size(); ++i )
+	{
+		SDL_DestroyTexture( mPages[ i ] );
+	}
+	mPages.clear();
+	mPageSizes.clear();
+
+	//Only pack again when the sources changed
+	bool success = loadCache( cachePath );
+	if( !success )
+	{
+		success = build( cachePath );
+	}
+
+	if( success )
+	{
+		printf( "Packed %d images into %d pages, %.1f%% used\n", (int)mImages.size(), getPageCount(), 100.0 * getEfficiency() );
+	}
+
+	return success;
+}
+
+void LTextureAtlas::free()
+{
+	//Free pages
+	for( int i = 0; i < mPages.size(); ++i )
+	{
+		SDL_DestroyTexture( mPages[ i ] );
+	}
+	mPages.clear();
+	mPageSizes.clear();
+	mImages.clear();
+}
+
+SDL_Texture* LTextureAtlas::getImage( std::string path, SDL_Rect& region )
+{
+	//Find the image
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		if( mImages[ i ].path == path && mImages[ i ].page >= 0 && mImages[ i ].page < mPages.size() )
+		{
+			region = mImages[ i ].region;
+			return mPages[ mImages[ i ].page ];
+		}
+	}
+
+	return NULL;
+}
+
+int LTextureAtlas::getPageCount()
+{
+	return mPages.size();
+}
+
+double LTextureAtlas::getEfficiency()
+{
+	//Image area over page area
+	double used = 0, total = 0;
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		used += mImages[ i ].region.w * mImages[ i ].region.h;
+	}
+	for( int i = 0; i < mPageSizes.size(); ++i )
+	{
+		total += mPageSizes[ i ].x * mPageSizes[ i ].y;
+	}
+
+	return total > 0 ? used / total : 0;
+}
+
+bool LTextureAtlas::loadCache( std::string cachePath )
+{
+	//Open the layout
+	FILE* file = fopen( cachePath.c_str(), "r" );
+	if( file == NULL )
+	{
+		return false;
+	}
+
+	//Check version and counts
+	bool success = true;
+	int version = 0, pageCount = 0, imageCount = 0;
+	if( fscanf( file, "%d %d %d", &version, &pageCount, &imageCount ) != 3 || version != ATLAS_VERSION || imageCount != mImages.size() )
+	{
+		success = false;
+	}
+
+	//Read page dimensions
+	std::vector<SDL_Point> sizes;
+	for( int i = 0; success && i < pageCount; ++i )
+	{
+		SDL_Point size;
+		if( fscanf( file, "%d %d", &size.x, &size.y ) != 2 )
+		{
+			success = false;
+		}
+		sizes.push_back( size );
+	}
+
+	//Read image placements, which must match the queued sources
+	std::vector<Image> images = mImages;
+	for( int i = 0; success && i < imageCount; ++i )
+	{
+		Image& image = images[ i ];
+		long modified = 0;
+		char path[ 1024 ];
+		if( fscanf( file, "%d %d %d %d %d %ld %1023[^\n]", &image.page, &image.region.x, &image.region.y, &image.region.w, &image.region.h, &modified, path ) != 7 ||
+			image.path != path || image.modified != modified || image.page < 0 || image.page >= pageCount )
+		{
+			success = false;
+		}
+	}
+	fclose( file );
+
+	//Load the packed pages
+	for( int i = 0; success && i < pageCount; ++i )
+	{
+		char pagePath[ 1100 ];
+		snprintf( pagePath, sizeof( pagePath ), "%s.%d.png", cachePath.c_str(), i );
+		SDL_Texture* page = IMG_LoadTexture( gRenderer, pagePath );
+		if( page == NULL )
+		{
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode( page, SDL_BLENDMODE_BLEND );
+			mPages.push_back( page );
+		}
+	}
+
+	if( success )
+	{
+		mImages = images;
+		mPageSizes = sizes;
+	}
+	else
+	{
+		//Stale or broken cache
+		for( int i = 0; i < mPages.size(); ++i )
+		{
+			SDL_DestroyTexture( mPages[ i ] );
+		}
+		mPages.clear();
+	}
+
+	return success;
+}
+
+bool LTextureAtlas::build( std::string cachePath )
+{
+	//Largest page the renderer can hold
+	int pageSize = ATLAS_PAGE_SIZE;
+	SDL_RendererInfo info;
+	if( SDL_GetRendererInfo( gRenderer, &info ) == 0 && info.max_texture_width > 0 )
+	{
+		pageSize = SDL_min( pageSize, SDL_min( info.max_texture_width, info.max_texture_height ) );
+	}
+
+	//Load the images with the color key turned into alpha
+	bool success = true;
+	std::vector<SDL_Surface*> surfaces( mImages.size(), (SDL_Surface*)NULL );
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		SDL_Surface* loadedSurface = IMG_Load( mImages[ i ].path.c_str() );
+		if( loadedSurface == NULL )
+		{
+			printf( "Unable to load image %s! SDL_image Error: %s\n", mImages[ i ].path.c_str(), IMG_GetError() );
+			success = false;
+		}
+		else
+		{
+			SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+			surfaces[ i ] = SDL_ConvertSurfaceFormat( loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0 );
+			SDL_FreeSurface( loadedSurface );
+
+			if( surfaces[ i ] == NULL )
+			{
+				printf( "Unable to convert image %s! SDL Error: %s\n", mImages[ i ].path.c_str(), SDL_GetError() );
+				success = false;
+			}
+			else if( surfaces[ i ]->w + ATLAS_PADDING > pageSize || surfaces[ i ]->h + ATLAS_PADDING > pageSize )
+			{
+				printf( "Image %s does not fit in a %dx%d atlas page!\n", mImages[ i ].path.c_str(), pageSize, pageSize );
+				success = false;
+			}
+		}
+	}
+
+	//Pack tallest images first
+	std::vector<int> order;
+	for( int i = 0; success && i < mImages.size(); ++i )
+	{
+		int j = order.size();
+		order.push_back( i );
+		while( j > 0 && surfaces[ order[ j - 1 ] ]->h < surfaces[ i ]->h )
+		{
+			order[ j ] = order[ j - 1 ];
+			--j;
+		}
+		order[ j ] = i;
+	}
+
+	//Place each image on the first page with room, opening pages as needed
+	std::vector< std::vector<Segment> > skylines;
+	for( int i = 0; i < order.size(); ++i )
+	{
+		Image& image = mImages[ order[ i ] ];
+		int w = surfaces[ order[ i ] ]->w + ATLAS_PADDING;
+		int h = surfaces[ order[ i ] ]->h + ATLAS_PADDING;
+
+		int x = 0, y = 0, segment = 0;
+		image.page = -1;
+		for( int page = 0; page < skylines.size() && image.page < 0; ++page )
+		{
+			if( findSpot( skylines[ page ], pageSize, w, h, x, y, segment ) )
+			{
+				image.page = page;
+			}
+		}
+		if( image.page < 0 )
+		{
+			Segment ground = { 0, 0, pageSize };
+			skylines.push_back( std::vector<Segment>( 1, ground ) );
+			image.page = skylines.size() - 1;
+			findSpot( skylines.back(), pageSize, w, h, x, y, segment );
+		}
+		place( skylines[ image.page ], segment, x, y, w, h );
+
+		image.region.x = x;
+		image.region.y = y;
+		image.region.w = w - ATLAS_PADDING;
+		image.region.h = h - ATLAS_PADDING;
+	}
+
+	//Trim pages to the used area
+	for( int page = 0; page < skylines.size(); ++page )
+	{
+		SDL_Point size = { 0, 0 };
+		for( int i = 0; i < mImages.size(); ++i )
+		{
+			if( mImages[ i ].page == page )
+			{
+				size.x = SDL_max( size.x, mImages[ i ].region.x + mImages[ i ].region.w );
+				size.y = SDL_max( size.y, mImages[ i ].region.y + mImages[ i ].region.h );
+			}
+		}
+		mPageSizes.push_back( size );
+	}
+
+	//Copy the images onto the pages
+	std::vector<SDL_Surface*> pages;
+	for( int page = 0; success && page < mPageSizes.size(); ++page )
+	{
+		SDL_Surface* pageSurface = SDL_CreateRGBSurfaceWithFormat( 0, mPageSizes[ page ].x, mPageSizes[ page ].y, 32, SDL_PIXELFORMAT_ARGB8888 );
+		if( pageSurface == NULL )
+		{
+			printf( "Unable to create atlas page! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+			break;
+		}
+		SDL_FillRect( pageSurface, NULL, 0 );
+
+		for( int i = 0; i < mImages.size(); ++i )
+		{
+			if( mImages[ i ].page == page )
+			{
+				//Copy alpha as is instead of blending
+				SDL_SetSurfaceBlendMode( surfaces[ i ], SDL_BLENDMODE_NONE );
+				SDL_BlitSurface( surfaces[ i ], NULL, pageSurface, &mImages[ i ].region );
+			}
+		}
+
+		//Create page texture
+		SDL_Texture* pageTexture = SDL_CreateTextureFromSurface( gRenderer, pageSurface );
+		if( pageTexture == NULL )
+		{
+			printf( "Unable to create atlas texture! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode( pageTexture, SDL_BLENDMODE_BLEND );
+			mPages.push_back( pageTexture );
+		}
+		pages.push_back( pageSurface );
+	}
+
+	//Keep the result for the next startup
+	if( success )
+	{
+		saveCache( cachePath, pages );
+	}
+
+	//Get rid of surfaces
+	for( int i = 0; i < pages.size(); ++i )
+	{
+		SDL_FreeSurface( pages[ i ] );
+	}
+	for( int i = 0; i < surfaces.size(); ++i )
+	{
+		if( surfaces[ i ] != NULL )
+		{
+			SDL_FreeSurface( surfaces[ i ] );
+		}
+	}
+
+	return success;
+}
+
+void LTextureAtlas::saveCache( std::string cachePath, std::vector<SDL_Surface*>& pages )
+{
+	//Save pages
+	for( int i = 0; i < pages.size(); ++i )
+	{
+		char pagePath[ 1100 ];
+		snprintf( pagePath, sizeof( pagePath ), "%s.%d.png", cachePath.c_str(), i );
+		if( IMG_SavePNG( pages[ i ], pagePath ) != 0 )
+		{
+			printf( "Unable to save atlas page %s! SDL_image Error: %s\n", pagePath, IMG_GetError() );
+			return;
+		}
+	}
+
+	//Save layout
+	FILE* file = fopen( cachePath.c_str(), "w" );
+	if( file == NULL )
+	{
+		printf( "Unable to save atlas layout %s!\n", cachePath.c_str() );
+		return;
+	}
+
+	fprintf( file, "%d %d %d\n", ATLAS_VERSION, (int)mPageSizes.size(), (int)mImages.size() );
+	for( int i = 0; i < mPageSizes.size(); ++i )
+	{
+		fprintf( file, "%d %d\n", mPageSizes[ i ].x, mPageSizes[ i ].y );
+	}
+	for( int i = 0; i < mImages.size(); ++i )
+	{
+		Image& image = mImages[ i ];
+		fprintf( file, "%d %d %d %d %d %ld %s\n", image.page, image.region.x, image.region.y, image.region.w, image.region.h, image.modified, image.path.c_str() );
+	}
+	fclose( file );
+}
+
+bool LTextureAtlas::findSpot( std::vector<Segment>& skyline, int pageSize, int w, int h, int& x, int& y, int& segment )
+{
+	//Try resting the rectangle's left edge on each segment
+	bool found = false;
+	for( int i = 0; i < skyline.size(); ++i )
+	{
+		int left = skyline[ i ].x;
+		if( left + w > pageSize )
+		{
+			break;
+		}
+
+		//Rest on the highest segment underneath
+		int top = 0;
+		for( int j = i; j < skyline.size() && skyline[ j ].x < left + w; ++j )
+		{
+			top = SDL_max( top, skyline[ j ].y );
+		}
+
+		//Keep the lowest spot
+		if( top + h <= pageSize && ( !found || top < y ) )
+		{
+			found = true;
+			x = left;
+			y = top;
+			segment = i;
+		}
+	}
+
+	return found;
+}
+
+void LTextureAtlas::place( std::vector<Segment>& skyline, int segment, int x, int y, int w, int h )
+{
+	//New top edge over the rectangle
+	Segment top = { x, y + h, w };
+	skyline.insert( skyline.begin() + segment, top );
+
+	//Cut away the segments it covers
+	for( int i = segment + 1; i < skyline.size(); )
+	{
+		int overlap = x + w - skyline[ i ].x;
+		if( overlap <= 0 )
+		{
+			break;
+		}
+
+		skyline[ i ].x += overlap;
+		skyline[ i ].w -= overlap;
+		if( skyline[ i ].w <= 0 )
+		{
+			skyline.erase( skyline.begin() + i );
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	//Merge neighbours at the same height
+	for( int i = 0; i + 1 < skyline.size(); )
+	{
+		if( skyline[ i ].y == skyline[ i + 1 ].y )
+		{
+			skyline[ i ].w += skyline[ i + 1 ].w;
+			skyline.erase( skyline.begin() + i + 1 );
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+LSpriteBatch::LSpriteBatch()
+{
+	//Initialize
+	mLastBucket = -1;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+	mDrawCalls = 0;
+}
+
+void LSpriteBatch::setColor( Uint8 red, Uint8 green, Uint8 blue )
+{
+	mColor.r = red;
+	mColor.g = green;
+	mColor.b = blue;
+}
+
+void LSpriteBatch::setAlpha( Uint8 alpha )
+{
+	mColor.a = alpha;
+}
+
+void LSpriteBatch::add( LTexture* texture, int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+{
+	//Nothing to draw
+	SDL_Texture* hardware = texture->getTexture();
+	if( hardware == NULL )
+	{
+		return;
+	}
+
+	//Find the bucket for this texture, images from one atlas page share it and most sprites reuse the last one
+	if( mLastBucket < 0 || mBuckets[ mLastBucket ].texture != hardware )
+	{
+		mLastBucket = -1;
+		for( int i = 0; i < mBuckets.size(); ++i )
+		{
+			if( mBuckets[ i ].texture == hardware )
+			{
+				mLastBucket = i;
+				break;
+			}
+		}
+
+		//Start a new bucket
+		if( mLastBucket < 0 )
+		{
+			mBuckets.push_back( Bucket() );
+			mLastBucket = mBuckets.size() - 1;
+			mBuckets[ mLastBucket ].texture = hardware;
+		}
+	}
+	Bucket& bucket = mBuckets[ mLastBucket ];
+
+	//Read the page size once per batch
+	if( bucket.vertices.empty() )
+	{
+		SDL_QueryTexture( hardware, NULL, NULL, &bucket.width, &bucket.height );
+	}
+
+	//Geometry ignores texture modulation, so fold it into the vertex colors
+	SDL_Color textureColor = texture->getColor();
+	SDL_Color color;
+	color.r = mColor.r * textureColor.r / 255;
+	color.g = mColor.g * textureColor.g / 255;
+	color.b = mColor.b * textureColor.b / 255;
+	color.a = mColor.a * textureColor.a / 255;
+
+	//Source rectangle inside the hardware texture
+	SDL_Point offset = texture->getOffset();
+	SDL_Rect source = { offset.x, offset.y, texture->getWidth(), texture->getHeight() };
+	if( clip != NULL )
+	{
+		source.x += clip->x;
+		source.y += clip->y;
+		source.w = clip->w;
+		source.h = clip->h;
+	}
+
+	//Texture coordinates, swapped when flipped
+	float left = (float)source.x / bucket.width;
+	float right = (float)( source.x + source.w ) / bucket.width;
+	float top = (float)source.y / bucket.height;
+	float bottom = (float)( source.y + source.h ) / bucket.height;
+	if( flip & SDL_FLIP_HORIZONTAL )
+	{
+		float swap = left; left = right; right = swap;
+	}
+	if( flip & SDL_FLIP_VERTICAL )
+	{
+		float swap = top; top = bottom; bottom = swap;
+	}
+
+	//Rotation center, defaults to the middle of the quad like SDL_RenderCopyEx
+	float centerX = source.w / 2.f;
+	float centerY = source.h / 2.f;
+	if( center != NULL )
+	{
+		centerX = center->x;
+		centerY = center->y;
+	}
+
+	//Rotation, clockwise in degrees
+	float cosAngle = 1.f, sinAngle = 0.f;
+	if( angle != 0.0 )
+	{
+		cosAngle = cos( angle * M_PI / 180.0 );
+		sinAngle = sin( angle * M_PI / 180.0 );
+	}
+
+	//Corners clockwise from top left, relative to the center
+	float cornerX[ 4 ] = { -centerX, source.w - centerX, source.w - centerX, -centerX };
+	float cornerY[ 4 ] = { -centerY, -centerY, source.h - centerY, source.h - centerY };
+	float u[ 4 ] = { left, right, right, left };
+	float v[ 4 ] = { top, top, bottom, bottom };
+
+	//Add the corners
+	int first = bucket.vertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		SDL_Vertex vertex;
+		vertex.position.x = x + centerX + cornerX[ i ] * cosAngle - cornerY[ i ] * sinAngle;
+		vertex.position.y = y + centerY + cornerX[ i ] * sinAngle + cornerY[ i ] * cosAngle;
+		vertex.color = color;
+		vertex.tex_coord.x = u[ i ];
+		vertex.tex_coord.y = v[ i ];
+		bucket.vertices.push_back( vertex );
+	}
+
+	//Two triangles per quad
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 1 );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first + 3 );
+}
+
+void LSpriteBatch::render()
+{
+	//Draw each texture's quads at once
+	mDrawCalls = 0;
+	for( int i = 0; i < mBuckets.size(); ++i )
+	{
+		Bucket& bucket = mBuckets[ i ];
+		if( !bucket.indices.empty() )
+		{
+			SDL_RenderGeometry( gRenderer, bucket.texture, &bucket.vertices[ 0 ], bucket.vertices.size(), &bucket.indices[ 0 ], bucket.indices.size() );
+			++mDrawCalls;
+
+			//Keep the storage for the next frame
+			bucket.vertices.clear();
+			bucket.indices.clear();
+		}
+	}
+}
+
+int LSpriteBatch::getDrawCalls()
+{
+	return mDrawCalls;
+}
+
+LJobPool::LJobPool()
+{
+	//Initialize
+	mLock = NULL;
+	mStart = NULL;
+	mDone = NULL;
+	mFunction = NULL;
+	mData = NULL;
+	mJobCount = 0;
+	SDL_AtomicSet( &mNextJob, 0 );
+	mFinished = 0;
+	mActive = 0;
+	mGeneration = 0;
+	mQuit = false;
+}
+
+LJobPool::~LJobPool()
+{
+	//Deallocate
+	stop();
+}
+
+bool LJobPool::start( int threadCount )
+{
+	//Get rid of preexisting threads
+	stop();
+
+	//Create synchronization
+	mLock = SDL_CreateMutex();
+	mStart = SDL_CreateCond();
+	mDone = SDL_CreateCond();
+	if( mLock == NULL || mStart == NULL || mDone == NULL )
+	{
+		printf( "Unable to create job pool synchronization! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+
+	//Create workers, the caller is the first thread
+	mQuit = false;
+	for( int i = 1; i < threadCount; ++i )
+	{
+		SDL_Thread* thread = SDL_CreateThread( work, "Worker", this );
+		if( thread == NULL )
+		{
+			printf( "Unable to create worker thread! SDL Error: %s\n", SDL_GetError() );
+			break;
+		}
+		mThreads.push_back( thread );
+	}
+
+	return true;
+}
+
+void LJobPool::stop()
+{
+	//Tell the workers to exit and wait for them
+	if( mLock != NULL )
+	{
+		SDL_LockMutex( mLock );
+		mQuit = true;
+		SDL_CondBroadcast( mStart );
+		SDL_UnlockMutex( mLock );
+
+		for( int i = 0; i < mThreads.size(); ++i )
+		{
+			SDL_WaitThread( mThreads[ i ], NULL );
+		}
+		mThreads.clear();
+
+		//Free synchronization
+		SDL_DestroyCond( mStart );
+		SDL_DestroyCond( mDone );
+		SDL_DestroyMutex( mLock );
+		mStart = NULL;
+		mDone = NULL;
+		mLock = NULL;
+	}
+}
+
+void LJobPool::run( void (*function)( void*, int ), void* data, int jobCount )
+{
+	//No workers, run everything here
+	if( mThreads.empty() )
+	{
+		for( int job = 0; job < jobCount; ++job )
+		{
+			function( data, job );
+		}
+		return;
+	}
+
+	//Wait for stragglers from the last set, then publish the new one
+	SDL_LockMutex( mLock );
+	while( mActive > 0 )
+	{
+		SDL_CondWait( mDone, mLock );
+	}
+	mFunction = function;
+	mData = data;
+	mJobCount = jobCount;
+	SDL_AtomicSet( &mNextJob, 0 );
+	mFinished = 0;
+	++mGeneration;
+	SDL_CondBroadcast( mStart );
+	SDL_UnlockMutex( mLock );
+
+	//Help out
+	int finished = runJobs();
+
+	//Wait for every job and worker to finish
+	SDL_LockMutex( mLock );
+	mFinished += finished;
+	while( mFinished < mJobCount || mActive > 0 )
+	{
+		SDL_CondWait( mDone, mLock );
+	}
+	SDL_UnlockMutex( mLock );
+}
+
+int LJobPool::getThreadCount()
+{
+	return mThreads.size() + 1;
+}
+
+int LJobPool::work( void* data )
+{
+	LJobPool* pool = static_cast<LJobPool*>( data );
+	int seen = 0;
+
+	SDL_LockMutex( pool->mLock );
+	while( true )
+	{
+		//Wait for a new set of jobs
+		while( !pool->mQuit && pool->mGeneration == seen )
+		{
+			SDL_CondWait( pool->mStart, pool->mLock );
+		}
+		if( pool->mQuit )
+		{
+			break;
+		}
+		seen = pool->mGeneration;
+		++pool->mActive;
+		SDL_UnlockMutex( pool->mLock );
+
+		//Run jobs outside the lock
+		int finished = pool->runJobs();
+
+		//Report back
+		SDL_LockMutex( pool->mLock );
+		pool->mFinished += finished;
+		--pool->mActive;
+		SDL_CondSignal( pool->mDone );
+	}
+	SDL_UnlockMutex( pool->mLock );
+
+	return 0;
+}
+
+int LJobPool::runJobs()
+{
+	//Take jobs until they run out
+	int finished = 0;
+	while( true )
+	{
+		int job = SDL_AtomicAdd( &mNextJob, 1 );
+		if( job >= mJobCount )
+		{
+			break;
+		}
+
+		mFunction( mData, job );
+		++finished;
+	}
+
+	return finished;
+}
+
+void integrateScalar( float* posX, float* posY, const float* velX, const float* velY, float* life, Uint32* dead, int count )
+{
+	for( int word = 0; word * 32 < count; ++word )
+	{
+		//Move and age up to 32 particles, marking the dead
+		Uint32 mask = 0;
+		int end = SDL_min( 32, count - word * 32 );
+		for( int bit = 0; bit < end; ++bit )
+		{
+			int i = word * 32 + bit;
+			posX[ i ] += velX[ i ];
+			posY[ i ] += velY[ i ];
+			life[ i ] -= 1.f;
+			mask |= (Uint32)( life[ i ] <= 0.f ) << bit;
+		}
+		dead[ word ] = mask;
+	}
+}
+
+#ifdef PARTICLE_SIMD
+TARGET_SSE2 void integrateSSE2( float* posX, float* posY, const float* velX, const float* velY, float* life, Uint32* dead, int count )
+{
+	const __m128 one = _mm_set1_ps( 1.f );
+	const __m128 zero = _mm_setzero_ps();
+
+	//Whole words 4 particles at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 4 )
+		{
+			int i = word * 32 + bit;
+			_mm_storeu_ps( posX + i, _mm_add_ps( _mm_loadu_ps( posX + i ), _mm_loadu_ps( velX + i ) ) );
+			_mm_storeu_ps( posY + i, _mm_add_ps( _mm_loadu_ps( posY + i ), _mm_loadu_ps( velY + i ) ) );
+			__m128 age = _mm_sub_ps( _mm_loadu_ps( life + i ), one );
+			_mm_storeu_ps( life + i, age );
+			mask |= (Uint32)_mm_movemask_ps( _mm_cmple_ps( age, zero ) ) << bit;
+		}
+		dead[ word ] = mask;
+	}
+
+	//Leftovers
+	integrateScalar( posX + full, posY + full, velX + full, velY + full, life + full, dead + full / 32, count - full );
+}
+
+TARGET_AVX2 void integrateAVX2( float* posX, float* posY, const float* velX, const float* velY, float* life, Uint32* dead, int count )
+{
+	const __m256 one = _mm256_set1_ps( 1.f );
+	const __m256 zero = _mm256_setzero_ps();
+
+	//Whole words 8 particles at a time
+	int full = count / 32 * 32;
+	for( int word = 0; word * 32 < full; ++word )
+	{
+		Uint32 mask = 0;
+		for( int bit = 0; bit < 32; bit += 8 )
+		{
+			int i = word * 32 + bit;
+			_mm256_storeu_ps( posX + i, _mm256_add_ps( _mm256_loadu_ps( posX + i ), _mm256_loadu_ps( velX + i ) ) );
+			_mm256_storeu_ps( posY + i, _mm256_add_ps( _mm256_loadu_ps( posY + i ), _mm256_loadu_ps( velY + i ) ) );
+			__m256 age = _mm256_sub_ps( _mm256_loadu_ps( life + i ), one );
+			_mm256_storeu_ps( life + i, age );
+			mask |= (Uint32)_mm256_movemask_ps( _mm256_cmp_ps( age, zero, _CMP_LE_OQ ) ) << bit;
+		}
+		dead[ word ] = mask;
+	}
+
+	//Leftovers
+	integrateScalar( posX + full, posY + full, velX + full, velY + full, life + full, dead + full / 32, count - full );
+}
+#endif
+
+ParticleKernel getParticleKernel( ParticlePath path )
+{
+	switch( path )
+	{
+		case PARTICLE_PATH_SCALAR:
+		return integrateScalar;
+
+#ifdef PARTICLE_SIMD
+		case PARTICLE_PATH_SSE2:
+		return SDL_HasSSE2() ? integrateSSE2 : NULL;
+
+		case PARTICLE_PATH_AVX2:
+		return SDL_HasAVX2() ? integrateAVX2 : NULL;
+#endif
+
+		default:
+		return NULL;
+	}
+}
+
+LParticleSystem::LParticleSystem()
+{
+	//Initialize
+	mSpawnRange = 0;
+	mCount = 0;
+	mRandom = rand() | 1;
+
+	//Use the widest instruction set the CPU has
+	mKernel = NULL;
+	mPath = PARTICLE_PATH_SCALAR;
+	for( int path = PARTICLE_PATH_TOTAL - 1; path >= 0; --path )
+	{
+		if( setPath( (ParticlePath)path ) )
+		{
+			break;
+		}
+	}
+}
 
-    private:
-		//The particles
-		Particle* particles[ TOTAL_PARTICLES ];
+void LParticleSystem::allocate( int capacity )
+{
+	//Size every field array
+	mPosX.assign( capacity, 0.f );
+	mPosY.assign( capacity, 0.f );
+	mVelX.assign( capacity, 0.f );
+	mVelY.assign( capacity, 0.f );
+	mLife.assign( capacity, 0.f );
+	mType.assign( capacity, 0 );
+	mEmitter.assign( capacity, 0 );
+	mDead.assign( ( capacity + 31 ) / 32, 0 );
+
+	//Every range starts empty
+	int ranges = getRangeCount();
+	mRangeCount.assign( ranges, 0 );
+	mSpawnRange = 0;
+
+	//Per range outputs
+	mFreed.resize( capacity + ranges );
+	mRangeFreed.assign( ranges, 0 );
+
+	//No particles alive
+	for( int i = 0; i < mEmitterAlive.size(); ++i )
+	{
+		mEmitterAlive[ i ] = 0;
+	}
+	mCount = 0;
+}
 
-		//Shows the particles
-		void renderParticles();
+int LParticleSystem::addEmitter()
+{
+	mEmitterAlive.push_back( 0 );
+	return mEmitterAlive.size() - 1;
+}
 
-		//The X and Y offsets of the dot
-		int mPosX, mPosY;
+int LParticleSystem::getAlive( int emitter )
+{
+	return mEmitterAlive[ emitter ];
+}
 
-		//The velocity of the dot
-		int mVelX, mVelY;
-};
+bool LParticleSystem::spawn( int emitter, int x, int y )
+{
+	//Find a range with room
+	int ranges = mRangeCount.size();
+	while( mSpawnRange < ranges && mRangeCount[ mSpawnRange ] == SDL_min( PARTICLE_RANGE, getCapacity() - mSpawnRange * PARTICLE_RANGE ) )
+	{
+		++mSpawnRange;
+	}
 
-//Starts up SDL and creates window
-bool init();
+	//Pool is full
+	if( mSpawnRange == ranges )
+	{
+		return false;
+	}
 
-//Loads media
-bool loadMedia();
+	//Append to the range's live particles
+	int i = mSpawnRange * PARTICLE_RANGE + mRangeCount[ mSpawnRange ]++;
 
-//Frees media and shuts down SDL
-void close();
+	//One random number covers offsets, life, and type
+	Uint32 r = random();
 
-//The window we'll be rendering to
-SDL_Window* gWindow = NULL;
+	//Set offsets
+	mPosX[ i ] = x - 5 + ( r & 0xFF ) % 25;
+	mPosY[ i ] = y - 5 + ( ( r >> 8 ) & 0xFF ) % 25;
 
-//The window renderer
-SDL_Renderer* gRenderer = NULL;
+	//Initialize life
+	mLife[ i ] = PARTICLE_LIFETIME + 1 - ( ( r >> 16 ) & 0xFF ) % 5;
 
-//Scene textures
-LTexture gDotTexture;
-LTexture gRedTexture;
-LTexture gGreenTexture;
-LTexture gBlueTexture;
-LTexture gShimmerTexture;
+	//Set type
+	mType[ i ] = ( r >> 24 ) % PARTICLE_TYPES;
 
-LTexture::LTexture()
-{
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
-}
+	//Another covers the drift
+	r = random();
+	mVelX[ i ] = ( ( r & 0xFFFF ) / 65535.f * 2.f - 1.f ) * PARTICLE_DRIFT;
+	mVelY[ i ] = ( ( r >> 16 ) / 65535.f * 2.f - 1.f ) * PARTICLE_DRIFT;
 
-LTexture::~LTexture()
-{
-	//Deallocate
-	free();
+	//Bring it to life
+	mEmitter[ i ] = emitter;
+	++mEmitterAlive[ emitter ];
+	++mCount;
+
+	return true;
 }
 
-bool LTexture::loadFromFile( std::string path )
+void LParticleSystem::update( LJobPool* jobs )
 {
-	//Get rid of preexisting texture
-	free();
-
-	//The final texture
-	SDL_Texture* newTexture = NULL;
+	int ranges = getRangeCount();
 
-	//Load image at specified path
-	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
-	if( loadedSurface == NULL )
+	//Update ranges in parallel, they touch disjoint particles and outputs
+	if( jobs != NULL )
 	{
-		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+		jobs->run( updateJob, this, ranges );
 	}
 	else
 	{
-		//Color key image
-		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
-
-		//Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
-		if( newTexture == NULL )
+		for( int range = 0; range < ranges; ++range )
 		{
-			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+			updateRange( range );
 		}
-		else
+	}
+
+	//Take culled particles off their emitters
+	mCount = 0;
+	for( int range = 0; range < ranges; ++range )
+	{
+		int* freed = &mFreed[ range * ( PARTICLE_RANGE + 1 ) ];
+		for( int i = 0; i < mRangeFreed[ range ]; ++i )
 		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
+			--mEmitterAlive[ freed[ i ] ];
 		}
-
-		//Get rid of old loaded surface
-		SDL_FreeSurface( loadedSurface );
+		mCount += mRangeCount[ range ];
 	}
 
-	//Return success
-	mTexture = newTexture;
-	return mTexture != NULL;
+	//Any range may have room again
+	mSpawnRange = 0;
 }
 
-#if defined(SDL_TTF_MAJOR_VERSION)
-bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
+void LParticleSystem::updateJob( void* data, int range )
 {
-	//Get rid of preexisting texture
-	free();
+	static_cast<LParticleSystem*>( data )->updateRange( range );
+}
 
-	//Render text surface
-	SDL_Surface* textSurface = TTF_RenderText_Solid( gFont, textureText.c_str(), textColor );
-	if( textSurface != NULL )
+void LParticleSystem::updateRange( int range )
+{
+	//Live particles in this range
+	int first = range * PARTICLE_RANGE;
+	int count = mRangeCount[ range ];
+
+	//Work on locals, byte stores would otherwise force members to be reloaded
+	float* posX = &mPosX[ first ];
+	float* posY = &mPosY[ first ];
+	float* velX = &mVelX[ first ];
+	float* velY = &mVelY[ first ];
+	float* life = &mLife[ first ];
+	Uint8* type = &mType[ first ];
+	int* emitter = &mEmitter[ first ];
+	Uint32* dead = &mDead[ first / 32 ];
+	int* freed = &mFreed[ range * ( PARTICLE_RANGE + 1 ) ];
+
+	//Move and age
+	mKernel( posX, posY, velX, velY, life, dead, count );
+
+	//Compact survivors to the front of the range
+	int kept = 0, freedCount = 0;
+	for( int word = 0; word * 32 < count; ++word )
 	{
-		//Create texture from surface pixels
-        mTexture = SDL_CreateTextureFromSurface( gRenderer, textSurface );
-		if( mTexture == NULL )
+		int start = word * 32;
+		int end = SDL_min( start + 32, count );
+		Uint32 mask = dead[ word ];
+
+		//Nothing has died yet, these are already in place
+		if( mask == 0 && kept == start )
 		{
-			printf( "Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError() );
+			kept = end;
+			continue;
 		}
-		else
+
+		//Deaths are too random to predict, so copy every particle and only advance past survivors
+		for( int i = start; i < end; ++i )
 		{
-			//Get image dimensions
-			mWidth = textSurface->w;
-			mHeight = textSurface->h;
+			int isDead = ( mask >> ( i - start ) ) & 1;
+			int owner = emitter[ i ];
+			posX[ kept ] = posX[ i ];
+			posY[ kept ] = posY[ i ];
+			velX[ kept ] = velX[ i ];
+			velY[ kept ] = velY[ i ];
+			life[ kept ] = life[ i ];
+			type[ kept ] = type[ i ];
+			emitter[ kept ] = owner;
+			kept += 1 - isDead;
+
+			//Remember whose particle died
+			freed[ freedCount ] = owner;
+			freedCount += isDead;
 		}
-
-		//Get rid of old surface
-		SDL_FreeSurface( textSurface );
-	}
-	else
-	{
-		printf( "Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError() );
 	}
 
-	
-	//Return success
-	return mTexture != NULL;
+	mRangeCount[ range ] = kept;
+	mRangeFreed[ range ] = freedCount;
 }
-#endif
 
-void LTexture::free()
+int LParticleSystem::getRangeCount()
 {
-	//Free texture if it exists
-	if( mTexture != NULL )
+	return ( getCapacity() + PARTICLE_RANGE - 1 ) / PARTICLE_RANGE;
+}
+
+void LParticleSystem::render( LSpriteBatch* batch )
+{
+	//Texture for each type
+	LTexture* textures[ PARTICLE_TYPES ] = { &gRedTexture, &gGreenTexture, &gBlueTexture };
+
+	//Go through each range's live particles
+	for( int range = 0; range < mRangeCount.size(); ++range )
 	{
-		SDL_DestroyTexture( mTexture );
-		mTexture = NULL;
-		mWidth = 0;
-		mHeight = 0;
+		int first = range * PARTICLE_RANGE;
+		for( int i = first; i < first + mRangeCount[ range ]; ++i )
+		{
+			int x = (int)mPosX[ i ];
+			int y = (int)mPosY[ i ];
+
+			//Show image
+			LTexture* texture = textures[ mType[ i ] ];
+			if( batch != NULL )
+			{
+				batch->add( texture, x, y );
+			}
+			else
+			{
+				texture->render( x, y );
+			}
+
+			//Show shimmer
+			if( (int)mLife[ i ] % 2 == 0 )
+			{
+				if( batch != NULL )
+				{
+					batch->add( &gShimmerTexture, x, y );
+				}
+				else
+				{
+					gShimmerTexture.render( x, y );
+				}
+			}
+		}
 	}
 }
 
-void LTexture::setColor( Uint8 red, Uint8 green, Uint8 blue )
+bool LParticleSystem::setPath( ParticlePath path )
 {
-	//Modulate texture rgb
-	SDL_SetTextureColorMod( mTexture, red, green, blue );
+	//Not built or not supported by this CPU
+	ParticleKernel kernel = getParticleKernel( path );
+	if( kernel == NULL )
+	{
+		return false;
+	}
+
+	mKernel = kernel;
+	mPath = path;
+	return true;
 }
 
-void LTexture::setBlendMode( SDL_BlendMode blending )
+ParticlePath LParticleSystem::getPath()
 {
-	//Set blending function
-	SDL_SetTextureBlendMode( mTexture, blending );
+	return mPath;
 }
-		
-void LTexture::setAlpha( Uint8 alpha )
+
+Uint32 LParticleSystem::random()
 {
-	//Modulate texture alpha
-	SDL_SetTextureAlphaMod( mTexture, alpha );
+	//Xorshift
+	mRandom ^= mRandom << 13;
+	mRandom ^= mRandom >> 17;
+	mRandom ^= mRandom << 5;
+	return mRandom;
 }
 
-void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+int LParticleSystem::getCount()
 {
-	//Set rendering space and render to screen
-	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
-
-	//Set clip rendering dimensions
-	if( clip != NULL )
-	{
-		renderQuad.w = clip->w;
-		renderQuad.h = clip->h;
-	}
-
-	//Render to screen
-	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
+	return mCount;
 }
 
-int LTexture::getWidth()
+int LParticleSystem::getCapacity()
 {
-	return mWidth;
+	return mPosX.size();
 }
 
-int LTexture::getHeight()
+LParticleEmitter::LParticleEmitter()
 {
-	return mHeight;
+	//Initialize
+	mSystem = NULL;
+	mId = -1;
+	mCount = 0;
+	mPosX = 0;
+	mPosY = 0;
 }
 
-Particle::Particle( int x, int y )
+void LParticleEmitter::attach( LParticleSystem* system )
 {
-    //Set offsets
-    mPosX = x - 5 + ( rand() % 25 );
-    mPosY = y - 5 + ( rand() % 25 );
-
-    //Initialize animation
-    mFrame = rand() % 5;
-
-    //Set type
-    switch( rand() % 3 )
-    {
-        case 0: mTexture = &gRedTexture; break;
-        case 1: mTexture = &gGreenTexture; break;
-        case 2: mTexture = &gBlueTexture; break;
-    }
+	mSystem = system;
+	mId = system->addEmitter();
 }
 
-void Particle::render()
+void LParticleEmitter::setCount( int count )
 {
-    //Show image
-	mTexture->render( mPosX, mPosY );
+	mCount = count;
+}
 
-    //Show shimmer
-    if( mFrame % 2 == 0 )
-    {
-		gShimmerTexture.render( mPosX, mPosY );
-    }
+int LParticleEmitter::getCount()
+{
+	return mCount;
+}
 
-    //Animate
-    mFrame++;
+void LParticleEmitter::setPosition( int x, int y )
+{
+	mPosX = x;
+	mPosY = y;
 }
 
-bool Particle::isDead()
+void LParticleEmitter::emit()
 {
-    return mFrame > 10;
+	//Not attached
+	if( mSystem == NULL )
+	{
+		return;
+	}
+
+	//Spawn until the count is met or the pool runs out
+	for( int missing = mCount - mSystem->getAlive( mId ); missing > 0; --missing )
+	{
+		if( !mSystem->spawn( mId, mPosX, mPosY ) )
+		{
+			break;
+		}
+	}
 }
 
-Dot::Dot()
+Dot::Dot( LParticleSystem& particles )
 {
     //Initialize the offsets
     mPosX = 0;
@@ -343,19 +1991,8 @@ Dot::Dot()
     mVelY = 0;
 
     //Initialize particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        particles[ i ] = new Particle( mPosX, mPosY );
-    }
-}
-
-Dot::~Dot()
-{
-    //Delete particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        delete particles[ i ];
-    }
+    mEmitter.attach( &particles );
+    mEmitter.setCount( DOT_PARTICLES );
 }
 
 void Dot::handleEvent( SDL_Event& e )
@@ -370,6 +2007,10 @@ void Dot::handleEvent( SDL_Event& e )
             case SDLK_DOWN: mVelY += DOT_VEL; break;
             case SDLK_LEFT: mVelX -= DOT_VEL; break;
             case SDLK_RIGHT: mVelX += DOT_VEL; break;
+
+            //Double or halve the particles
+            case SDLK_EQUALS: mEmitter.setCount( SDL_min( mEmitter.getCount() * 2, PARTICLE_CAPACITY ) ); break;
+            case SDLK_MINUS: mEmitter.setCount( SDL_max( mEmitter.getCount() / 2, 1 ) ); break;
         }
     }
     //If a key was released
@@ -409,33 +2050,22 @@ void Dot::move()
     }
 }
 
+void Dot::emit()
+{
+	//Replace dead particles around the dot
+	mEmitter.setPosition( mPosX, mPosY );
+	mEmitter.emit();
+}
+
 void Dot::render()
 {
     //Show the dot
 	gDotTexture.render( mPosX, mPosY );
-
-	//Show particles on top of dot
-	renderParticles();
 }
 
-void Dot::renderParticles()
+int Dot::getParticleCount()
 {
-	//Go through particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        //Delete and replace dead particles
-        if( particles[ i ]->isDead() )
-        {
-            delete particles[ i ];
-            particles[ i ] = new Particle( mPosX, mPosY );
-        }
-    }
-
-    //Show particles
-    for( int i = 0; i < TOTAL_PARTICLES; ++i )
-    {
-        particles[ i ]->render();
-    }
+	return mEmitter.getCount();
 }
 
 bool init()
@@ -497,36 +2127,48 @@ bool loadMedia()
 	//Loading success flag
 	bool success = true;
 
+	//Pack the images into one texture so particles batch together
+	gAtlas.addImage( "dot.bmp" );
+	gAtlas.addImage( "red.bmp" );
+	gAtlas.addImage( "green.bmp" );
+	gAtlas.addImage( "blue.bmp" );
+	gAtlas.addImage( "shimmer.bmp" );
+	if( !gAtlas.pack( "particles.atlas" ) )
+	{
+		printf( "Failed to pack texture atlas!\n" );
+		success = false;
+	}
+
 	//Load dot texture
-	if( !gDotTexture.loadFromFile( "dot.bmp" ) )
+	if( !gDotTexture.loadFromAtlas( gAtlas, "dot.bmp" ) )
 	{
 		printf( "Failed to load dot texture!\n" );
 		success = false;
 	}
 
 	//Load red texture
-	if( !gRedTexture.loadFromFile( "red.bmp" ) )
+	if( !gRedTexture.loadFromAtlas( gAtlas, "red.bmp" ) )
 	{
 		printf( "Failed to load red texture!\n" );
 		success = false;
 	}
 
 	//Load green texture
-	if( !gGreenTexture.loadFromFile( "green.bmp" ) )
+	if( !gGreenTexture.loadFromAtlas( gAtlas, "green.bmp" ) )
 	{
 		printf( "Failed to load green texture!\n" );
 		success = false;
 	}
 
 	//Load blue texture
-	if( !gBlueTexture.loadFromFile( "blue.bmp" ) )
+	if( !gBlueTexture.loadFromAtlas( gAtlas, "blue.bmp" ) )
 	{
 		printf( "Failed to load blue texture!\n" );
 		success = false;
 	}
 
 	//Load shimmer texture
-	if( !gShimmerTexture.loadFromFile( "shimmer.bmp" ) )
+	if( !gShimmerTexture.loadFromAtlas( gAtlas, "shimmer.bmp" ) )
 	{
 		printf( "Failed to load shimmer texture!\n" );
 		success = false;
@@ -549,6 +2191,10 @@ void close()
 	gGreenTexture.free();
 	gBlueTexture.free();
 	gShimmerTexture.free();
+	gAtlas.free();
+
+	//Stop particle threads
+	gJobs.stop();
 
 	//Destroy window	
 	SDL_DestroyRenderer( gRenderer );
@@ -561,6 +2207,145 @@ void close()
 	SDL_Quit();
 }
 
+void runBenchmark()
+{
+	//Scatter particles over the screen
+	LParticleSystem sprites;
+	sprites.allocate( BENCHMARK_SPRITES );
+	int scattered = sprites.addEmitter();
+	for( int i = 0; i < BENCHMARK_SPRITES; ++i )
+	{
+		sprites.spawn( scattered, rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT );
+	}
+
+	//Age them once, the same frame is rendered every time
+	sprites.update();
+
+	//Batch reused every frame
+	LSpriteBatch batch;
+
+	//Run unbatched then batched
+	for( int pass = 0; pass < 2; ++pass )
+	{
+		bool batched = pass == 1;
+		Uint64 submitTime = 0, frameTime = 0;
+		int drawCalls = 0;
+
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			Uint64 frameStart = SDL_GetPerformanceCounter();
+
+			//Clear screen
+			SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+			SDL_RenderClear( gRenderer );
+
+			//Submit the sprites
+			gTextureRenders = 0;
+			sprites.render( batched ? &batch : NULL );
+			if( batched )
+			{
+				batch.render();
+				drawCalls += batch.getDrawCalls();
+			}
+			else
+			{
+				drawCalls += gTextureRenders;
+			}
+			Uint64 submitEnd = SDL_GetPerformanceCounter();
+
+			//Update screen
+			SDL_RenderPresent( gRenderer );
+
+			submitTime += submitEnd - frameStart;
+			frameTime += SDL_GetPerformanceCounter() - frameStart;
+		}
+
+		//Average per frame
+		double frequency = SDL_GetPerformanceFrequency();
+		printf( "%s: %d sprites, %d draw calls, %.3f ms submit, %.3f ms frame\n",
+			batched ? "Batched" : "Unbatched",
+			BENCHMARK_SPRITES,
+			drawCalls / BENCHMARK_FRAMES,
+			1000.0 * submitTime / frequency / BENCHMARK_FRAMES,
+			1000.0 * frameTime / frequency / BENCHMARK_FRAMES );
+	}
+
+	//Simulate a full pool on one thread with each instruction set
+	for( int path = 0; path < PARTICLE_PATH_TOTAL; ++path )
+	{
+		LParticleSystem particles;
+		if( !particles.setPath( (ParticlePath)path ) )
+		{
+			printf( "%s: not supported\n", PARTICLE_PATH_NAMES[ path ] );
+			continue;
+		}
+		particles.allocate( BENCHMARK_PARTICLES );
+		LParticleEmitter emitter;
+		emitter.attach( &particles );
+		emitter.setCount( BENCHMARK_PARTICLES );
+
+		Uint64 updateTime = 0;
+		double updated = 0;
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			emitter.setPosition( rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT );
+			emitter.emit();
+			updated += particles.getCount();
+
+			Uint64 start = SDL_GetPerformanceCounter();
+			particles.update();
+			updateTime += SDL_GetPerformanceCounter() - start;
+		}
+
+		//Throughput of moving, aging, and compacting
+		double nanoseconds = 1000000000.0 * updateTime / SDL_GetPerformanceFrequency();
+		printf( "%s: %.3f ms update, %.3f particles/ns\n",
+			PARTICLE_PATH_NAMES[ path ],
+			nanoseconds / 1000000.0 / BENCHMARK_FRAMES,
+			updated / nanoseconds );
+	}
+
+	//Simulate a full pool without rendering at each thread count
+	double baseTime = 0;
+	for( int threads = 1; threads <= MAX_UPDATE_THREADS; threads *= 2 )
+	{
+		LJobPool jobs;
+		jobs.start( threads );
+
+		LParticleSystem particles;
+		particles.allocate( BENCHMARK_PARTICLES );
+		LParticleEmitter emitter;
+		emitter.attach( &particles );
+		emitter.setCount( BENCHMARK_PARTICLES );
+
+		Uint64 emitTime = 0, updateTime = 0;
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			Uint64 start = SDL_GetPerformanceCounter();
+			emitter.setPosition( rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT );
+			emitter.emit();
+			Uint64 emitted = SDL_GetPerformanceCounter();
+			particles.update( &jobs );
+			updateTime += SDL_GetPerformanceCounter() - emitted;
+			emitTime += emitted - start;
+		}
+
+		//Average per frame, speedup against one thread
+		double frequency = SDL_GetPerformanceFrequency();
+		double updateMs = 1000.0 * updateTime / frequency / BENCHMARK_FRAMES;
+		if( threads == 1 )
+		{
+			baseTime = updateMs;
+		}
+		printf( "Simulated: %d particles, %d threads, %.3f ms emit, %.3f ms update, %.2fx\n",
+			particles.getCount(),
+			jobs.getThreadCount(),
+			1000.0 * emitTime / frequency / BENCHMARK_FRAMES,
+			updateMs,
+			baseTime / updateMs );
+	}
+}
+
 int main( int argc, char* args[] )
 {
 	//Start up SDL and create window
@@ -575,6 +2360,11 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
+		//Time unbatched against batched rendering
+		else if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+		{
+			runBenchmark();
+		}
 		else
 		{	
 			//Main loop flag
@@ -583,8 +2373,15 @@ int main( int argc, char* args[] )
 			//Event handler
 			SDL_Event e;
 
+			//Particle pool shared by emitters, updated on every core
+			gParticles.allocate( PARTICLE_CAPACITY );
+			gJobs.start( SDL_min( SDL_GetCPUCount(), MAX_UPDATE_THREADS ) );
+
 			//The dot that will be moving around on the screen
-			Dot dot;
+			Dot dot( gParticles );
+
+			//Particle sprite batch
+			LSpriteBatch batch;
 
 			//While application is running
 			while( !quit )
@@ -605,16 +2402,25 @@ int main( int argc, char* args[] )
 				//Move the dot
 				dot.move();
 
+				//Replace dead particles, then pack and animate them
+				dot.emit();
+				gParticles.update( &gJobs );
+
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
-				//Render objects
+				//Render objects, particles on top of the dot
 				dot.render();
+				gParticles.render( &batch );
+				batch.render();
 
 				//Update screen
 				SDL_RenderPresent( gRenderer );
 			}
+
+			//Report the particle count the dot ended with
+			printf( "Dot finished with %d particles\n", dot.getParticleCount() );
 		}
 	}
 
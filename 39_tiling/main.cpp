@@ -1,27 +1,52 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, standard IO, strings, and file streams
+//Using SDL, SDL Threads, SDL_image, standard IO, math, strings, vectors, deques, and memory mapped files
 #include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <cmath>
 #include <string>
-#include <fstream>
+#include <vector>
+#include <deque>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
-//The dimensions of the level
-const int LEVEL_WIDTH = 1280;
-const int LEVEL_HEIGHT = 960;
-
 //Tile constants
 const int TILE_WIDTH = 80;
 const int TILE_HEIGHT = 80;
-const int TOTAL_TILES = 192;
 const int TOTAL_TILE_SPRITES = 12;
 
+//Binary map format version
+const Uint32 MAP_VERSION = 1;
+
+//Page dimensions in tiles, each page is baked into one chunk
+const int PAGE_TILES_X = 8;
+const int PAGE_TILES_Y = 8;
+
+//Pages around the camera to load ahead of time
+const int PAGE_PREFETCH = 1;
+
+//Default cap on memory used by loaded pages and their chunks
+const size_t WORLD_MEMORY_CAP = 32 * 1024 * 1024;
+
+//Number of dots wandering the level on their own
+const int TOTAL_WANDERERS = 200;
+
+//Most cells per moving body moveBoxes looks up together before it falls back to looking up each body's own
+const int MAX_SHARED_CELLS_PER_BODY = 16;
+
 //The different tile sprites
 const int TILE_RED = 0;
 const int TILE_GREEN = 1;
@@ -54,6 +79,9 @@ class LTexture
 		bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
 		#endif
 
+		//Creates blank texture
+		bool createBlank( int width, int height, SDL_TextureAccess access );
+
 		//Deallocates texture
 		void free();
 
@@ -69,6 +97,15 @@ class LTexture
 		//Renders texture at given point
 		void render( int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
+		//Set self as render target
+		void setAsRenderTarget();
+
+		//Gets color and alpha modulation
+		SDL_Color getColor();
+
+		//Gets the hardware texture
+		SDL_Texture* getTexture();
+
 		//Gets image dimensions
 		int getWidth();
 		int getHeight();
@@ -82,28 +119,362 @@ class LTexture
 		int mHeight;
 };
 
-//The tile
-class Tile
+//Sprite batch class
+class LSpriteBatch
+{
+	public:
+		//Initializes variables
+		LSpriteBatch();
+
+		//Set color modulation of sprites added after this
+		void setColor( Uint8 red, Uint8 green, Uint8 blue );
+
+		//Set alpha modulation of sprites added after this
+		void setAlpha( Uint8 alpha );
+
+		//Queues texture at given point, same arguments as LTexture::render
+		void add( LTexture* texture, int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
+
+		//Renders queued sprites with one geometry call per texture and empties the batch
+		void render();
+
+		//Gets the number of geometry calls made by the last render
+		int getDrawCalls();
+
+	private:
+		//Queued quads sharing one texture
+		struct Bucket
+		{
+			LTexture* texture;
+			SDL_Color textureColor;
+			std::vector<SDL_Vertex> vertices;
+			std::vector<int> indices;
+		};
+
+		//Buckets in order of first use, kept between frames to reuse their storage
+		std::vector<Bucket> mBuckets;
+
+		//Bucket of the last added sprite
+		int mLastBucket;
+
+		//Color modulation
+		SDL_Color mColor;
+
+		//Geometry calls made by the last render
+		int mDrawCalls;
+};
+
+//Binary map header, stored little endian and followed by layerCount packed layers of width * height tile bytes
+//Only the first layer holds the tiles this lesson plays on, any others are checked for size and skipped
+struct MapHeader
+{
+	//Always "LMAP"
+	char magic[ 4 ];
+
+	//Format version
+	Uint32 version;
+
+	//Map dimensions in tiles
+	Uint32 width;
+	Uint32 height;
+
+	//Tile dimensions
+	Uint32 tileWidth;
+	Uint32 tileHeight;
+
+	//Number of tile layers
+	Uint32 layerCount;
+
+	//Unused, always zero
+	Uint32 reserved;
+};
+
+//Memory mapped file wrapper class
+class LMappedFile
+{
+	public:
+		//Initializes variables
+		LMappedFile();
+
+		//Unmaps file
+		~LMappedFile();
+
+		//Maps file at specified path with private copy on write pages
+		bool loadFromFile( std::string path );
+
+		//Unmaps file
+		void free();
+
+		//Gets mapped bytes
+		Uint8* getData();
+		size_t getSize();
+
+	private:
+		//The mapped bytes
+		Uint8* mData;
+		size_t mSize;
+
+		#ifdef _WIN32
+		//The file mapping object
+		HANDLE mMapping;
+		#endif
+};
+
+//Dense row-major storage of tile types
+class TileGrid
 {
     public:
-		//Initializes position and type
-		Tile( int x, int y, int tileType );
+		//Initializes variables
+		TileGrid();
+
+		//Deallocates memory
+		~TileGrid();
+
+		//Allocates a grid with the given dimensions in tiles
+		bool create( int width, int height, int tileWidth, int tileHeight );
+
+		//Deallocates tiles
+		void free();
+
+		//Gets grid dimensions in tiles
+		int getWidth();
+		int getHeight();
+
+		//Gets tile dimensions
+		int getTileWidth();
+		int getTileHeight();
 
-		//Shows the tile
+		//Gets grid dimensions in pixels
+		int getLevelWidth();
+		int getLevelHeight();
+
+		//Tile type accessors
+		int getType( int x, int y );
+		void setType( int x, int y, int tileType );
+
+		//Gets the collision box of the tile at the given cell
+		SDL_Rect getTileBox( int x, int y );
+
+		//Gets the cells overlapping a rect, returns false if there are none
+		bool getRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY );
+
+		//Shows the tiles inside the camera
 		void render( SDL_Rect& camera );
 
-		//Get the tile type
-		int getType();
+    private:
+		//The tile types
+		Uint8* mTiles;
 
-		//Get the collision box
+		//Grid dimensions in tiles
+		int mWidth;
+		int mHeight;
+
+		//Tile dimensions
+		int mTileWidth;
+		int mTileHeight;
+};
+
+//A block of tiles baked into a single target texture
+class TileChunk
+{
+    public:
+		//Initializes variables
+		TileChunk();
+
+		//Sets the level area covered by the chunk
+		void setBox( int x, int y, int w, int h );
+
+		//Get the covered area
 		SDL_Rect getBox();
 
+		//Flags the chunk to be baked again before next render
+		void invalidate();
+
+		//Draws the chunk's tiles into its texture if they changed
+		bool bake( TileGrid& tiles );
+
+		//Shows the chunk
+		void render( SDL_Rect& camera );
+
+		//Deallocates chunk texture
+		void free();
+
     private:
-		//The attributes of the tile
+		//The baked tiles
+		LTexture mTexture;
+
+		//The level area covered by the chunk
 		SDL_Rect mBox;
 
-		//The tile type
-		int mType;
+		//Whether the texture is out of date
+		bool mDirty;
+};
+
+//Page load states
+enum PageState
+{
+	PAGE_EMPTY,
+	PAGE_QUEUED,
+	PAGE_LOADING,
+	PAGE_READY,
+	PAGE_FAILED
+};
+
+//A region of the world that is loaded and evicted as a unit
+struct TilePage
+{
+	//Load state, guarded by the world lock
+	PageState state;
+
+	//The page's tiles, handed over by the loader thread once ready
+	TileGrid* tiles;
+
+	//Whether the main thread has taken the tiles over
+	bool resident;
+
+	//Whether tiles were changed since loading
+	bool modified;
+
+	//Frame the page was last near the camera
+	Uint32 lastUsed;
+
+	//The baked page
+	TileChunk chunk;
+};
+
+//A tile level whose pages are copied out of a memory mapped binary map file on a background thread
+class TileWorld
+{
+    public:
+		//Initializes variables
+		TileWorld();
+
+		//Deallocates memory
+		~TileWorld();
+
+		//Maps the map file, checks its header and starts streaming its first layer, keeping at most memoryCap bytes of pages loaded
+		bool open( std::string path, size_t memoryCap );
+
+		//Stops the loader thread and deallocates pages
+		void free();
+
+		//Gets world dimensions in pixels
+		int getLevelWidth();
+		int getLevelHeight();
+
+		//Gets tile dimensions
+		int getTileWidth();
+		int getTileHeight();
+
+		//Gets the tile type, or -1 if its page is not loaded
+		int getType( int x, int y );
+
+		//Changes the type of a loaded tile and flags its page for baking
+		bool setType( int x, int y, int tileType );
+
+		//Gets the cells overlapping a rect, returns false if there are none
+		bool getRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY );
+
+		//Requests the pages near the camera and evicts the least recently used ones over the cap
+		void update( SDL_Rect& camera );
+
+		//Flags every loaded page for baking
+		void invalidateAll();
+
+		//Frees every loaded page's chunk texture, they are made again when next shown
+		void freeChunks();
+
+		//Shows the loaded pages in the camera and placeholders for the rest
+		void render( SDL_Rect& camera );
+
+    private:
+		//Loader thread function
+		static int loadPages( void* data );
+
+		//Copies and checks a page's tiles from the mapped file, returns NULL on failure
+		TileGrid* readPage( int index );
+
+		//Gets the pages overlapping a rect, returns false if there are none
+		bool getPageRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY );
+
+		//Unloads a page
+		void evict( int index );
+
+		//The mapped map file, only read by the loader thread once it starts
+		LMappedFile mMapFile;
+
+		//Map dimensions in tiles
+		int mMapWidth;
+		int mMapHeight;
+
+		//Tile dimensions
+		int mTileWidth;
+		int mTileHeight;
+
+		//The pages
+		TilePage* mPages;
+
+		//World dimensions in pages
+		int mWidth;
+		int mHeight;
+
+		//Page dimensions in pixels
+		int mPageWidth;
+		int mPageHeight;
+
+		//Memory used by one loaded page
+		size_t mPageBytes;
+
+		//Memory limit for loaded pages
+		size_t mMemoryCap;
+
+		//Pages taken over by the main thread
+		std::vector<int> mResident;
+
+		//Pages finished by the loader thread
+		std::vector<int> mLoaded;
+
+		//Pages waiting for the loader thread, most urgent first
+		std::deque<int> mQueue;
+
+		//Frame counter for recency
+		Uint32 mFrame;
+
+		//The loader thread
+		SDL_Thread* mThread;
+
+		//Guards page states and the queues
+		SDL_mutex* mLock;
+
+		//Signals queued pages
+		SDL_cond* mCanLoad;
+
+		//Loader thread exit flag
+		bool mQuit;
+};
+
+//Where a moving shape first touches another
+struct Contact
+{
+	//Fraction of the move made before touching
+	float time;
+
+	//Direction pointing out of the surface that was touched
+	float normalX, normalY;
+};
+
+//Blocking flags for a block of cells, looked up from the level once so several moves can share them
+struct WallGrid
+{
+	//The block's first cell and dimensions in cells
+	int firstX, firstY;
+	int width, height;
+
+	//Tile dimensions
+	int tileWidth, tileHeight;
+
+	//One flag per cell, set for wall tiles and tiles that aren't loaded
+	std::vector<Uint8> walls;
 };
 
 //The dot that will move around on the screen
@@ -123,11 +494,14 @@ class Dot
 		//Takes key presses and adjusts the dot's velocity
 		void handleEvent( SDL_Event& e );
 
-		//Moves the dot and check collision against tiles
-		void move( Tile *tiles[] );
+		//Moves the dot until it touches a wall, then slides along it
+		void move( TileWorld& world );
 
 		//Centers the camera over the dot
-		void setCamera( SDL_Rect& camera );
+		void setCamera( SDL_Rect& camera, TileWorld& world );
+
+		//Get the collision box
+		SDL_Rect getBox();
 
 		//Shows the dot on the screen
 		void render( SDL_Rect& camera );
@@ -144,19 +518,52 @@ class Dot
 bool init();
 
 //Loads media
-bool loadMedia( Tile* tiles[] );
+bool loadMedia();
+
+//Loads the textures, also used to remake them after the render device is reset
+bool loadTextures();
 
 //Frees media and shuts down SDL
-void close( Tile* tiles[] );
+void close();
 
 //Box collision detector
 bool checkCollision( SDL_Rect a, SDL_Rect b );
 
-//Checks collision box against set of tiles
-bool touchesWall( SDL_Rect box, Tile* tiles[] );
+//Swept box collision detector, finds when a box moving by the velocity first touches another
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact );
+
+//Looks up the walls under a rect, treating unloaded tiles as walls, returns false if there are no cells
+bool gatherWalls( SDL_Rect rect, TileWorld& world, WallGrid& walls );
+
+//Gets the gathered cells overlapping a rect, returns false if there are none
+bool getWallRange( SDL_Rect rect, WallGrid& walls, int& firstX, int& firstY, int& lastX, int& lastY );
+
+//Checks collision box against gathered walls
+bool touchesWall( SDL_Rect box, WallGrid& walls );
+
+//Checks whether a box is over tiles that aren't loaded yet
+bool touchesUnloaded( SDL_Rect box, TileWorld& world );
+
+//Sweeps a box against gathered walls, contact is left alone on a miss
+bool sweepWalls( SDL_Rect box, int velX, int velY, WallGrid& walls, Contact& contact );
+
+//Moves a box until it touches a wall or the level's edge, then slides along it
+void moveBox( SDL_Rect& box, int velX, int velY, TileWorld& world );
 
-//Sets tiles from tile map
-bool setTiles( Tile *tiles[] );
+//Moves a box against walls already gathered over its whole move
+void moveBox( SDL_Rect& box, int velX, int velY, TileWorld& world, WallGrid& walls );
+
+//Moves a set of boxes against the level, looking up the walls they all move over once when they are close together
+void moveBoxes( SDL_Rect boxes[], SDL_Point velocities[], int count, TileWorld& world );
+
+//Opens the tile map and sets the sprite clips
+bool setTiles();
+
+//Reads a whitespace separated text map, one row per line
+bool loadTextMap( std::string path, std::vector<Uint8>& tiles, int& width, int& height );
+
+//Converts a text map to the binary map format
+bool convertMap( std::string textPath, std::string binaryPath );
 
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
@@ -169,6 +576,12 @@ LTexture gDotTexture;
 LTexture gTileTexture;
 SDL_Rect gTileClips[ TOTAL_TILE_SPRITES ];
 
+//Tile quads queued while baking chunks
+LSpriteBatch gTileBatch;
+
+//The streamed level
+TileWorld gWorld;
+
 LTexture::LTexture()
 {
 	//Initialize
@@ -261,6 +674,26 @@ bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColo
 }
 #endif
 
+bool LTexture::createBlank( int width, int height, SDL_TextureAccess access )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Create uninitialized texture
+	mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, access, width, height );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create blank texture! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		mWidth = width;
+		mHeight = height;
+	}
+
+	return mTexture != NULL;
+}
+
 void LTexture::free()
 {
 	//Free texture if it exists
@@ -307,6 +740,12 @@ void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* ce
 	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
 }
 
+void LTexture::setAsRenderTarget()
+{
+	//Make self render target
+	SDL_SetRenderTarget( gRenderer, mTexture );
+}
+
 int LTexture::getWidth()
 {
 	return mWidth;
@@ -317,129 +756,1083 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
-Tile::Tile( int x, int y, int tileType )
+SDL_Color LTexture::getColor()
 {
-    //Get the offsets
-    mBox.x = x;
-    mBox.y = y;
-
-    //Set the collision box
-    mBox.w = TILE_WIDTH;
-    mBox.h = TILE_HEIGHT;
-
-    //Get the tile type
-    mType = tileType;
-}
+	//Read texture modulation
+	SDL_Color color = { 0xFF, 0xFF, 0xFF, 0xFF };
+	if( mTexture != NULL )
+	{
+		SDL_GetTextureColorMod( mTexture, &color.r, &color.g, &color.b );
+		SDL_GetTextureAlphaMod( mTexture, &color.a );
+	}
 
-void Tile::render( SDL_Rect& camera )
-{
-    //If the tile is on screen
-    if( checkCollision( camera, mBox ) )
-    {
-        //Show the tile
-        gTileTexture.render( mBox.x - camera.x, mBox.y - camera.y, &gTileClips[ mType ] );
-    }
+	return color;
 }
 
-int Tile::getType()
+SDL_Texture* LTexture::getTexture()
 {
-    return mType;
+	return mTexture;
 }
 
-SDL_Rect Tile::getBox()
+LSpriteBatch::LSpriteBatch()
 {
-    return mBox;
+	//Initialize
+	mLastBucket = -1;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+	mDrawCalls = 0;
 }
 
-Dot::Dot()
+void LSpriteBatch::setColor( Uint8 red, Uint8 green, Uint8 blue )
 {
-    //Initialize the collision box
-    mBox.x = 0;
-    mBox.y = 0;
-	mBox.w = DOT_WIDTH;
-	mBox.h = DOT_HEIGHT;
-
-    //Initialize the velocity
-    mVelX = 0;
-    mVelY = 0;
+	mColor.r = red;
+	mColor.g = green;
+	mColor.b = blue;
 }
 
-void Dot::handleEvent( SDL_Event& e )
+void LSpriteBatch::setAlpha( Uint8 alpha )
 {
-    //If a key was pressed
-	if( e.type == SDL_KEYDOWN && e.key.repeat == 0 )
-    {
-        //Adjust the velocity
-        switch( e.key.keysym.sym )
-        {
-            case SDLK_UP: mVelY -= DOT_VEL; break;
-            case SDLK_DOWN: mVelY += DOT_VEL; break;
-            case SDLK_LEFT: mVelX -= DOT_VEL; break;
-            case SDLK_RIGHT: mVelX += DOT_VEL; break;
-        }
-    }
-    //If a key was released
-    else if( e.type == SDL_KEYUP && e.key.repeat == 0 )
-    {
-        //Adjust the velocity
-        switch( e.key.keysym.sym )
-        {
-            case SDLK_UP: mVelY += DOT_VEL; break;
-            case SDLK_DOWN: mVelY -= DOT_VEL; break;
-            case SDLK_LEFT: mVelX += DOT_VEL; break;
-            case SDLK_RIGHT: mVelX -= DOT_VEL; break;
-        }
-    }
+	mColor.a = alpha;
 }
 
-void Dot::move( Tile *tiles[] )
+void LSpriteBatch::add( LTexture* texture, int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
 {
-    //Move the dot left or right
-    mBox.x += mVelX;
-
-    //If the dot went too far to the left or right or touched a wall
-    if( ( mBox.x < 0 ) || ( mBox.x + DOT_WIDTH > LEVEL_WIDTH ) || touchesWall( mBox, tiles ) )
-    {
-        //move back
-        mBox.x -= mVelX;
-    }
-
-    //Move the dot up or down
-    mBox.y += mVelY;
-
-    //If the dot went too far up or down or touched a wall
-    if( ( mBox.y < 0 ) || ( mBox.y + DOT_HEIGHT > LEVEL_HEIGHT ) || touchesWall( mBox, tiles ) )
-    {
-        //move back
-        mBox.y -= mVelY;
-    }
-}
+	//Nothing to draw
+	if( texture->getTexture() == NULL )
+	{
+		return;
+	}
 
-void Dot::setCamera( SDL_Rect& camera )
-{
-	//Center the camera over the dot
-	camera.x = ( mBox.x + DOT_WIDTH / 2 ) - SCREEN_WIDTH / 2;
-	camera.y = ( mBox.y + DOT_HEIGHT / 2 ) - SCREEN_HEIGHT / 2;
+	//Find the bucket for this texture, most sprites reuse the last one
+	if( mLastBucket < 0 || mBuckets[ mLastBucket ].texture != texture )
+	{
+		mLastBucket = -1;
+		for( int i = 0; i < mBuckets.size(); ++i )
+		{
+			if( mBuckets[ i ].texture == texture )
+			{
+				mLastBucket = i;
+				break;
+			}
+		}
 
-	//Keep the camera in bounds
-	if( camera.x < 0 )
-	{ 
-		camera.x = 0;
+		//Start a new bucket
+		if( mLastBucket < 0 )
+		{
+			mBuckets.push_back( Bucket() );
+			mLastBucket = mBuckets.size() - 1;
+			mBuckets[ mLastBucket ].texture = texture;
+		}
 	}
-	if( camera.y < 0 )
+	Bucket& bucket = mBuckets[ mLastBucket ];
+
+	//Geometry ignores texture modulation, so read it once per batch and fold it into the vertex colors
+	if( bucket.vertices.empty() )
 	{
-		camera.y = 0;
+		bucket.textureColor = texture->getColor();
 	}
-	if( camera.x > LEVEL_WIDTH - camera.w )
+	SDL_Color color;
+	color.r = mColor.r * bucket.textureColor.r / 255;
+	color.g = mColor.g * bucket.textureColor.g / 255;
+	color.b = mColor.b * bucket.textureColor.b / 255;
+	color.a = mColor.a * bucket.textureColor.a / 255;
+
+	//Source rectangle
+	SDL_Rect source = { 0, 0, texture->getWidth(), texture->getHeight() };
+	if( clip != NULL )
+	{
+		source = *clip;
+	}
+
+	//Texture coordinates, swapped when flipped
+	float left = (float)source.x / texture->getWidth();
+	float right = (float)( source.x + source.w ) / texture->getWidth();
+	float top = (float)source.y / texture->getHeight();
+	float bottom = (float)( source.y + source.h ) / texture->getHeight();
+	if( flip & SDL_FLIP_HORIZONTAL )
+	{
+		float swap = left; left = right; right = swap;
+	}
+	if( flip & SDL_FLIP_VERTICAL )
+	{
+		float swap = top; top = bottom; bottom = swap;
+	}
+
+	//Rotation center, defaults to the middle of the quad like SDL_RenderCopyEx
+	float centerX = source.w / 2.f;
+	float centerY = source.h / 2.f;
+	if( center != NULL )
+	{
+		centerX = center->x;
+		centerY = center->y;
+	}
+
+	//Rotation, clockwise in degrees
+	float cosAngle = 1.f, sinAngle = 0.f;
+	if( angle != 0.0 )
+	{
+		cosAngle = cos( angle * M_PI / 180.0 );
+		sinAngle = sin( angle * M_PI / 180.0 );
+	}
+
+	//Corners clockwise from top left, relative to the center
+	float cornerX[ 4 ] = { -centerX, source.w - centerX, source.w - centerX, -centerX };
+	float cornerY[ 4 ] = { -centerY, -centerY, source.h - centerY, source.h - centerY };
+	float u[ 4 ] = { left, right, right, left };
+	float v[ 4 ] = { top, top, bottom, bottom };
+
+	//Add the corners
+	int first = bucket.vertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		SDL_Vertex vertex;
+		vertex.position.x = x + centerX + cornerX[ i ] * cosAngle - cornerY[ i ] * sinAngle;
+		vertex.position.y = y + centerY + cornerX[ i ] * sinAngle + cornerY[ i ] * cosAngle;
+		vertex.color = color;
+		vertex.tex_coord.x = u[ i ];
+		vertex.tex_coord.y = v[ i ];
+		bucket.vertices.push_back( vertex );
+	}
+
+	//Two triangles per quad
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 1 );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first + 3 );
+}
+
+void LSpriteBatch::render()
+{
+	//Draw each texture's quads at once
+	mDrawCalls = 0;
+	for( int i = 0; i < mBuckets.size(); ++i )
+	{
+		Bucket& bucket = mBuckets[ i ];
+		if( !bucket.indices.empty() )
+		{
+			SDL_RenderGeometry( gRenderer, bucket.texture->getTexture(), &bucket.vertices[ 0 ], bucket.vertices.size(), &bucket.indices[ 0 ], bucket.indices.size() );
+			++mDrawCalls;
+
+			//Keep the storage for the next frame
+			bucket.vertices.clear();
+			bucket.indices.clear();
+		}
+	}
+}
+
+int LSpriteBatch::getDrawCalls()
+{
+	return mDrawCalls;
+}
+
+LMappedFile::LMappedFile()
+{
+	//Initialize
+	mData = NULL;
+	mSize = 0;
+
+	#ifdef _WIN32
+	mMapping = NULL;
+	#endif
+}
+
+LMappedFile::~LMappedFile()
+{
+	//Unmap
+	free();
+}
+
+bool LMappedFile::loadFromFile( std::string path )
+{
+	//Get rid of preexisting mapping
+	free();
+
+	#ifdef _WIN32
+	//Open file
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+	{
+		printf( "Unable to open %s!\n", path.c_str() );
+		return false;
+	}
+
+	//Map file with copy on write pages
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
+	{
+		mMapping = CreateFileMappingA( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+		if( mMapping != NULL )
+		{
+			mData = (Uint8*)MapViewOfFile( mMapping, FILE_MAP_COPY, 0, 0, 0 );
+			if( mData == NULL )
+			{
+				CloseHandle( mMapping );
+				mMapping = NULL;
+			}
+			else
+			{
+				mSize = (size_t)size.QuadPart;
+			}
+		}
+	}
+	CloseHandle( file );
+	#else
+	//Open file
+	int file = open( path.c_str(), O_RDONLY );
+	if( file < 0 )
+	{
+		printf( "Unable to open %s!\n", path.c_str() );
+		return false;
+	}
+
+	//Map file with copy on write pages
+	struct stat info;
+	if( fstat( file, &info ) == 0 && info.st_size > 0 )
+	{
+		void* data = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+		if( data != MAP_FAILED )
+		{
+			mData = (Uint8*)data;
+			mSize = info.st_size;
+		}
+	}
+	::close( file );
+	#endif
+
+	if( mData == NULL )
+	{
+		printf( "Unable to map %s!\n", path.c_str() );
+	}
+
+	return mData != NULL;
+}
+
+void LMappedFile::free()
+{
+	//Unmap file if it is mapped
+	if( mData != NULL )
+	{
+		#ifdef _WIN32
+		UnmapViewOfFile( mData );
+		CloseHandle( mMapping );
+		mMapping = NULL;
+		#else
+		munmap( mData, mSize );
+		#endif
+		mData = NULL;
+		mSize = 0;
+	}
+}
+
+Uint8* LMappedFile::getData()
+{
+	return mData;
+}
+
+size_t LMappedFile::getSize()
+{
+	return mSize;
+}
+
+TileGrid::TileGrid()
+{
+	//Initialize
+	mTiles = NULL;
+	mWidth = 0;
+	mHeight = 0;
+	mTileWidth = 0;
+	mTileHeight = 0;
+}
+
+TileGrid::~TileGrid()
+{
+	//Deallocate
+	free();
+}
+
+bool TileGrid::create( int width, int height, int tileWidth, int tileHeight )
+{
+	//Get rid of preexisting tiles
+	free();
+
+	//Allocate one byte per tile
+	mTiles = new Uint8[ width * height ];
+	memset( mTiles, 0, width * height );
+
+	mWidth = width;
+	mHeight = height;
+	mTileWidth = tileWidth;
+	mTileHeight = tileHeight;
+
+	return true;
+}
+
+void TileGrid::free()
+{
+	//Free tiles if they exist
+	if( mTiles != NULL )
+	{
+		delete[] mTiles;
+		mTiles = NULL;
+		mWidth = 0;
+		mHeight = 0;
+		mTileWidth = 0;
+		mTileHeight = 0;
+	}
+}
+
+int TileGrid::getWidth()
+{
+	return mWidth;
+}
+
+int TileGrid::getHeight()
+{
+	return mHeight;
+}
+
+int TileGrid::getTileWidth()
+{
+	return mTileWidth;
+}
+
+int TileGrid::getTileHeight()
+{
+	return mTileHeight;
+}
+
+int TileGrid::getLevelWidth()
+{
+	return mWidth * mTileWidth;
+}
+
+int TileGrid::getLevelHeight()
+{
+	return mHeight * mTileHeight;
+}
+
+int TileGrid::getType( int x, int y )
+{
+	return mTiles[ y * mWidth + x ];
+}
+
+void TileGrid::setType( int x, int y, int tileType )
+{
+	mTiles[ y * mWidth + x ] = tileType;
+}
+
+SDL_Rect TileGrid::getTileBox( int x, int y )
+{
+	SDL_Rect box = { x * mTileWidth, y * mTileHeight, mTileWidth, mTileHeight };
+	return box;
+}
+
+bool TileGrid::getRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY )
+{
+	//If the rect is empty or outside the level
+	if( ( rect.w <= 0 ) || ( rect.h <= 0 ) ||
+		( rect.x + rect.w <= 0 ) || ( rect.y + rect.h <= 0 ) ||
+		( rect.x >= getLevelWidth() ) || ( rect.y >= getLevelHeight() ) )
+	{
+		return false;
+	}
+
+	//Get the cells under the rect's edges
+	firstX = rect.x < 0 ? 0 : rect.x / mTileWidth;
+	firstY = rect.y < 0 ? 0 : rect.y / mTileHeight;
+	lastX = ( rect.x + rect.w - 1 ) / mTileWidth;
+	lastY = ( rect.y + rect.h - 1 ) / mTileHeight;
+
+	//Keep the range in the grid
+	if( lastX >= mWidth )
+	{
+		lastX = mWidth - 1;
+	}
+	if( lastY >= mHeight )
+	{
+		lastY = mHeight - 1;
+	}
+
+	return true;
+}
+
+void TileGrid::render( SDL_Rect& camera )
+{
+	//Get the tiles on screen
+	int firstX, firstY, lastX, lastY;
+	if( !getRange( camera, firstX, firstY, lastX, lastY ) )
+	{
+		return;
+	}
+
+	//Show the tiles
+	for( int y = firstY; y <= lastY; ++y )
+	{
+		Uint8* row = &mTiles[ y * mWidth ];
+		for( int x = firstX; x <= lastX; ++x )
+		{
+			gTileBatch.add( &gTileTexture, x * mTileWidth - camera.x, y * mTileHeight - camera.y, &gTileClips[ row[ x ] ] );
+		}
+	}
+
+	//Draw all tiles at once
+	gTileBatch.render();
+}
+
+TileChunk::TileChunk()
+{
+	//Initialize
+	mBox.x = 0;
+	mBox.y = 0;
+	mBox.w = 0;
+	mBox.h = 0;
+	mDirty = true;
+}
+
+void TileChunk::setBox( int x, int y, int w, int h )
+{
+	//Set the covered area
+	mBox.x = x;
+	mBox.y = y;
+	mBox.w = w;
+	mBox.h = h;
+
+	//Texture no longer matches
+	mDirty = true;
+}
+
+SDL_Rect TileChunk::getBox()
+{
+	return mBox;
+}
+
+void TileChunk::invalidate()
+{
+	mDirty = true;
+}
+
+bool TileChunk::bake( TileGrid& tiles )
+{
+	//Texture is up to date
+	if( !mDirty )
+	{
+		return true;
+	}
+
+	//Create target texture the size of the chunk
+	if( mTexture.getWidth() != mBox.w || mTexture.getHeight() != mBox.h )
+	{
+		if( !mTexture.createBlank( mBox.w, mBox.h, SDL_TEXTUREACCESS_TARGET ) )
+		{
+			printf( "Failed to create chunk texture!\n" );
+			return false;
+		}
+	}
+
+	//Render to the chunk texture
+	mTexture.setAsRenderTarget();
+
+	//Clear chunk
+	SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+	SDL_RenderClear( gRenderer );
+
+	//Render the chunk's tiles from their own origin
+	SDL_Rect area = { 0, 0, mBox.w, mBox.h };
+	tiles.render( area );
+
+	//Reset render target
+	SDL_SetRenderTarget( gRenderer, NULL );
+
+	mDirty = false;
+	return true;
+}
+
+void TileChunk::render( SDL_Rect& camera )
+{
+	//Show the baked tiles
+	mTexture.render( mBox.x - camera.x, mBox.y - camera.y );
+}
+
+void TileChunk::free()
+{
+	mTexture.free();
+	mDirty = true;
+}
+
+TileWorld::TileWorld()
+{
+	//Initialize
+	mMapWidth = 0;
+	mMapHeight = 0;
+	mTileWidth = 0;
+	mTileHeight = 0;
+	mPages = NULL;
+	mWidth = 0;
+	mHeight = 0;
+	mPageWidth = 0;
+	mPageHeight = 0;
+	mPageBytes = 0;
+	mMemoryCap = 0;
+	mFrame = 0;
+	mThread = NULL;
+	mLock = NULL;
+	mCanLoad = NULL;
+	mQuit = false;
+}
+
+TileWorld::~TileWorld()
+{
+	//Deallocate
+	free();
+}
+
+bool TileWorld::open( std::string path, size_t memoryCap )
+{
+	//Get rid of preexisting pages
+	free();
+
+	//Map the file, its tiles are only touched later a page at a time
+	if( !mMapFile.loadFromFile( path ) )
+	{
+		return false;
+	}
+
+	//Read the header in place
+	MapHeader header;
+	if( mMapFile.getSize() < sizeof( MapHeader ) )
+	{
+		printf( "Error loading map %s: File too small!\n", path.c_str() );
+		free();
+		return false;
+	}
+	memcpy( &header, mMapFile.getData(), sizeof( MapHeader ) );
+	header.version = SDL_SwapLE32( header.version );
+	header.width = SDL_SwapLE32( header.width );
+	header.height = SDL_SwapLE32( header.height );
+	header.tileWidth = SDL_SwapLE32( header.tileWidth );
+	header.tileHeight = SDL_SwapLE32( header.tileHeight );
+	header.layerCount = SDL_SwapLE32( header.layerCount );
+
+	//Check the header
+	Uint64 layerSize = (Uint64)header.width * header.height;
+	if( memcmp( header.magic, "LMAP", 4 ) != 0 || header.version != MAP_VERSION )
+	{
+		printf( "Error loading map %s: Not a version %u map!\n", path.c_str(), MAP_VERSION );
+		free();
+		return false;
+	}
+	if( header.width == 0 || header.height == 0 || header.tileWidth == 0 || header.tileHeight == 0 || header.layerCount == 0 ||
+		layerSize > SDL_MAX_SINT32 || header.tileWidth > 0xFFFF || header.tileHeight > 0xFFFF ||
+		mMapFile.getSize() < sizeof( MapHeader ) + layerSize * header.layerCount )
+	{
+		printf( "Error loading map %s: Bad dimensions!\n", path.c_str() );
+		free();
+		return false;
+	}
+	if( header.layerCount > 1 )
+	{
+		printf( "Warning: Map %s has %u layers, only the first is used!\n", path.c_str(), header.layerCount );
+	}
+	mMapWidth = header.width;
+	mMapHeight = header.height;
+	mTileWidth = header.tileWidth;
+	mTileHeight = header.tileHeight;
+
+	//Get page dimensions
+	mMemoryCap = memoryCap;
+	mPageWidth = PAGE_TILES_X * mTileWidth;
+	mPageHeight = PAGE_TILES_Y * mTileHeight;
+	mWidth = ( mMapWidth + PAGE_TILES_X - 1 ) / PAGE_TILES_X;
+	mHeight = ( mMapHeight + PAGE_TILES_Y - 1 ) / PAGE_TILES_Y;
+
+	//A page costs its tiles plus its chunk texture, the mapped file is only faulted in where pages are copied and the OS can drop it again
+	mPageBytes = PAGE_TILES_X * PAGE_TILES_Y + (size_t)mPageWidth * mPageHeight * 4;
+
+	//Allocate pages
+	mPages = new TilePage[ mWidth * mHeight ];
+	for( int y = 0; y < mHeight; ++y )
+	{
+		for( int x = 0; x < mWidth; ++x )
+		{
+			TilePage& page = mPages[ y * mWidth + x ];
+			page.state = PAGE_EMPTY;
+			page.tiles = NULL;
+			page.resident = false;
+			page.modified = false;
+			page.lastUsed = 0;
+
+			//Clamp the last row and column to the level
+			int w = getLevelWidth() - x * mPageWidth;
+			int h = getLevelHeight() - y * mPageHeight;
+			page.chunk.setBox( x * mPageWidth, y * mPageHeight, w < mPageWidth ? w : mPageWidth, h < mPageHeight ? h : mPageHeight );
+		}
+	}
+
+	//Start the loader thread
+	mQuit = false;
+	mLock = SDL_CreateMutex();
+	mCanLoad = SDL_CreateCond();
+	mThread = SDL_CreateThread( loadPages, "PageLoader", this );
+	if( mLock == NULL || mCanLoad == NULL || mThread == NULL )
+	{
+		printf( "Unable to start page loader! SDL Error: %s\n", SDL_GetError() );
+		free();
+		return false;
+	}
+
+	return true;
+}
+
+void TileWorld::free()
+{
+	//Stop the loader thread
+	if( mThread != NULL )
+	{
+		SDL_LockMutex( mLock );
+		mQuit = true;
+		SDL_UnlockMutex( mLock );
+		SDL_CondSignal( mCanLoad );
+		SDL_WaitThread( mThread, NULL );
+		mThread = NULL;
+	}
+	if( mLock != NULL )
+	{
+		SDL_DestroyMutex( mLock );
+		mLock = NULL;
+	}
+	if( mCanLoad != NULL )
+	{
+		SDL_DestroyCond( mCanLoad );
+		mCanLoad = NULL;
+	}
+
+	//Free pages if they exist
+	if( mPages != NULL )
+	{
+		for( int i = 0; i < mWidth * mHeight; ++i )
+		{
+			delete mPages[ i ].tiles;
+		}
+		delete[] mPages;
+		mPages = NULL;
+	}
+
+	//Unmap the map
+	mMapFile.free();
+
+	mResident.clear();
+	mLoaded.clear();
+	mQueue.clear();
+	mMapWidth = 0;
+	mMapHeight = 0;
+	mTileWidth = 0;
+	mTileHeight = 0;
+	mWidth = 0;
+	mHeight = 0;
+	mPageWidth = 0;
+	mPageHeight = 0;
+	mPageBytes = 0;
+}
+
+int TileWorld::getLevelWidth()
+{
+	return mMapWidth * mTileWidth;
+}
+
+int TileWorld::getLevelHeight()
+{
+	return mMapHeight * mTileHeight;
+}
+
+int TileWorld::getTileWidth()
+{
+	return mTileWidth;
+}
+
+int TileWorld::getTileHeight()
+{
+	return mTileHeight;
+}
+
+int TileWorld::getType( int x, int y )
+{
+	//If the page isn't loaded yet
+	TilePage& page = mPages[ ( y / PAGE_TILES_Y ) * mWidth + x / PAGE_TILES_X ];
+	if( !page.resident )
+	{
+		return -1;
+	}
+
+	return page.tiles->getType( x % PAGE_TILES_X, y % PAGE_TILES_Y );
+}
+
+bool TileWorld::setType( int x, int y, int tileType )
+{
+	//If the page isn't loaded yet
+	TilePage& page = mPages[ ( y / PAGE_TILES_Y ) * mWidth + x / PAGE_TILES_X ];
+	if( !page.resident )
+	{
+		return false;
+	}
+
+	//If something changed
+	if( page.tiles->getType( x % PAGE_TILES_X, y % PAGE_TILES_Y ) != tileType )
+	{
+		page.tiles->setType( x % PAGE_TILES_X, y % PAGE_TILES_Y, tileType );
+
+		//Rebake the page and keep it loaded so the change isn't lost
+		page.chunk.invalidate();
+		page.modified = true;
+	}
+
+	return true;
+}
+
+bool TileWorld::getRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY )
+{
+	//If the rect is empty or outside the level
+	if( ( rect.w <= 0 ) || ( rect.h <= 0 ) ||
+		( rect.x + rect.w <= 0 ) || ( rect.y + rect.h <= 0 ) ||
+		( rect.x >= getLevelWidth() ) || ( rect.y >= getLevelHeight() ) )
+	{
+		return false;
+	}
+
+	//Get the cells under the rect's edges
+	firstX = rect.x < 0 ? 0 : rect.x / mTileWidth;
+	firstY = rect.y < 0 ? 0 : rect.y / mTileHeight;
+	lastX = ( rect.x + rect.w - 1 ) / mTileWidth;
+	lastY = ( rect.y + rect.h - 1 ) / mTileHeight;
+
+	//Keep the range in the map
+	if( lastX >= mMapWidth )
+	{
+		lastX = mMapWidth - 1;
+	}
+	if( lastY >= mMapHeight )
+	{
+		lastY = mMapHeight - 1;
+	}
+
+	return true;
+}
+
+bool TileWorld::getPageRange( SDL_Rect rect, int& firstX, int& firstY, int& lastX, int& lastY )
+{
+	//Get the cells under the rect
+	if( !getRange( rect, firstX, firstY, lastX, lastY ) )
+	{
+		return false;
+	}
+
+	//Convert to pages
+	firstX /= PAGE_TILES_X;
+	firstY /= PAGE_TILES_Y;
+	lastX /= PAGE_TILES_X;
+	lastY /= PAGE_TILES_Y;
+
+	return true;
+}
+
+void TileWorld::update( SDL_Rect& camera )
+{
+	++mFrame;
+
+	//Get the pages the camera is near
+	SDL_Rect area = { camera.x - PAGE_PREFETCH * mPageWidth, camera.y - PAGE_PREFETCH * mPageHeight, camera.w + 2 * PAGE_PREFETCH * mPageWidth, camera.h + 2 * PAGE_PREFETCH * mPageHeight };
+	int firstX, firstY, lastX, lastY;
+	bool nearCamera = getPageRange( area, firstX, firstY, lastX, lastY );
+
+	SDL_LockMutex( mLock );
+
+	//Take over pages the loader finished
+	for( int i = 0; i < (int)mLoaded.size(); ++i )
+	{
+		mPages[ mLoaded[ i ] ].resident = true;
+		mResident.push_back( mLoaded[ i ] );
+	}
+	mLoaded.clear();
+
+	//Drop requests from earlier frames
+	for( int i = 0; i < (int)mQueue.size(); ++i )
+	{
+		mPages[ mQueue[ i ] ].state = PAGE_EMPTY;
+	}
+	mQueue.clear();
+
+	//Request missing pages, visible ones first
+	int visibleFirstX = 0, visibleFirstY = 0, visibleLastX = -1, visibleLastY = -1;
+	getPageRange( camera, visibleFirstX, visibleFirstY, visibleLastX, visibleLastY );
+	for( int y = firstY; nearCamera && y <= lastY; ++y )
+	{
+		for( int x = firstX; x <= lastX; ++x )
+		{
+			int index = y * mWidth + x;
+			mPages[ index ].lastUsed = mFrame;
+			if( mPages[ index ].state == PAGE_EMPTY )
+			{
+				mPages[ index ].state = PAGE_QUEUED;
+				if( x >= visibleFirstX && x <= visibleLastX && y >= visibleFirstY && y <= visibleLastY )
+				{
+					mQueue.push_front( index );
+				}
+				else
+				{
+					mQueue.push_back( index );
+				}
+			}
+		}
+	}
+
+	//Evict least recently used pages while over the cap
+	while( mResident.size() * mPageBytes > mMemoryCap )
+	{
+		//Find the oldest page that isn't near the camera or edited
+		int oldest = -1;
+		for( int i = 0; i < (int)mResident.size(); ++i )
+		{
+			TilePage& page = mPages[ mResident[ i ] ];
+			if( page.lastUsed != mFrame && !page.modified && ( oldest == -1 || page.lastUsed < mPages[ mResident[ oldest ] ].lastUsed ) )
+			{
+				oldest = i;
+			}
+		}
+
+		//Everything left is in use
+		if( oldest == -1 )
+		{
+			break;
+		}
+
+		evict( mResident[ oldest ] );
+		mResident[ oldest ] = mResident.back();
+		mResident.pop_back();
+	}
+
+	bool queued = !mQueue.empty();
+	SDL_UnlockMutex( mLock );
+
+	//Wake the loader
+	if( queued )
+	{
+		SDL_CondSignal( mCanLoad );
+	}
+}
+
+void TileWorld::evict( int index )
+{
+	//Free the tiles and the baked chunk
+	TilePage& page = mPages[ index ];
+	delete page.tiles;
+	page.tiles = NULL;
+	page.chunk.free();
+	page.resident = false;
+	page.state = PAGE_EMPTY;
+}
+
+void TileWorld::invalidateAll()
+{
+	for( int i = 0; i < (int)mResident.size(); ++i )
+	{
+		mPages[ mResident[ i ] ].chunk.invalidate();
+	}
+}
+
+void TileWorld::freeChunks()
+{
+	for( int i = 0; i < (int)mResident.size(); ++i )
+	{
+		mPages[ mResident[ i ] ].chunk.free();
+	}
+}
+
+void TileWorld::render( SDL_Rect& camera )
+{
+	//Get the pages on screen
+	int firstX, firstY, lastX, lastY;
+	if( !getPageRange( camera, firstX, firstY, lastX, lastY ) )
+	{
+		return;
+	}
+
+	//Show the pages
+	for( int y = firstY; y <= lastY; ++y )
+	{
+		for( int x = firstX; x <= lastX; ++x )
+		{
+			TilePage& page = mPages[ y * mWidth + x ];
+			if( page.resident && page.chunk.bake( *page.tiles ) )
+			{
+				page.chunk.render( camera );
+			}
+			//Show a placeholder until the page is loaded
+			else
+			{
+				SDL_Rect box = page.chunk.getBox();
+				SDL_Rect fillRect = { box.x - camera.x, box.y - camera.y, box.w, box.h };
+				SDL_SetRenderDrawColor( gRenderer, 0x80, 0x80, 0x80, 0xFF );
+				SDL_RenderFillRect( gRenderer, &fillRect );
+			}
+		}
+	}
+}
+
+TileGrid* TileWorld::readPage( int index )
+{
+	//Get the page's first cell
+	int firstX = ( index % mWidth ) * PAGE_TILES_X;
+	int firstY = ( index / mWidth ) * PAGE_TILES_Y;
+
+	//Clamp the last row and column to the map
+	int width = SDL_min( PAGE_TILES_X, mMapWidth - firstX );
+	int height = SDL_min( PAGE_TILES_Y, mMapHeight - firstY );
+
+	//Copy the page a row at a time straight from the mapping, this is the only place the map's tiles are faulted in from disk
+	TileGrid* tiles = new TileGrid();
+	tiles->create( PAGE_TILES_X, PAGE_TILES_Y, mTileWidth, mTileHeight );
+	for( int y = 0; y < height; ++y )
+	{
+		const Uint8* row = mMapFile.getData() + sizeof( MapHeader ) + (size_t)( firstY + y ) * mMapWidth + firstX;
+
+		//Make sure every tile has a sprite
+		for( int x = 0; x < width; ++x )
+		{
+			if( row[ x ] >= TOTAL_TILE_SPRITES )
+			{
+				printf( "Error loading page %d: Invalid tile type at %d, %d!\n", index, firstX + x, firstY + y );
+				delete tiles;
+				return NULL;
+			}
+			tiles->setType( x, y, row[ x ] );
+		}
+	}
+
+	return tiles;
+}
+
+int TileWorld::loadPages( void* data )
+{
+	TileWorld* world = (TileWorld*)data;
+
+	SDL_LockMutex( world->mLock );
+	while( !world->mQuit )
+	{
+		//Wait for requests
+		if( world->mQueue.empty() )
+		{
+			SDL_CondWait( world->mCanLoad, world->mLock );
+			continue;
+		}
+
+		//Take the most urgent request
+		int index = world->mQueue.front();
+		world->mQueue.pop_front();
+		world->mPages[ index ].state = PAGE_LOADING;
+
+		//Load without holding the lock
+		SDL_UnlockMutex( world->mLock );
+		TileGrid* tiles = world->readPage( index );
+		SDL_LockMutex( world->mLock );
+
+		//Hand the page over to the main thread
+		if( tiles != NULL )
+		{
+			world->mPages[ index ].tiles = tiles;
+			world->mPages[ index ].state = PAGE_READY;
+			world->mLoaded.push_back( index );
+		}
+		//Leave a broken page unloaded so it stays a wall and isn't asked for again
+		else
+		{
+			world->mPages[ index ].state = PAGE_FAILED;
+		}
+	}
+	SDL_UnlockMutex( world->mLock );
+
+	return 0;
+}
+
+Dot::Dot()
+{
+    //Initialize the collision box
+    mBox.x = 0;
+    mBox.y = 0;
+	mBox.w = DOT_WIDTH;
+	mBox.h = DOT_HEIGHT;
+
+    //Initialize the velocity
+    mVelX = 0;
+    mVelY = 0;
+}
+
+void Dot::handleEvent( SDL_Event& e )
+{
+    //If a key was pressed
+	if( e.type == SDL_KEYDOWN && e.key.repeat == 0 )
+    {
+        //Adjust the velocity
+        switch( e.key.keysym.sym )
+        {
+            case SDLK_UP: mVelY -= DOT_VEL; break;
+            case SDLK_DOWN: mVelY += DOT_VEL; break;
+            case SDLK_LEFT: mVelX -= DOT_VEL; break;
+            case SDLK_RIGHT: mVelX += DOT_VEL; break;
+        }
+    }
+    //If a key was released
+    else if( e.type == SDL_KEYUP && e.key.repeat == 0 )
+    {
+        //Adjust the velocity
+        switch( e.key.keysym.sym )
+        {
+            case SDLK_UP: mVelY += DOT_VEL; break;
+            case SDLK_DOWN: mVelY -= DOT_VEL; break;
+            case SDLK_LEFT: mVelX += DOT_VEL; break;
+            case SDLK_RIGHT: mVelX -= DOT_VEL; break;
+        }
+    }
+}
+
+void Dot::move( TileWorld& world )
+{
+    //Move the dot against the level
+    moveBox( mBox, mVelX, mVelY, world );
+}
+
+void Dot::setCamera( SDL_Rect& camera, TileWorld& world )
+{
+	//Center the camera over the dot
+	camera.x = ( mBox.x + DOT_WIDTH / 2 ) - SCREEN_WIDTH / 2;
+	camera.y = ( mBox.y + DOT_HEIGHT / 2 ) - SCREEN_HEIGHT / 2;
+
+	//Keep the camera in bounds
+	if( camera.x < 0 )
+	{ 
+		camera.x = 0;
+	}
+	if( camera.y < 0 )
 	{
-		camera.x = LEVEL_WIDTH - camera.w;
+		camera.y = 0;
+	}
+	if( camera.x > world.getLevelWidth() - camera.w )
+	{
+		camera.x = world.getLevelWidth() - camera.w;
 	}
-	if( camera.y > LEVEL_HEIGHT - camera.h )
+	if( camera.y > world.getLevelHeight() - camera.h )
 	{
-		camera.y = LEVEL_HEIGHT - camera.h;
+		camera.y = world.getLevelHeight() - camera.h;
 	}
 }
 
+SDL_Rect Dot::getBox()
+{
+	return mBox;
+}
+
 void Dot::render( SDL_Rect& camera )
 {
     //Show the dot
@@ -500,7 +1893,28 @@ bool init()
 	return success;
 }
 
-bool loadMedia( Tile* tiles[] )
+bool loadMedia()
+{
+	//Loading success flag
+	bool success = true;
+
+	//Load textures
+	if( !loadTextures() )
+	{
+		success = false;
+	}
+
+	//Load tile map
+	if( !setTiles() )
+	{
+		printf( "Failed to load tile set!\n" );
+		success = false;
+	}
+
+	return success;
+}
+
+bool loadTextures()
 {
 	//Loading success flag
 	bool success = true;
@@ -519,27 +1933,13 @@ bool loadMedia( Tile* tiles[] )
 		success = false;
 	}
 
-	//Load tile map
-	if( !setTiles( tiles ) )
-	{
-		printf( "Failed to load tile set!\n" );
-		success = false;
-	}
-
 	return success;
 }
 
-void close( Tile* tiles[] )
+void close()
 {
-	//Deallocate tiles
-	for( int i = 0; i < TOTAL_TILES; ++i )
-	{
-		 if( tiles[ i ] != NULL )
-		 {
-			delete tiles[ i ];
-			tiles[ i ] = NULL;
-		 }
-	}
+	//Stop streaming and free pages
+	gWorld.free();
 
 	//Free loaded images
 	gDotTexture.free();
@@ -601,153 +2001,371 @@ bool checkCollision( SDL_Rect a, SDL_Rect b )
     return true;
 }
 
-bool setTiles( Tile* tiles[] )
+bool sweepCollision( SDL_Rect a, int velX, int velY, SDL_Rect b, Contact& contact )
 {
-	//Success flag
-	bool tilesLoaded = true;
+    //The velocity and sides of both boxes by axis
+    int velocity[ 2 ] = { velX, velY };
+    int startA[ 2 ] = { a.x, a.y };
+    int endA[ 2 ] = { a.x + a.w, a.y + a.h };
+    int startB[ 2 ] = { b.x, b.y };
+    int endB[ 2 ] = { b.x + b.w, b.y + b.h };
+
+    //When the boxes start and stop overlapping on each axis
+    float enter[ 2 ], leave[ 2 ];
+    for( int axis = 0; axis < 2; ++axis )
+    {
+        if( velocity[ axis ] > 0 )
+        {
+            enter[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+        }
+        else if( velocity[ axis ] < 0 )
+        {
+            enter[ axis ] = (float)( endB[ axis ] - startA[ axis ] ) / velocity[ axis ];
+            leave[ axis ] = (float)( startB[ axis ] - endA[ axis ] ) / velocity[ axis ];
+        }
+        //Not moving on this axis, so it has to overlap the whole time
+        else if( startA[ axis ] < endB[ axis ] && endA[ axis ] > startB[ axis ] )
+        {
+            enter[ axis ] = -INFINITY;
+            leave[ axis ] = INFINITY;
+        }
+        else
+        {
+            return false;
+        }
+    }
 
-    //The tile offsets
-    int x = 0, y = 0;
+    //The boxes overlap once they overlap on both axes
+    float enterBoth = SDL_max( enter[ 0 ], enter[ 1 ] );
+    float leaveBoth = SDL_min( leave[ 0 ], leave[ 1 ] );
 
-    //Open the map
-    std::ifstream map( "lazy.map" );
+    //If they never overlap, only touch, already overlap, or don't reach each other this move
+    if( enterBoth >= leaveBoth || enterBoth < 0.f || enterBoth >= 1.f )
+    {
+        return false;
+    }
 
-    //If the map couldn't be loaded
-    if( map.fail() )
+    //The axis that started overlapping last is the one that was hit
+    contact.time = enterBoth;
+    contact.normalX = 0.f;
+    contact.normalY = 0.f;
+    if( enter[ 0 ] > enter[ 1 ] )
     {
-		printf( "Unable to load map file!\n" );
-		tilesLoaded = false;
+        contact.normalX = velX > 0 ? -1.f : 1.f;
     }
-	else
+    else
+    {
+        contact.normalY = velY > 0 ? -1.f : 1.f;
+    }
+
+    return true;
+}
+
+bool setTiles()
+{
+	//Success flag
+	bool tilesLoaded = true;
+
+	//Stream the binary level
+	if( !gWorld.open( "lazy.lmap", WORLD_MEMORY_CAP ) )
 	{
-		//Initialize the tiles
-		for( int i = 0; i < TOTAL_TILES; ++i )
+		//Rebuild it from the text level so it can still be streamed
+		printf( "Falling back to text map!\n" );
+		if( !convertMap( "lazy.map", "lazy.lmap" ) || !gWorld.open( "lazy.lmap", WORLD_MEMORY_CAP ) )
 		{
-			//Determines what kind of tile will be made
-			int tileType = -1;
+			printf( "Unable to load map file!\n" );
+			tilesLoaded = false;
+		}
+	}
+
+	//The clips below cut the sprite sheet into TILE_WIDTH by TILE_HEIGHT tiles
+	if( tilesLoaded && ( gWorld.getTileWidth() != TILE_WIDTH || gWorld.getTileHeight() != TILE_HEIGHT ) )
+	{
+		printf( "Error loading map: Tiles are %dx%d but the sprite sheet's are %dx%d!\n", gWorld.getTileWidth(), gWorld.getTileHeight(), TILE_WIDTH, TILE_HEIGHT );
+		gWorld.free();
+		tilesLoaded = false;
+	}
+
+	//Clip the sprite sheet
+	if( tilesLoaded )
+	{
+		gTileClips[ TILE_RED ].x = 0;
+		gTileClips[ TILE_RED ].y = 0;
+		gTileClips[ TILE_RED ].w = TILE_WIDTH;
+		gTileClips[ TILE_RED ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_GREEN ].x = 0;
+		gTileClips[ TILE_GREEN ].y = 80;
+		gTileClips[ TILE_GREEN ].w = TILE_WIDTH;
+		gTileClips[ TILE_GREEN ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_BLUE ].x = 0;
+		gTileClips[ TILE_BLUE ].y = 160;
+		gTileClips[ TILE_BLUE ].w = TILE_WIDTH;
+		gTileClips[ TILE_BLUE ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_TOPLEFT ].x = 80;
+		gTileClips[ TILE_TOPLEFT ].y = 0;
+		gTileClips[ TILE_TOPLEFT ].w = TILE_WIDTH;
+		gTileClips[ TILE_TOPLEFT ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_LEFT ].x = 80;
+		gTileClips[ TILE_LEFT ].y = 80;
+		gTileClips[ TILE_LEFT ].w = TILE_WIDTH;
+		gTileClips[ TILE_LEFT ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_BOTTOMLEFT ].x = 80;
+		gTileClips[ TILE_BOTTOMLEFT ].y = 160;
+		gTileClips[ TILE_BOTTOMLEFT ].w = TILE_WIDTH;
+		gTileClips[ TILE_BOTTOMLEFT ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_TOP ].x = 160;
+		gTileClips[ TILE_TOP ].y = 0;
+		gTileClips[ TILE_TOP ].w = TILE_WIDTH;
+		gTileClips[ TILE_TOP ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_CENTER ].x = 160;
+		gTileClips[ TILE_CENTER ].y = 80;
+		gTileClips[ TILE_CENTER ].w = TILE_WIDTH;
+		gTileClips[ TILE_CENTER ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_BOTTOM ].x = 160;
+		gTileClips[ TILE_BOTTOM ].y = 160;
+		gTileClips[ TILE_BOTTOM ].w = TILE_WIDTH;
+		gTileClips[ TILE_BOTTOM ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_TOPRIGHT ].x = 240;
+		gTileClips[ TILE_TOPRIGHT ].y = 0;
+		gTileClips[ TILE_TOPRIGHT ].w = TILE_WIDTH;
+		gTileClips[ TILE_TOPRIGHT ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_RIGHT ].x = 240;
+		gTileClips[ TILE_RIGHT ].y = 80;
+		gTileClips[ TILE_RIGHT ].w = TILE_WIDTH;
+		gTileClips[ TILE_RIGHT ].h = TILE_HEIGHT;
+
+		gTileClips[ TILE_BOTTOMRIGHT ].x = 240;
+		gTileClips[ TILE_BOTTOMRIGHT ].y = 160;
+		gTileClips[ TILE_BOTTOMRIGHT ].w = TILE_WIDTH;
+		gTileClips[ TILE_BOTTOMRIGHT ].h = TILE_HEIGHT;
+	}
+
+    //If the map was loaded fine
+    return tilesLoaded;
+}
+
+bool loadTextMap( std::string path, std::vector<Uint8>& tiles, int& width, int& height )
+{
+	//Success flag
+	bool success = true;
+
+	//Reset output
+	tiles.clear();
+	width = 0;
+	height = 0;
 
-			//Read tile from map file
-			map >> tileType;
+	//Open the map
+	FILE* file = fopen( path.c_str(), "rb" );
+	if( file == NULL )
+	{
+		printf( "Unable to open %s!\n", path.c_str() );
+		return false;
+	}
 
-			//If the was a problem in reading the map
-			if( map.fail() )
+	//Read the whole file at once
+	fseek( file, 0, SEEK_END );
+	long size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	std::vector<char> text( size + 1 );
+	size = fread( &text[ 0 ], 1, size, file );
+	text[ size ] = '\0';
+	fclose( file );
+
+	//Scan the numbers row by row
+	int rowLength = 0;
+	const char* c = &text[ 0 ];
+	while( success )
+	{
+		//Tile number
+		if( *c >= '0' && *c <= '9' )
+		{
+			int tileType = 0;
+			while( *c >= '0' && *c <= '9' && tileType < TOTAL_TILE_SPRITES )
 			{
-				//Stop loading map
-				printf( "Error loading map: Unexpected end of file!\n" );
-				tilesLoaded = false;
-				break;
+				tileType = tileType * 10 + ( *c - '0' );
+				++c;
 			}
 
-			//If the number is a valid tile number
-			if( ( tileType >= 0 ) && ( tileType < TOTAL_TILE_SPRITES ) )
+			//If we don't recognize the tile type
+			if( tileType >= TOTAL_TILE_SPRITES )
 			{
-				tiles[ i ] = new Tile( x, y, tileType );
+				printf( "Error loading map: Invalid tile type at %d!\n", (int)tiles.size() );
+				success = false;
 			}
-			//If we don't recognize the tile type
 			else
 			{
-				//Stop loading map
-				printf( "Error loading map: Invalid tile type at %d!\n", i );
-				tilesLoaded = false;
-				break;
+				tiles.push_back( tileType );
+				++rowLength;
 			}
+		}
+		//End of row
+		else if( *c == '\n' || *c == '\0' )
+		{
+			if( rowLength > 0 )
+			{
+				//The first row sets the width
+				if( width == 0 )
+				{
+					width = rowLength;
+				}
+
+				//Every row must match it
+				if( rowLength != width )
+				{
+					printf( "Error loading map: Row %d has %d tiles instead of %d!\n", height, rowLength, width );
+					success = false;
+				}
 
-			//Move to next tile spot
-			x += TILE_WIDTH;
+				++height;
+				rowLength = 0;
+			}
 
-			//If we've gone too far
-			if( x >= LEVEL_WIDTH )
+			//Done scanning
+			if( *c == '\0' )
 			{
-				//Move back
-				x = 0;
-
-				//Move to the next row
-				y += TILE_HEIGHT;
+				break;
 			}
+			++c;
 		}
-		
-		//Clip the sprite sheet
-		if( tilesLoaded )
-		{
-			gTileClips[ TILE_RED ].x = 0;
-			gTileClips[ TILE_RED ].y = 0;
-			gTileClips[ TILE_RED ].w = TILE_WIDTH;
-			gTileClips[ TILE_RED ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_GREEN ].x = 0;
-			gTileClips[ TILE_GREEN ].y = 80;
-			gTileClips[ TILE_GREEN ].w = TILE_WIDTH;
-			gTileClips[ TILE_GREEN ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_BLUE ].x = 0;
-			gTileClips[ TILE_BLUE ].y = 160;
-			gTileClips[ TILE_BLUE ].w = TILE_WIDTH;
-			gTileClips[ TILE_BLUE ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_TOPLEFT ].x = 80;
-			gTileClips[ TILE_TOPLEFT ].y = 0;
-			gTileClips[ TILE_TOPLEFT ].w = TILE_WIDTH;
-			gTileClips[ TILE_TOPLEFT ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_LEFT ].x = 80;
-			gTileClips[ TILE_LEFT ].y = 80;
-			gTileClips[ TILE_LEFT ].w = TILE_WIDTH;
-			gTileClips[ TILE_LEFT ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_BOTTOMLEFT ].x = 80;
-			gTileClips[ TILE_BOTTOMLEFT ].y = 160;
-			gTileClips[ TILE_BOTTOMLEFT ].w = TILE_WIDTH;
-			gTileClips[ TILE_BOTTOMLEFT ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_TOP ].x = 160;
-			gTileClips[ TILE_TOP ].y = 0;
-			gTileClips[ TILE_TOP ].w = TILE_WIDTH;
-			gTileClips[ TILE_TOP ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_CENTER ].x = 160;
-			gTileClips[ TILE_CENTER ].y = 80;
-			gTileClips[ TILE_CENTER ].w = TILE_WIDTH;
-			gTileClips[ TILE_CENTER ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_BOTTOM ].x = 160;
-			gTileClips[ TILE_BOTTOM ].y = 160;
-			gTileClips[ TILE_BOTTOM ].w = TILE_WIDTH;
-			gTileClips[ TILE_BOTTOM ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_TOPRIGHT ].x = 240;
-			gTileClips[ TILE_TOPRIGHT ].y = 0;
-			gTileClips[ TILE_TOPRIGHT ].w = TILE_WIDTH;
-			gTileClips[ TILE_TOPRIGHT ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_RIGHT ].x = 240;
-			gTileClips[ TILE_RIGHT ].y = 80;
-			gTileClips[ TILE_RIGHT ].w = TILE_WIDTH;
-			gTileClips[ TILE_RIGHT ].h = TILE_HEIGHT;
-
-			gTileClips[ TILE_BOTTOMRIGHT ].x = 240;
-			gTileClips[ TILE_BOTTOMRIGHT ].y = 160;
-			gTileClips[ TILE_BOTTOMRIGHT ].w = TILE_WIDTH;
-			gTileClips[ TILE_BOTTOMRIGHT ].h = TILE_HEIGHT;
-		}
-	}
-
-    //Close the file
-    map.close();
+		//Separator
+		else if( *c == ' ' || *c == '\t' || *c == '\r' )
+		{
+			++c;
+		}
+		//Anything else
+		else
+		{
+			printf( "Error loading map: Invalid tile type at %d!\n", (int)tiles.size() );
+			success = false;
+		}
+	}
 
-    //If the map was loaded fine
-    return tilesLoaded;
+	//If there was nothing to load
+	if( success && tiles.empty() )
+	{
+		printf( "Error loading map: No tiles!\n" );
+		success = false;
+	}
+
+	return success;
+}
+
+bool convertMap( std::string textPath, std::string binaryPath )
+{
+	//Read the text map
+	std::vector<Uint8> tiles;
+	int width = 0, height = 0;
+	if( !loadTextMap( textPath, tiles, width, height ) )
+	{
+		printf( "Failed to read %s!\n", textPath.c_str() );
+		return false;
+	}
+
+	//Fill in the header
+	MapHeader header;
+	memcpy( header.magic, "LMAP", 4 );
+	header.version = SDL_SwapLE32( MAP_VERSION );
+	header.width = SDL_SwapLE32( width );
+	header.height = SDL_SwapLE32( height );
+	header.tileWidth = SDL_SwapLE32( TILE_WIDTH );
+	header.tileHeight = SDL_SwapLE32( TILE_HEIGHT );
+	header.layerCount = SDL_SwapLE32( 1 );
+	header.reserved = 0;
+
+	//Open the output
+	FILE* file = fopen( binaryPath.c_str(), "wb" );
+	if( file == NULL )
+	{
+		printf( "Unable to open %s for writing!\n", binaryPath.c_str() );
+		return false;
+	}
+
+	//Write header and tiles
+	bool success = ( fwrite( &header, sizeof( MapHeader ), 1, file ) == 1 ) && ( fwrite( &tiles[ 0 ], 1, tiles.size(), file ) == tiles.size() );
+	if( fclose( file ) != 0 || !success )
+	{
+		printf( "Failed writing %s!\n", binaryPath.c_str() );
+		return false;
+	}
+
+	printf( "Wrote %dx%d map to %s\n", width, height, binaryPath.c_str() );
+	return true;
+}
+
+bool gatherWalls( SDL_Rect rect, TileWorld& world, WallGrid& walls )
+{
+    //Get the tiles under the rect
+    int lastX, lastY;
+    walls.tileWidth = world.getTileWidth();
+    walls.tileHeight = world.getTileHeight();
+    if( !world.getRange( rect, walls.firstX, walls.firstY, lastX, lastY ) )
+    {
+        walls.width = 0;
+        walls.height = 0;
+        walls.walls.clear();
+        return false;
+    }
+    walls.width = lastX - walls.firstX + 1;
+    walls.height = lastY - walls.firstY + 1;
+
+    //Look each tile's page up once
+    walls.walls.resize( walls.width * walls.height );
+    for( int y = 0; y < walls.height; ++y )
+    {
+        for( int x = 0; x < walls.width; ++x )
+        {
+            //If the tile is a wall type tile or isn't loaded
+            int tileType = world.getType( walls.firstX + x, walls.firstY + y );
+            walls.walls[ y * walls.width + x ] = ( tileType == -1 ) || ( ( tileType >= TILE_CENTER ) && ( tileType <= TILE_TOPLEFT ) );
+        }
+    }
+
+    return true;
+}
+
+bool getWallRange( SDL_Rect rect, WallGrid& walls, int& firstX, int& firstY, int& lastX, int& lastY )
+{
+    //If the rect is empty or nothing was gathered
+    if( rect.w <= 0 || rect.h <= 0 || walls.width == 0 || walls.height == 0 )
+    {
+        return false;
+    }
+
+    //Get the cells under the rect's edges, kept in the gathered block
+    firstX = SDL_max( rect.x < 0 ? 0 : rect.x / walls.tileWidth, walls.firstX );
+    firstY = SDL_max( rect.y < 0 ? 0 : rect.y / walls.tileHeight, walls.firstY );
+    lastX = SDL_min( ( rect.x + rect.w - 1 ) / walls.tileWidth, walls.firstX + walls.width - 1 );
+    lastY = SDL_min( ( rect.y + rect.h - 1 ) / walls.tileHeight, walls.firstY + walls.height - 1 );
+
+    return firstX <= lastX && firstY <= lastY;
 }
 
-bool touchesWall( SDL_Rect box, Tile* tiles[] )
+bool touchesWall( SDL_Rect box, WallGrid& walls )
 {
-    //Go through the tiles
-    for( int i = 0; i < TOTAL_TILES; ++i )
+    //Get the tiles under the box
+    int firstX, firstY, lastX, lastY;
+    if( !getWallRange( box, walls, firstX, firstY, lastX, lastY ) )
+    {
+        return false;
+    }
+
+    //Every covered tile overlaps the box, so only the flag needs checking
+    for( int y = firstY; y <= lastY; ++y )
     {
-        //If the tile is a wall type tile
-        if( ( tiles[ i ]->getType() >= TILE_CENTER ) && ( tiles[ i ]->getType() <= TILE_TOPLEFT ) )
+        for( int x = firstX; x <= lastX; ++x )
         {
-            //If the collision box touches the wall tile
-            if( checkCollision( box, tiles[ i ]->getBox() ) )
+            if( walls.walls[ ( y - walls.firstY ) * walls.width + x - walls.firstX ] )
             {
                 return true;
             }
@@ -758,8 +2376,165 @@ bool touchesWall( SDL_Rect box, Tile* tiles[] )
     return false;
 }
 
+bool touchesUnloaded( SDL_Rect box, TileWorld& world )
+{
+    //Get the tiles under the box
+    int firstX, firstY, lastX, lastY;
+    if( !world.getRange( box, firstX, firstY, lastX, lastY ) )
+    {
+        return false;
+    }
+
+    for( int y = firstY; y <= lastY; ++y )
+    {
+        for( int x = firstX; x <= lastX; ++x )
+        {
+            if( world.getType( x, y ) == -1 )
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool sweepWalls( SDL_Rect box, int velX, int velY, WallGrid& walls, Contact& contact )
+{
+    //Get the tiles the whole move passes over
+    SDL_Rect swept = { SDL_min( box.x, box.x + velX ), SDL_min( box.y, box.y + velY ), box.w + abs( velX ), box.h + abs( velY ) };
+    int firstX, firstY, lastX, lastY;
+    if( !getWallRange( swept, walls, firstX, firstY, lastX, lastY ) )
+    {
+        return false;
+    }
+
+    //Keep the first wall the box touches
+    bool hit = false;
+    for( int y = firstY; y <= lastY; ++y )
+    {
+        for( int x = firstX; x <= lastX; ++x )
+        {
+            if( walls.walls[ ( y - walls.firstY ) * walls.width + x - walls.firstX ] )
+            {
+                SDL_Rect tile = { x * walls.tileWidth, y * walls.tileHeight, walls.tileWidth, walls.tileHeight };
+                Contact tileContact;
+                if( sweepCollision( box, velX, velY, tile, tileContact ) && ( !hit || tileContact.time < contact.time ) )
+                {
+                    contact = tileContact;
+                    hit = true;
+                }
+            }
+        }
+    }
+
+    return hit;
+}
+
+void moveBox( SDL_Rect& box, int velX, int velY, TileWorld& world )
+{
+    //Look up the walls around the whole move
+    SDL_Rect swept = { SDL_min( box.x, box.x + velX ), SDL_min( box.y, box.y + velY ), box.w + abs( velX ), box.h + abs( velY ) };
+    WallGrid walls;
+    gatherWalls( swept, world, walls );
+
+    moveBox( box, velX, velY, world, walls );
+}
+
+void moveBox( SDL_Rect& box, int velX, int velY, TileWorld& world, WallGrid& walls )
+{
+    //Wait while the box is over tiles that aren't loaded yet
+    if( touchesWall( box, walls ) )
+    {
+        return;
+    }
+
+    //Keep the move inside the level, this only shrinks it so it stays in the gathered walls
+    velX = SDL_max( -box.x, SDL_min( velX, world.getLevelWidth() - box.w - box.x ) );
+    velY = SDL_max( -box.y, SDL_min( velY, world.getLevelHeight() - box.h - box.y ) );
+
+    //Move until a wall is touched, then slide along it with the rest of the move
+    for( int pass = 0; pass < 2 && ( velX != 0 || velY != 0 ); ++pass )
+    {
+        //Find when the box touches the first wall, if it does
+        Contact contact = { 1.f, 0.f, 0.f };
+        sweepWalls( box, velX, velY, walls, contact );
+
+        //Move up to it, rounding can't push the box in since every side is on a whole pixel
+        int moveX = (int)std::lround( velX * contact.time );
+        int moveY = (int)std::lround( velY * contact.time );
+        box.x += moveX;
+        box.y += moveY;
+
+        //Drop the part of what's left going into the wall
+        velX = contact.normalX != 0.f ? 0 : velX - moveX;
+        velY = contact.normalY != 0.f ? 0 : velY - moveY;
+    }
+}
+
+void moveBoxes( SDL_Rect boxes[], SDL_Point velocities[], int count, TileWorld& world )
+{
+    //Get the area all the moving bodies pass over, resting bodies can't have moved into a wall
+    SDL_Rect area = { 0, 0, 0, 0 };
+    int moving = 0;
+    for( int i = 0; i < count; ++i )
+    {
+        if( velocities[ i ].x != 0 || velocities[ i ].y != 0 )
+        {
+            SDL_Rect swept = { SDL_min( boxes[ i ].x, boxes[ i ].x + velocities[ i ].x ), SDL_min( boxes[ i ].y, boxes[ i ].y + velocities[ i ].y ), boxes[ i ].w + abs( velocities[ i ].x ), boxes[ i ].h + abs( velocities[ i ].y ) };
+            if( moving == 0 )
+            {
+                area = swept;
+            }
+            else
+            {
+                SDL_UnionRect( &area, &swept, &area );
+            }
+            ++moving;
+        }
+    }
+
+    //Look the walls up once for every body, unless they are spread too far apart for that to pay off
+    WallGrid walls;
+    int firstX, firstY, lastX, lastY;
+    bool shared = moving > 0 && world.getRange( area, firstX, firstY, lastX, lastY ) &&
+        ( lastX - firstX + 1 ) * ( lastY - firstY + 1 ) <= moving * MAX_SHARED_CELLS_PER_BODY;
+    if( shared )
+    {
+        gatherWalls( area, world, walls );
+    }
+
+    //Resolve each body
+    for( int i = 0; i < count; ++i )
+    {
+        if( velocities[ i ].x != 0 || velocities[ i ].y != 0 )
+        {
+            if( shared )
+            {
+                moveBox( boxes[ i ], velocities[ i ].x, velocities[ i ].y, world, walls );
+            }
+            else
+            {
+                moveBox( boxes[ i ], velocities[ i ].x, velocities[ i ].y, world );
+            }
+        }
+    }
+}
+
 int main( int argc, char* args[] )
 {
+	//Convert a text map instead of running
+	if( argc > 1 && strcmp( args[ 1 ], "--convert" ) == 0 )
+	{
+		if( argc != 4 )
+		{
+			printf( "Usage: %s --convert <text map> <binary map>\n", args[ 0 ] );
+			return 1;
+		}
+
+		return convertMap( args[ 2 ], args[ 3 ] ) ? 0 : 1;
+	}
+
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -767,11 +2542,8 @@ int main( int argc, char* args[] )
 	}
 	else
 	{
-		//The level tiles
-		Tile* tileSet[ TOTAL_TILES ];
-
 		//Load media
-		if( !loadMedia( tileSet ) )
+		if( !loadMedia() )
 		{
 			printf( "Failed to load media!\n" );
 		}
@@ -789,6 +2561,17 @@ int main( int argc, char* args[] )
 			//Level camera
 			SDL_Rect camera = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
 
+			//Dots that start where the player does and wander off in random directions
+			SDL_Rect wanderers[ TOTAL_WANDERERS ];
+			SDL_Rect wanderStarts[ TOTAL_WANDERERS ];
+			SDL_Point wanderVelocities[ TOTAL_WANDERERS ];
+			for( int i = 0; i < TOTAL_WANDERERS; ++i )
+			{
+				wanderers[ i ] = dot.getBox();
+				wanderVelocities[ i ].x = rand() % ( Dot::DOT_VEL * 2 + 1 ) - Dot::DOT_VEL;
+				wanderVelocities[ i ].y = rand() % ( Dot::DOT_VEL * 2 + 1 ) - Dot::DOT_VEL;
+			}
+
 			//While application is running
 			while( !quit )
 			{
@@ -801,23 +2584,82 @@ int main( int argc, char* args[] )
 						quit = true;
 					}
 
+					//Render target contents were lost
+					if( e.type == SDL_RENDER_TARGETS_RESET )
+					{
+						gWorld.invalidateAll();
+					}
+					//Every texture was lost with the device, so make them all again
+					else if( e.type == SDL_RENDER_DEVICE_RESET )
+					{
+						gWorld.freeChunks();
+						if( !loadTextures() )
+						{
+							printf( "Failed to reload textures!\n" );
+							quit = true;
+						}
+					}
+
+					//Cycle the floor tile under the dot
+					if( e.type == SDL_KEYDOWN && e.key.repeat == 0 && e.key.keysym.sym == SDLK_SPACE )
+					{
+						SDL_Rect box = dot.getBox();
+						int x = ( box.x + box.w / 2 ) / gWorld.getTileWidth();
+						int y = ( box.y + box.h / 2 ) / gWorld.getTileHeight();
+						int tileType = gWorld.getType( x, y );
+						if( tileType != -1 && tileType < TILE_CENTER )
+						{
+							gWorld.setType( x, y, ( tileType + 1 ) % TILE_CENTER );
+						}
+					}
+
 					//Handle input for the dot
 					dot.handleEvent( e );
 				}
 
 				//Move the dot
-				dot.move( tileSet );
-				dot.setCamera( camera );
+				dot.move( gWorld );
+				dot.setCamera( camera, gWorld );
+
+				//Move the wanderers in one pass, turning them back on any axis a wall or the level's edge stopped them on
+				for( int i = 0; i < TOTAL_WANDERERS; ++i )
+				{
+					wanderStarts[ i ] = wanderers[ i ];
+				}
+				moveBoxes( wanderers, wanderVelocities, TOTAL_WANDERERS, gWorld );
+				for( int i = 0; i < TOTAL_WANDERERS; ++i )
+				{
+					//Tiles that aren't loaded yet stop them too, but those just wait for their page
+					SDL_Rect aheadX = { wanderStarts[ i ].x + wanderVelocities[ i ].x, wanderStarts[ i ].y, wanderStarts[ i ].w, wanderStarts[ i ].h };
+					SDL_Rect aheadY = { wanderStarts[ i ].x, wanderStarts[ i ].y + wanderVelocities[ i ].y, wanderStarts[ i ].w, wanderStarts[ i ].h };
+					bool waiting = touchesUnloaded( wanderStarts[ i ], gWorld );
+					if( wanderers[ i ].x - wanderStarts[ i ].x != wanderVelocities[ i ].x && !waiting && !touchesUnloaded( aheadX, gWorld ) )
+					{
+						wanderVelocities[ i ].x = -wanderVelocities[ i ].x;
+					}
+					if( wanderers[ i ].y - wanderStarts[ i ].y != wanderVelocities[ i ].y && !waiting && !touchesUnloaded( aheadY, gWorld ) )
+					{
+						wanderVelocities[ i ].y = -wanderVelocities[ i ].y;
+					}
+				}
+
+				//Stream pages around the camera
+				gWorld.update( camera );
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
 				//Render level
-				for( int i = 0; i < TOTAL_TILES; ++i )
+				gWorld.render( camera );
+
+				//Render wanderers tinted so they stand out from the player
+				gDotTexture.setColor( 0x80, 0x80, 0xFF );
+				for( int i = 0; i < TOTAL_WANDERERS; ++i )
 				{
-					tileSet[ i ]->render( camera );
+					gDotTexture.render( wanderers[ i ].x - camera.x, wanderers[ i ].y - camera.y );
 				}
+				gDotTexture.setColor( 0xFF, 0xFF, 0xFF );
 
 				//Render dot
 				dot.render( camera );
@@ -828,7 +2670,7 @@ int main( int argc, char* args[] )
 		}
 		
 		//Free resources and close SDL
-		close( tileSet );
+		close();
 	}
 
 	return 0;
@@ -1,16 +1,64 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL_image, SDL_ttf, standard IO, math, strings, and string streams
+//Using SDL, SDL_image, SDL_ttf, standard IO, math, strings, vectors, maps, and file stats
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <cmath>
 #include <string>
+#include <vector>
+#include <map>
+
+//SSE2 pixel compares
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Profiling is compiled out of release builds
+#ifndef NDEBUG
+#define PROFILER_ENABLED
+#endif
+
+//Times the rest of the enclosing block, and marks the start of a frame
+#ifdef PROFILER_ENABLED
+#define PROFILE_CONCAT( a, b ) a##b
+#define PROFILE_LINE_NAME( line ) PROFILE_CONCAT( profileScope, line )
+#define PROFILE_SCOPE( name ) LProfileScope PROFILE_LINE_NAME( __LINE__ )( name )
+#define PROFILE_FRAME() gProfiler.beginFrame()
+#else
+#define PROFILE_SCOPE( name )
+#define PROFILE_FRAME()
+#endif
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Layouts a font keeps before its cache is emptied
+const int LAYOUT_CACHE_SIZE = 64;
+
+//Replacement for invalid UTF-8
+const Uint32 UNICODE_REPLACEMENT = 0xFFFD;
+
+//Fullwidth forms of '!' through '~' sit this far past ASCII
+const Uint32 FULLWIDTH_OFFSET = 0xFEE0;
+
+//Glyph metrics file format version
+const int FONT_METRICS_VERSION = 1;
+
+//Benchmark character and frame counts
+const int BENCHMARK_CHARACTERS = 10000;
+const int BENCHMARK_FRAMES = 300;
+
+//Profiled frames kept, scopes recorded per frame, overlay width of a 60 Hz frame, and overlay bar height
+const int PROFILER_FRAMES = 120;
+const int PROFILER_SCOPES = 32;
+const int PROFILER_WIDTH = 600;
+const int PROFILER_BAR_HEIGHT = 8;
+
 //Texture wrapper class
 class LTexture
 {
@@ -50,6 +98,12 @@ public:
 	//Renders texture at given point
 	void render( int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
 
+	//Gets color and alpha modulation
+	SDL_Color getColor();
+
+	//Gets the hardware texture
+	SDL_Texture* getTexture();
+
 	//Gets image dimensions
 	int getWidth();
 	int getHeight();
@@ -71,6 +125,130 @@ private:
 	int mHeight;
 };
 
+//Sprite batch class
+class LSpriteBatch
+{
+public:
+	//Initializes variables
+	LSpriteBatch();
+
+	//Set color modulation of sprites added after this
+	void setColor( Uint8 red, Uint8 green, Uint8 blue );
+
+	//Set alpha modulation of sprites added after this
+	void setAlpha( Uint8 alpha );
+
+	//Queues texture at given point, same arguments as LTexture::render
+	void add( LTexture* texture, int x, int y, SDL_Rect* clip = NULL, double angle = 0.0, SDL_Point* center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE );
+
+	//Renders queued sprites with one geometry call per texture and empties the batch
+	void render();
+
+	//Gets the number of geometry calls made by the last render
+	int getDrawCalls();
+
+private:
+	//Queued quads sharing one texture
+	struct Bucket
+	{
+		LTexture* texture;
+		SDL_Color textureColor;
+		std::vector<SDL_Vertex> vertices;
+		std::vector<int> indices;
+	};
+
+	//Buckets in order of first use, kept between frames to reuse their storage
+	std::vector<Bucket> mBuckets;
+
+	//Bucket of the last added sprite
+	int mLastBucket;
+
+	//Color modulation
+	SDL_Color mColor;
+
+	//Geometry calls made by the last render
+	int mDrawCalls;
+};
+
+//Glyph quads for a string, laid out once and drawn with one geometry call per font page
+class LTextLayout
+{
+public:
+	//Initializes variables
+	LTextLayout();
+
+	//Removes all glyphs
+	void clear();
+
+	//Adds a glyph clipped from the texture at given offset from the layout's origin
+	void addGlyph( LTexture* texture, int x, int y, SDL_Rect* clip );
+
+	//Draws the glyphs with the layout's origin at given point
+	void render( int x, int y );
+
+	//Gets the number of glyphs
+	int getGlyphCount();
+
+private:
+	//Glyph quads sharing one texture
+	struct Run
+	{
+		LTexture* texture;
+
+		//Quads relative to the origin
+		std::vector<SDL_Vertex> vertices;
+		std::vector<int> indices;
+
+		//Quads moved to the last rendered point and colored with the texture's modulation at the time
+		std::vector<SDL_Vertex> placed;
+		SDL_Color placedColor;
+	};
+
+	//Runs in order of first use
+	std::vector<Run> mRuns;
+
+	//Run of the last added glyph
+	int mLastRun;
+
+	//Last rendered point
+	int mPlacedX, mPlacedY;
+};
+
+//Open addressing hash table from 64 bit keys to ints
+class LSparseTable
+{
+public:
+	//Initializes variables
+	LSparseTable();
+
+	//Removes all entries
+	void clear();
+
+	//Adds a key or replaces its value
+	void set( Uint64 key, int value );
+
+	//Gets a key's value, returns false if the key is missing
+	bool get( Uint64 key, int& value );
+
+	//Gets the number of entries
+	int getSize();
+
+private:
+	//Doubles the slots and reinserts every entry
+	void grow();
+
+	//Gets the first slot to probe for a key
+	Uint32 getSlot( Uint64 key );
+
+	//Slots, at most half of them used so probes stay short
+	std::vector<Uint64> mKeys;
+	std::vector<int> mValues;
+	std::vector<Uint8> mUsed;
+
+	//Used slots
+	int mSize;
+};
+
 //Our bitmap font
 class LBitmapFont
 {
@@ -78,26 +256,158 @@ class LBitmapFont
 		//The default constructor
 		LBitmapFont();
 
-		//Generates the font
+		//Deallocates memory
+		~LBitmapFont();
+
+		//Generates the font from a page of the first 256 code points
 		bool buildFont( std::string path );
 
+		//Adds glyphs from a 16x16 grid whose first cell is firstCodepoint, taking cellCount cells from firstCell on, pages should share the first page's cell size
+		bool addPage( std::string path, Uint32 firstCodepoint, int firstCell = 0, int cellCount = 256 );
+
+		//Moves the second glyph of a pair horizontally when it follows the first
+		void setKerning( Uint32 left, Uint32 right, int amount );
+
 		//Deallocates font
 		void free();
 
-		//Shows the text
+		//Shows the UTF-8 text, laid out on first use and drawn from the cache after that
 		void renderText( int x, int y, std::string text );
 
+		//Shows the UTF-8 text by walking the string every call, as one batch or one render per glyph
+		void renderTextUncached( int x, int y, std::string text, bool batched = true );
+
+		//Gets the cached layout of the text, valid until the font is rebuilt or its cache fills
+		LTextLayout* getLayout( std::string text );
+
+		//Gets the number of glyphs
+		int getGlyphCount();
+
     private:
-		//The font texture
-		LTexture mFontTexture;
+		//Glyph clipped from a page
+		struct Glyph
+		{
+			Uint32 codepoint;
+			LTexture* page;
+			SDL_Rect clip;
+		};
+
+		//Glyph placed relative to the text's origin
+		struct Placement
+		{
+			int glyph;
+			int x, y;
+		};
+
+		//Finds glyph bounds and spacing from a page's loaded pixels
+		void scanMetrics( LTexture& page, SDL_Rect* chars, int& space, int& newLine );
+
+		//Reads and writes glyph metrics saved next to a page image
+		bool loadMetrics( std::string path, std::string metricsPath, LTexture& page, SDL_Rect* chars, int& space, int& newLine );
+		void saveMetrics( std::string path, std::string metricsPath, LTexture& page, SDL_Rect* chars, int space, int newLine );
+
+		//Gets the glyph for a code point, -1 if the font doesn't have it
+		int findGlyph( Uint32 codepoint );
+
+		//Gets the horizontal adjustment between two code points
+		int getKerning( Uint32 left, Uint32 right );
+
+		//Decodes the text and places its glyphs
+		void placeGlyphs( std::string text, std::vector<Placement>& placements );
+
+		//Lays out text with this font's glyphs
+		void layoutText( std::string text, LTextLayout& layout );
+
+		//The font pages
+		std::vector<LTexture*> mPages;
 
-		//The individual characters in the surface
-		SDL_Rect mChars[ 256 ];
+		//Every glyph, found by code point through the index
+		std::vector<Glyph> mGlyphs;
+		LSparseTable mGlyphIndex;
+
+		//ASCII glyphs looked up directly, -1 where missing
+		int mAsciiGlyphs[ 128 ];
+
+		//Kerning amounts by code point pair
+		LSparseTable mKerning;
+
+		//Layouts by string, each font has its own so entries are keyed by font and string
+		std::map<std::string, LTextLayout> mLayouts;
+
+		//Glyph quads queued by renderTextUncached
+		LSpriteBatch mBatch;
+
+		//Placements reused by each walk
+		std::vector<Placement> mPlacements;
 
 		//Spacing Variables
 		int mNewLine, mSpace;
 };
 
+#ifdef PROFILER_ENABLED
+//Records nested scope timings for the last frames
+class LProfiler
+{
+public:
+	//Initializes variables
+	LProfiler();
+
+	//Ends the current frame and starts recording the next one
+	void beginFrame();
+
+	//Opens a scope, returns the sample to close or -1 when the frame is full
+	int begin( const char* name );
+
+	//Closes a scope
+	void end( int sample );
+
+	//Draws the last finished frame's scopes as nested bars with labels, over a graph of recent frame times
+	void render( LBitmapFont& font, int x, int y );
+
+private:
+	//Time spent in a scope
+	struct Sample
+	{
+		const char* name;
+		int depth;
+		Uint64 start, end;
+	};
+
+	//Scopes recorded during one frame
+	struct Frame
+	{
+		Sample samples[ PROFILER_SCOPES ];
+		int count;
+		Uint64 start, end;
+	};
+
+	//Ring buffer of frames
+	Frame mFrames[ PROFILER_FRAMES ];
+
+	//Frame being recorded and frames recorded so far
+	int mCurrent;
+	int mRecorded;
+
+	//Open scopes
+	int mDepth;
+};
+
+//Times the block it is declared in
+class LProfileScope
+{
+public:
+	//Opens the scope
+	LProfileScope( const char* name );
+
+	//Closes the scope
+	~LProfileScope();
+
+private:
+	//Sample being recorded
+	int mSample;
+};
+#endif
+
 //Starts up SDL and creates window
 bool init();
 
@@ -107,6 +417,15 @@ bool loadMedia();
 //Frees media and shuts down SDL
 void close();
 
+//Times drawing a screen of text per glyph, batched, and from a cached layout
+void runBenchmark();
+
+//Marks the columns of a pixel row that differ from the background, returns whether any did
+bool findInk( const Uint32* row, int count, Uint32 bgColor, Uint8* columns );
+
+//Decodes the UTF-8 character at i and moves i past it
+Uint32 decodeUTF8( const std::string& text, int& i );
+
 //The window we'll be rendering to
 SDL_Window* gWindow = NULL;
 
@@ -116,6 +435,14 @@ SDL_Renderer* gRenderer = NULL;
 //Scene textures
 LBitmapFont gBitmapFont;
 
+//Render and geometry calls, counted for the benchmark
+int gDrawCalls = 0;
+
+#ifdef PROFILER_ENABLED
+//Frame profiler
+LProfiler gProfiler;
+#endif
+
 LTexture::LTexture()
 {
 	//Initialize
@@ -308,6 +635,7 @@ void LTexture::render( int x, int y, SDL_Rect* clip, double angle, SDL_Point* ce
 
 	//Render to screen
 	SDL_RenderCopyEx( gRenderer, mTexture, clip, &renderQuad, angle, center, flip );
+	++gDrawCalls;
 }
 
 int LTexture::getWidth()
@@ -353,255 +681,1007 @@ Uint32 LTexture::getPitch32()
 	return pitch;
 }
 
-LBitmapFont::LBitmapFont()
+SDL_Color LTexture::getColor()
 {
-    //Initialize variables
-    mNewLine = 0;
-    mSpace = 0;
+	//Read texture modulation
+	SDL_Color color = { 0xFF, 0xFF, 0xFF, 0xFF };
+	if( mTexture != NULL )
+	{
+		SDL_GetTextureColorMod( mTexture, &color.r, &color.g, &color.b );
+		SDL_GetTextureAlphaMod( mTexture, &color.a );
+	}
+
+	return color;
 }
 
-bool LBitmapFont::buildFont( std::string path )
+SDL_Texture* LTexture::getTexture()
 {
-	//Get rid of preexisting texture
-	free();
+	return mTexture;
+}
 
-	//Load bitmap image
-	bool success = true;
-	if( !mFontTexture.loadPixelsFromFile( path ) )
-	{
-		printf( "Unable to load bitmap font surface!\n" );
-		success = false;
-	}
-	else
-	{
-		//Get the background color
-		Uint32 bgColor = mFontTexture.getPixel32( 0, 0 );
+LSpriteBatch::LSpriteBatch()
+{
+	//Initialize
+	mLastBucket = -1;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+	mDrawCalls = 0;
+}
 
-		//Set the cell dimensions
-		int cellW = mFontTexture.getWidth() / 16;
-		int cellH = mFontTexture.getHeight() / 16;
+void LSpriteBatch::setColor( Uint8 red, Uint8 green, Uint8 blue )
+{
+	mColor.r = red;
+	mColor.g = green;
+	mColor.b = blue;
+}
 
-		//New line variables
-		int top = cellH;
-		int baseA = cellH;
+void LSpriteBatch::setAlpha( Uint8 alpha )
+{
+	mColor.a = alpha;
+}
 
-		//The current character we're setting
-		int currentChar = 0;
+void LSpriteBatch::add( LTexture* texture, int x, int y, SDL_Rect* clip, double angle, SDL_Point* center, SDL_RendererFlip flip )
+{
+	//Nothing to draw
+	if( texture->getTexture() == NULL )
+	{
+		return;
+	}
 
-		//Go through the cell rows
-		for( int rows = 0; rows < 16; ++rows )
+	//Find the bucket for this texture, most sprites reuse the last one
+	if( mLastBucket < 0 || mBuckets[ mLastBucket ].texture != texture )
+	{
+		mLastBucket = -1;
+		for( int i = 0; i < mBuckets.size(); ++i )
 		{
-			//Go through the cell columns
-			for( int cols = 0; cols < 16; ++cols )
+			if( mBuckets[ i ].texture == texture )
 			{
-				//Set the character offset
-				mChars[ currentChar ].x = cellW * cols;
-				mChars[ currentChar ].y = cellH * rows;
-
-				//Set the dimensions of the character
-				mChars[ currentChar ].w = cellW;
-				mChars[ currentChar ].h = cellH;
+				mLastBucket = i;
+				break;
+			}
+		}
 
-				//Find Left Side
-				//Go through pixel columns
-				for( int pCol = 0; pCol < cellW; ++pCol )
-				{
-					//Go through pixel rows
-					for( int pRow = 0; pRow < cellH; ++pRow )
-					{
-						//Get the pixel offsets
-						int pX = ( cellW * cols ) + pCol;
-						int pY = ( cellH * rows ) + pRow;
+		//Start a new bucket
+		if( mLastBucket < 0 )
+		{
+			mBuckets.push_back( Bucket() );
+			mLastBucket = mBuckets.size() - 1;
+			mBuckets[ mLastBucket ].texture = texture;
+		}
+	}
+	Bucket& bucket = mBuckets[ mLastBucket ];
 
-						//If a non colorkey pixel is found
-						if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-						{
-							//Set the x offset
-							mChars[ currentChar ].x = pX;
+	//Geometry ignores texture modulation, so read it once per batch and fold it into the vertex colors
+	if( bucket.vertices.empty() )
+	{
+		bucket.textureColor = texture->getColor();
+	}
+	SDL_Color color;
+	color.r = mColor.r * bucket.textureColor.r / 255;
+	color.g = mColor.g * bucket.textureColor.g / 255;
+	color.b = mColor.b * bucket.textureColor.b / 255;
+	color.a = mColor.a * bucket.textureColor.a / 255;
+
+	//Source rectangle
+	SDL_Rect source = { 0, 0, texture->getWidth(), texture->getHeight() };
+	if( clip != NULL )
+	{
+		source = *clip;
+	}
 
-							//Break the loops
-							pCol = cellW;
-							pRow = cellH;
-						}
-					}
-				}
+	//Texture coordinates, swapped when flipped
+	float left = (float)source.x / texture->getWidth();
+	float right = (float)( source.x + source.w ) / texture->getWidth();
+	float top = (float)source.y / texture->getHeight();
+	float bottom = (float)( source.y + source.h ) / texture->getHeight();
+	if( flip & SDL_FLIP_HORIZONTAL )
+	{
+		float swap = left; left = right; right = swap;
+	}
+	if( flip & SDL_FLIP_VERTICAL )
+	{
+		float swap = top; top = bottom; bottom = swap;
+	}
 
-				//Find Right Side
-				//Go through pixel columns
-				for( int pColW = cellW - 1; pColW >= 0; --pColW )
-				{
-					//Go through pixel rows
-					for( int pRowW = 0; pRowW < cellH; ++pRowW )
-					{
-						//Get the pixel offsets
-						int pX = ( cellW * cols ) + pColW;
-						int pY = ( cellH * rows ) + pRowW;
+	//Rotation center, defaults to the middle of the quad like SDL_RenderCopyEx
+	float centerX = source.w / 2.f;
+	float centerY = source.h / 2.f;
+	if( center != NULL )
+	{
+		centerX = center->x;
+		centerY = center->y;
+	}
 
-						//If a non colorkey pixel is found
-						if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-						{
-							//Set the width
-							mChars[ currentChar ].w = ( pX - mChars[ currentChar ].x ) + 1;
+	//Rotation, clockwise in degrees
+	float cosAngle = 1.f, sinAngle = 0.f;
+	if( angle != 0.0 )
+	{
+		cosAngle = cos( angle * M_PI / 180.0 );
+		sinAngle = sin( angle * M_PI / 180.0 );
+	}
 
-							//Break the loops
-							pColW = -1;
-							pRowW = cellH;
-						}
-					}
-				}
+	//Corners clockwise from top left, relative to the center
+	float cornerX[ 4 ] = { -centerX, source.w - centerX, source.w - centerX, -centerX };
+	float cornerY[ 4 ] = { -centerY, -centerY, source.h - centerY, source.h - centerY };
+	float u[ 4 ] = { left, right, right, left };
+	float v[ 4 ] = { top, top, bottom, bottom };
 
-				//Find Top
-				//Go through pixel rows
-				for( int pRow = 0; pRow < cellH; ++pRow )
-				{
-					//Go through pixel columns
-					for( int pCol = 0; pCol < cellW; ++pCol )
-					{
-						//Get the pixel offsets
-						int pX = ( cellW * cols ) + pCol;
-						int pY = ( cellH * rows ) + pRow;
+	//Add the corners
+	int first = bucket.vertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		SDL_Vertex vertex;
+		vertex.position.x = x + centerX + cornerX[ i ] * cosAngle - cornerY[ i ] * sinAngle;
+		vertex.position.y = y + centerY + cornerX[ i ] * sinAngle + cornerY[ i ] * cosAngle;
+		vertex.color = color;
+		vertex.tex_coord.x = u[ i ];
+		vertex.tex_coord.y = v[ i ];
+		bucket.vertices.push_back( vertex );
+	}
 
-						//If a non colorkey pixel is found
-						if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-						{
-							//If new top is found
-							if( pRow < top )
-							{
-								top = pRow;
-							}
-
-							//Break the loops
-							pCol = cellW;
-							pRow = cellH;
-						}
-					}
-				}
+	//Two triangles per quad
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 1 );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first );
+	bucket.indices.push_back( first + 2 );
+	bucket.indices.push_back( first + 3 );
+}
 
-				//Find Bottom of A
-				if( currentChar == 'A' )
-				{
-					//Go through pixel rows
-					for( int pRow = cellH - 1; pRow >= 0; --pRow )
-					{
-						//Go through pixel columns
-						for( int pCol = 0; pCol < cellW; ++pCol )
-						{
-							//Get the pixel offsets
-							int pX = ( cellW * cols ) + pCol;
-							int pY = ( cellH * rows ) + pRow;
-
-							//If a non colorkey pixel is found
-							if( mFontTexture.getPixel32( pX, pY ) != bgColor )
-							{
-								//Bottom of a is found
-								baseA = pRow;
-
-								//Break the loops
-								pCol = cellW;
-								pRow = -1;
-							}
-						}
-					}
-				}
+void LSpriteBatch::render()
+{
+	//Draw each texture's quads at once
+	mDrawCalls = 0;
+	for( int i = 0; i < mBuckets.size(); ++i )
+	{
+		Bucket& bucket = mBuckets[ i ];
+		if( !bucket.indices.empty() )
+		{
+			SDL_RenderGeometry( gRenderer, bucket.texture->getTexture(), &bucket.vertices[ 0 ], bucket.vertices.size(), &bucket.indices[ 0 ], bucket.indices.size() );
+			++mDrawCalls;
+			++gDrawCalls;
 
-				//Go to the next character
-				++currentChar;
-			}
+			//Keep the storage for the next frame
+			bucket.vertices.clear();
+			bucket.indices.clear();
 		}
+	}
+}
+
+int LSpriteBatch::getDrawCalls()
+{
+	return mDrawCalls;
+}
 
-		//Calculate space
-		mSpace = cellW / 2;
+LTextLayout::LTextLayout()
+{
+	//Initialize
+	mLastRun = -1;
+	mPlacedX = 0;
+	mPlacedY = 0;
+}
 
-		//Calculate new line
-		mNewLine = baseA - top;
+void LTextLayout::clear()
+{
+	mRuns.clear();
+	mLastRun = -1;
+}
 
-		//Lop off excess top pixels
-		for( int i = 0; i < 256; ++i )
+void LTextLayout::addGlyph( LTexture* texture, int x, int y, SDL_Rect* clip )
+{
+	//Find the run for this page, text mostly stays on the last one
+	if( mLastRun < 0 || mRuns[ mLastRun ].texture != texture )
+	{
+		mLastRun = -1;
+		for( int i = 0; i < mRuns.size(); ++i )
 		{
-			mChars[ i ].y += top;
-			mChars[ i ].h -= top;
+			if( mRuns[ i ].texture == texture )
+			{
+				mLastRun = i;
+				break;
+			}
 		}
 
-		//Create final texture
-		if( !mFontTexture.loadFromPixels() )
+		//Start a new run
+		if( mLastRun < 0 )
 		{
-			printf( "Unable to create font texture!\n" );
-			success = false;
+			mRuns.push_back( Run() );
+			mLastRun = mRuns.size() - 1;
+			mRuns[ mLastRun ].texture = texture;
 		}
 	}
+	Run& run = mRuns[ mLastRun ];
+
+	//Modulation is only known when drawing, so quads start out white
+	SDL_Color color = { 0xFF, 0xFF, 0xFF, 0xFF };
+
+	//Texture coordinates
+	float left = (float)clip->x / texture->getWidth();
+	float right = (float)( clip->x + clip->w ) / texture->getWidth();
+	float top = (float)clip->y / texture->getHeight();
+	float bottom = (float)( clip->y + clip->h ) / texture->getHeight();
+
+	//Corners clockwise from top left
+	float cornerX[ 4 ] = { (float)x, (float)( x + clip->w ), (float)( x + clip->w ), (float)x };
+	float cornerY[ 4 ] = { (float)y, (float)y, (float)( y + clip->h ), (float)( y + clip->h ) };
+	float u[ 4 ] = { left, right, right, left };
+	float v[ 4 ] = { top, top, bottom, bottom };
+
+	//Add the corners
+	int first = run.vertices.size();
+	for( int i = 0; i < 4; ++i )
+	{
+		SDL_Vertex vertex;
+		vertex.position.x = cornerX[ i ];
+		vertex.position.y = cornerY[ i ];
+		vertex.color = color;
+		vertex.tex_coord.x = u[ i ];
+		vertex.tex_coord.y = v[ i ];
+		run.vertices.push_back( vertex );
+	}
 
-	return success;
+	//Two triangles per quad
+	run.indices.push_back( first );
+	run.indices.push_back( first + 1 );
+	run.indices.push_back( first + 2 );
+	run.indices.push_back( first );
+	run.indices.push_back( first + 2 );
+	run.indices.push_back( first + 3 );
+
+	//Placed quads are out of date
+	run.placed.clear();
 }
 
-void LBitmapFont::free()
+void LTextLayout::render( int x, int y )
+{
+	bool moved = x != mPlacedX || y != mPlacedY;
+	mPlacedX = x;
+	mPlacedY = y;
+
+	for( int i = 0; i < mRuns.size(); ++i )
+	{
+		Run& run = mRuns[ i ];
+
+		//Geometry ignores texture modulation, so read it each draw to fold into the vertex colors
+		SDL_Color color = run.texture->getColor();
+		bool recolored = color.r != run.placedColor.r || color.g != run.placedColor.g || color.b != run.placedColor.b || color.a != run.placedColor.a;
+
+		//Only redo the quads when the origin or the modulation changes
+		if( moved || recolored || run.placed.size() != run.vertices.size() )
+		{
+			run.placed = run.vertices;
+			for( int j = 0; j < run.placed.size(); ++j )
+			{
+				run.placed[ j ].position.x += x;
+				run.placed[ j ].position.y += y;
+				run.placed[ j ].color = color;
+			}
+			run.placedColor = color;
+		}
+
+		//Draw the page's glyphs at once
+		SDL_RenderGeometry( gRenderer, run.texture->getTexture(), &run.placed[ 0 ], run.placed.size(), &run.indices[ 0 ], run.indices.size() );
+		++gDrawCalls;
+	}
+}
+
+int LTextLayout::getGlyphCount()
 {
-	mFontTexture.free();
+	int count = 0;
+	for( int i = 0; i < mRuns.size(); ++i )
+	{
+		count += mRuns[ i ].indices.size() / 6;
+	}
+
+	return count;
 }
 
-void LBitmapFont::renderText( int x, int y, std::string text )
+LSparseTable::LSparseTable()
 {
-    //If the font has been built
-    if( mFontTexture.getWidth() > 0 )
-    {
-		//Temp offsets
-		int curX = x, curY = y;
-
-        //Go through the text
-        for( int i = 0; i < text.length(); ++i )
-        {
-            //If the current character is a space
-            if( text[ i ] == ' ' )
-            {
-                //Move over
-                curX += mSpace;
-            }
-            //If the current character is a newline
-            else if( text[ i ] == '\n' )
-            {
-                //Move down
-                curY += mNewLine;
-
-                //Move back
-                curX = x;
-            }
-            else
-            {
-                //Get the ASCII value of the character
-                int ascii = (unsigned char)text[ i ];
-
-                //Show the character
-				mFontTexture.render( curX, curY, &mChars[ ascii ] );
-
-                //Move over the width of the character with one pixel of padding
-                curX += mChars[ ascii ].w + 1;
-            }
-        }
-    }
+	//Initialize
+	mSize = 0;
 }
 
-bool init()
+void LSparseTable::clear()
 {
-	//Initialization flag
-	bool success = true;
+	mKeys.clear();
+	mValues.clear();
+	mUsed.clear();
+	mSize = 0;
+}
 
-	//Initialize SDL
-	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+void LSparseTable::set( Uint64 key, int value )
+{
+	//Keep at least half the slots empty
+	if( ( mSize + 1 ) * 2 > (int)mUsed.size() )
 	{
-		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
-		success = false;
+		grow();
 	}
-	else
-	{
-		//Set texture filtering to linear
-		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
-		{
-			printf( "Warning: Linear texture filtering not enabled!" );
-		}
 
-		//Seed random
-		srand( SDL_GetTicks() );
+	//Probe for the key or an empty slot
+	Uint32 mask = mUsed.size() - 1;
+	Uint32 slot = getSlot( key ) & mask;
+	while( mUsed[ slot ] && mKeys[ slot ] != key )
+	{
+		slot = ( slot + 1 ) & mask;
+	}
 
-		//Create window
+	//New key
+	if( !mUsed[ slot ] )
+	{
+		mUsed[ slot ] = 1;
+		mKeys[ slot ] = key;
+		++mSize;
+	}
+	mValues[ slot ] = value;
+}
+
+bool LSparseTable::get( Uint64 key, int& value )
+{
+	//Empty table
+	if( mSize == 0 )
+	{
+		return false;
+	}
+
+	//Probe until the key or an empty slot
+	Uint32 mask = mUsed.size() - 1;
+	for( Uint32 slot = getSlot( key ) & mask; mUsed[ slot ]; slot = ( slot + 1 ) & mask )
+	{
+		if( mKeys[ slot ] == key )
+		{
+			value = mValues[ slot ];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int LSparseTable::getSize()
+{
+	return mSize;
+}
+
+void LSparseTable::grow()
+{
+	//Keep the old slots
+	std::vector<Uint64> keys;
+	std::vector<int> values;
+	std::vector<Uint8> used;
+	keys.swap( mKeys );
+	values.swap( mValues );
+	used.swap( mUsed );
+
+	//Double the slots, sizes stay a power of two so probes can wrap with a mask
+	int slots = used.empty() ? 16 : used.size() * 2;
+	mKeys.assign( slots, 0 );
+	mValues.assign( slots, 0 );
+	mUsed.assign( slots, 0 );
+	mSize = 0;
+
+	//Reinsert
+	for( int i = 0; i < used.size(); ++i )
+	{
+		if( used[ i ] )
+		{
+			set( keys[ i ], values[ i ] );
+		}
+	}
+}
+
+Uint32 LSparseTable::getSlot( Uint64 key )
+{
+	//Fibonacci hashing spreads nearby code points apart
+	return ( key * 0x9E3779B97F4A7C15ULL ) >> 32;
+}
+
+LBitmapFont::LBitmapFont()
+{
+    //Initialize variables
+    mNewLine = 0;
+    mSpace = 0;
+	for( int i = 0; i < 128; ++i )
+	{
+		mAsciiGlyphs[ i ] = -1;
+	}
+}
+
+LBitmapFont::~LBitmapFont()
+{
+	//Deallocate
+	free();
+}
+
+bool LBitmapFont::buildFont( std::string path )
+{
+	//Get rid of preexisting pages
+	free();
+
+	//The first page covers ASCII and Latin-1
+	return addPage( path, 0 );
+}
+
+bool LBitmapFont::addPage( std::string path, Uint32 firstCodepoint, int firstCell, int cellCount )
+{
+	//Load bitmap image
+	LTexture* page = new LTexture();
+	if( !page->loadPixelsFromFile( path ) )
+	{
+		printf( "Unable to load bitmap font surface!\n" );
+		delete page;
+		return false;
+	}
+
+	//Reuse the metrics saved by an earlier run, scan the pixels otherwise
+	SDL_Rect chars[ 256 ];
+	int space = 0, newLine = 0;
+	std::string metricsPath = path + ".chars";
+	if( !loadMetrics( path, metricsPath, *page, chars, space, newLine ) )
+	{
+		scanMetrics( *page, chars, space, newLine );
+		saveMetrics( path, metricsPath, *page, chars, space, newLine );
+	}
+
+	//Create final texture
+	if( !page->loadFromPixels() )
+	{
+		printf( "Unable to create font texture!\n" );
+		delete page;
+		return false;
+	}
+
+	//The first page sets the spacing
+	if( mPages.empty() )
+	{
+		mSpace = space;
+		mNewLine = newLine;
+	}
+	mPages.push_back( page );
+
+	//Add the page's glyphs, replacing ones already defined
+	for( int i = SDL_max( firstCell, 0 ); i < firstCell + cellCount && i < 256; ++i )
+	{
+		Glyph glyph;
+		glyph.codepoint = firstCodepoint + i;
+		glyph.page = page;
+		glyph.clip = chars[ i ];
+
+		int index = findGlyph( glyph.codepoint );
+		if( index >= 0 )
+		{
+			mGlyphs[ index ] = glyph;
+		}
+		else
+		{
+			index = mGlyphs.size();
+			mGlyphs.push_back( glyph );
+			mGlyphIndex.set( glyph.codepoint, index );
+			if( glyph.codepoint < 128 )
+			{
+				mAsciiGlyphs[ glyph.codepoint ] = index;
+			}
+		}
+	}
+
+	//Cached layouts may use replaced glyphs
+	mLayouts.clear();
+
+	return true;
+}
+
+void LBitmapFont::setKerning( Uint32 left, Uint32 right, int amount )
+{
+	mKerning.set( ( (Uint64)left << 32 ) | right, amount );
+
+	//Cached layouts may contain the pair
+	mLayouts.clear();
+}
+
+void LBitmapFont::scanMetrics( LTexture& page, SDL_Rect* chars, int& space, int& newLine )
+{
+	//Get the background color
+	Uint32* pixels = page.getPixels32();
+	Uint32 pitch = page.getPitch32();
+	Uint32 bgColor = pixels[ 0 ];
+
+	//Set the cell dimensions
+	int cellW = page.getWidth() / 16;
+	int cellH = page.getHeight() / 16;
+
+	//New line variables
+	int top = cellH;
+	int baseA = cellH;
+
+	//Which columns and rows of the current cell have a non colorkey pixel
+	std::vector<Uint8> columnInk( cellW );
+	std::vector<Uint8> rowInk( cellH );
+
+	//Go through the cells
+	for( int currentChar = 0; currentChar < 256; ++currentChar )
+	{
+		int cellX = cellW * ( currentChar % 16 );
+		int cellY = cellH * ( currentChar / 16 );
+
+		//Read every pixel of the cell once
+		for( int pCol = 0; pCol < cellW; ++pCol )
+		{
+			columnInk[ pCol ] = 0;
+		}
+		for( int pRow = 0; pRow < cellH; ++pRow )
+		{
+			rowInk[ pRow ] = findInk( &pixels[ ( cellY + pRow ) * pitch + cellX ], cellW, bgColor, &columnInk[ 0 ] );
+		}
+
+		//Default to the whole cell
+		chars[ currentChar ].x = cellX;
+		chars[ currentChar ].y = cellY;
+		chars[ currentChar ].w = cellW;
+		chars[ currentChar ].h = cellH;
+
+		//Find left and right side
+		int left = 0;
+		while( left < cellW && !columnInk[ left ] )
+		{
+			++left;
+		}
+		int right = cellW - 1;
+		while( right >= 0 && !columnInk[ right ] )
+		{
+			--right;
+		}
+		if( left < cellW )
+		{
+			chars[ currentChar ].x = cellX + left;
+			chars[ currentChar ].w = right - left + 1;
+		}
+
+		//Find top
+		int first = 0;
+		while( first < cellH && !rowInk[ first ] )
+		{
+			++first;
+		}
+		if( first < top )
+		{
+			top = first;
+		}
+
+		//Find bottom of A
+		if( currentChar == 'A' )
+		{
+			int last = cellH - 1;
+			while( last >= 0 && !rowInk[ last ] )
+			{
+				--last;
+			}
+			if( last >= 0 )
+			{
+				baseA = last;
+			}
+		}
+	}
+
+	//Calculate space
+	space = cellW / 2;
+
+	//Calculate new line
+	newLine = baseA - top;
+
+	//Lop off excess top pixels
+	for( int i = 0; i < 256; ++i )
+	{
+		chars[ i ].y += top;
+		chars[ i ].h -= top;
+	}
+}
+
+bool LBitmapFont::loadMetrics( std::string path, std::string metricsPath, LTexture& page, SDL_Rect* chars, int& space, int& newLine )
+{
+	//Source image must not have changed since the metrics were saved
+	long modified = 0;
+	struct stat info;
+	if( stat( path.c_str(), &info ) == 0 )
+	{
+		modified = info.st_mtime;
+	}
+
+	//Open the metrics
+	FILE* file = fopen( metricsPath.c_str(), "r" );
+	if( file == NULL )
+	{
+		return false;
+	}
+
+	//Check version, source, and dimensions
+	bool success = true;
+	int version = 0, width = 0, height = 0;
+	long savedModified = 0;
+	if( fscanf( file, "%d %ld %d %d", &version, &savedModified, &width, &height ) != 4 ||
+		version != FONT_METRICS_VERSION || savedModified != modified || width != page.getWidth() || height != page.getHeight() )
+	{
+		success = false;
+	}
+
+	//Read spacing and glyph bounds
+	if( success && fscanf( file, "%d %d", &space, &newLine ) != 2 )
+	{
+		success = false;
+	}
+	for( int i = 0; success && i < 256; ++i )
+	{
+		if( fscanf( file, "%d %d %d %d", &chars[ i ].x, &chars[ i ].y, &chars[ i ].w, &chars[ i ].h ) != 4 )
+		{
+			success = false;
+		}
+	}
+	fclose( file );
+
+	return success;
+}
+
+void LBitmapFont::saveMetrics( std::string path, std::string metricsPath, LTexture& page, SDL_Rect* chars, int space, int newLine )
+{
+	//Remember when the source was last changed
+	long modified = 0;
+	struct stat info;
+	if( stat( path.c_str(), &info ) == 0 )
+	{
+		modified = info.st_mtime;
+	}
+
+	//Save metrics
+	FILE* file = fopen( metricsPath.c_str(), "w" );
+	if( file == NULL )
+	{
+		printf( "Unable to save font metrics %s!\n", metricsPath.c_str() );
+		return;
+	}
+
+	fprintf( file, "%d %ld %d %d\n", FONT_METRICS_VERSION, modified, page.getWidth(), page.getHeight() );
+	fprintf( file, "%d %d\n", space, newLine );
+	for( int i = 0; i < 256; ++i )
+	{
+		fprintf( file, "%d %d %d %d\n", chars[ i ].x, chars[ i ].y, chars[ i ].w, chars[ i ].h );
+	}
+	fclose( file );
+}
+
+int LBitmapFont::findGlyph( Uint32 codepoint )
+{
+	//Most text is ASCII
+	if( codepoint < 128 )
+	{
+		return mAsciiGlyphs[ codepoint ];
+	}
+
+	int index = -1;
+	mGlyphIndex.get( codepoint, index );
+	return index;
+}
+
+int LBitmapFont::getKerning( Uint32 left, Uint32 right )
+{
+	int amount = 0;
+	mKerning.get( ( (Uint64)left << 32 ) | right, amount );
+	return amount;
+}
+
+void LBitmapFont::free()
+{
+	//Layouts point into the old pages
+	mLayouts.clear();
+
+	//Forget the glyphs
+	mGlyphs.clear();
+	mGlyphIndex.clear();
+	mKerning.clear();
+	for( int i = 0; i < 128; ++i )
+	{
+		mAsciiGlyphs[ i ] = -1;
+	}
+
+	//Free the pages
+	for( int i = 0; i < mPages.size(); ++i )
+	{
+		delete mPages[ i ];
+	}
+	mPages.clear();
+}
+
+void LBitmapFont::renderText( int x, int y, std::string text )
+{
+	//If the font has been built
+	if( !mPages.empty() )
+	{
+		getLayout( text )->render( x, y );
+	}
+}
+
+LTextLayout* LBitmapFont::getLayout( std::string text )
+{
+	//Already laid out
+	std::map<std::string, LTextLayout>::iterator cached = mLayouts.find( text );
+	if( cached != mLayouts.end() )
+	{
+		return &cached->second;
+	}
+
+	//Start over instead of growing without bound when the text keeps changing
+	if( mLayouts.size() >= LAYOUT_CACHE_SIZE )
+	{
+		mLayouts.clear();
+	}
+
+	//Lay out new text
+	LTextLayout& layout = mLayouts[ text ];
+	layoutText( text, layout );
+
+	return &layout;
+}
+
+int LBitmapFont::getGlyphCount()
+{
+	return mGlyphs.size();
+}
+
+void LBitmapFont::placeGlyphs( std::string text, std::vector<Placement>& placements )
+{
+	placements.clear();
+
+	//Temp offsets from the origin
+	int curX = 0, curY = 0;
+
+	//Last glyph's code point for kerning, 0 after spacing
+	Uint32 previous = 0;
+
+	//Go through the text
+	for( int i = 0; i < text.length(); )
+	{
+		Uint32 codepoint = decodeUTF8( text, i );
+
+		//If the current character is a space
+		if( codepoint == ' ' )
+		{
+			//Move over
+			curX += mSpace;
+			previous = 0;
+		}
+		//If the current character is a newline
+		else if( codepoint == '\n' )
+		{
+			//Move down
+			curY += mNewLine;
+
+			//Move back
+			curX = 0;
+			previous = 0;
+		}
+		else
+		{
+			//Show missing characters as question marks
+			int glyph = findGlyph( codepoint );
+			if( glyph < 0 )
+			{
+				glyph = findGlyph( '?' );
+				if( glyph < 0 )
+				{
+					continue;
+				}
+			}
+
+			//Adjust the pair
+			if( previous != 0 )
+			{
+				curX += getKerning( previous, codepoint );
+			}
+
+			//Place the character
+			Placement placement;
+			placement.glyph = glyph;
+			placement.x = curX;
+			placement.y = curY;
+			placements.push_back( placement );
+
+			//Move over the width of the character with one pixel of padding
+			curX += mGlyphs[ glyph ].clip.w + 1;
+			previous = codepoint;
+		}
+	}
+}
+
+void LBitmapFont::layoutText( std::string text, LTextLayout& layout )
+{
+	layout.clear();
+
+	//Add each placed glyph
+	placeGlyphs( text, mPlacements );
+	for( int i = 0; i < mPlacements.size(); ++i )
+	{
+		Glyph& glyph = mGlyphs[ mPlacements[ i ].glyph ];
+		layout.addGlyph( glyph.page, mPlacements[ i ].x, mPlacements[ i ].y, &glyph.clip );
+	}
+}
+
+void LBitmapFont::renderTextUncached( int x, int y, std::string text, bool batched )
+{
+	//If the font has been built
+	if( !mPages.empty() )
+	{
+		//Go through the text
+		placeGlyphs( text, mPlacements );
+		for( int i = 0; i < mPlacements.size(); ++i )
+		{
+			//Show the character
+			Glyph& glyph = mGlyphs[ mPlacements[ i ].glyph ];
+			if( batched )
+			{
+				mBatch.add( glyph.page, x + mPlacements[ i ].x, y + mPlacements[ i ].y, &glyph.clip );
+			}
+			else
+			{
+				glyph.page->render( x + mPlacements[ i ].x, y + mPlacements[ i ].y, &glyph.clip );
+			}
+		}
+
+		//Draw each page's glyphs at once
+		if( batched )
+		{
+			mBatch.render();
+		}
+	}
+}
+
+#ifdef PROFILER_ENABLED
+LProfiler::LProfiler()
+{
+	//Initialize
+	mCurrent = 0;
+	mRecorded = 0;
+	mDepth = 0;
+	mFrames[ 0 ].count = 0;
+	mFrames[ 0 ].start = 0;
+	mFrames[ 0 ].end = 0;
+}
+
+void LProfiler::beginFrame()
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	//Finish the current frame
+	if( mRecorded > 0 )
+	{
+		mFrames[ mCurrent ].end = now;
+		mCurrent = ( mCurrent + 1 ) % PROFILER_FRAMES;
+	}
+	++mRecorded;
+
+	//Start the next one, overwriting the oldest
+	mFrames[ mCurrent ].count = 0;
+	mFrames[ mCurrent ].start = now;
+	mFrames[ mCurrent ].end = now;
+	mDepth = 0;
+}
+
+int LProfiler::begin( const char* name )
+{
+	//No frame started or no room left
+	Frame& frame = mFrames[ mCurrent ];
+	if( mRecorded == 0 || frame.count == PROFILER_SCOPES )
+	{
+		return -1;
+	}
+
+	Sample& sample = frame.samples[ frame.count ];
+	sample.name = name;
+	sample.depth = mDepth++;
+	sample.start = SDL_GetPerformanceCounter();
+	sample.end = sample.start;
+
+	return frame.count++;
+}
+
+void LProfiler::end( int sample )
+{
+	if( sample >= 0 )
+	{
+		mFrames[ mCurrent ].samples[ sample ].end = SDL_GetPerformanceCounter();
+		--mDepth;
+	}
+}
+
+void LProfiler::render( LBitmapFont& font, int x, int y )
+{
+	//Need a finished frame
+	if( mRecorded < 2 )
+	{
+		return;
+	}
+	Frame& frame = mFrames[ ( mCurrent + PROFILER_FRAMES - 1 ) % PROFILER_FRAMES ];
+
+	//A 60 Hz frame spans the overlay width
+	double frequency = SDL_GetPerformanceFrequency();
+	double pixelsPerTick = PROFILER_WIDTH / ( frequency / 60.0 );
+
+	//Graph recent frame times, newest on the left, a 60 Hz frame reaches the bars
+	int graphHeight = PROFILER_BAR_HEIGHT * 4;
+	SDL_SetRenderDrawColor( gRenderer, 0x80, 0x80, 0x80, 0xFF );
+	for( int i = 0; i < PROFILER_FRAMES && i < mRecorded - 1; ++i )
+	{
+		Frame& past = mFrames[ ( mCurrent + PROFILER_FRAMES - 1 - i ) % PROFILER_FRAMES ];
+		int height = SDL_min( (int)( ( past.end - past.start ) * graphHeight / ( frequency / 60.0 ) ), graphHeight );
+		SDL_RenderDrawLine( gRenderer, x + i, y + graphHeight, x + i, y + graphHeight - height );
+	}
+	y += graphHeight + 2;
+
+	//Whole frame
+	SDL_Rect bar = { x, y, (int)( ( frame.end - frame.start ) * pixelsPerTick ), PROFILER_BAR_HEIGHT };
+	SDL_SetRenderDrawColor( gRenderer, 0x40, 0x40, 0x40, 0xFF );
+	SDL_RenderFillRect( gRenderer, &bar );
+
+	//Scopes, nested ones below their parents
+	const SDL_Color colors[ 4 ] = { { 0xE0, 0x40, 0x40, 0xFF }, { 0x40, 0xA0, 0x40, 0xFF }, { 0x40, 0x60, 0xE0, 0xFF }, { 0xE0, 0xA0, 0x20, 0xFF } };
+	std::string labels;
+	char line[ 128 ];
+	snprintf( line, sizeof( line ), "Frame %.2f ms", 1000.0 * ( frame.end - frame.start ) / frequency );
+	labels += line;
+	int deepest = 0;
+	for( int i = 0; i < frame.count; ++i )
+	{
+		Sample& sample = frame.samples[ i ];
+		deepest = SDL_max( deepest, sample.depth );
+		bar.x = x + (int)( ( sample.start - frame.start ) * pixelsPerTick );
+		bar.y = y + ( sample.depth + 1 ) * PROFILER_BAR_HEIGHT;
+		bar.w = SDL_max( (int)( ( sample.end - sample.start ) * pixelsPerTick ), 1 );
+		SDL_Color color = colors[ i % 4 ];
+		SDL_SetRenderDrawColor( gRenderer, color.r, color.g, color.b, color.a );
+		SDL_RenderFillRect( gRenderer, &bar );
+
+		//Label indented by depth
+		snprintf( line, sizeof( line ), "\n%*s%s %.3f ms", sample.depth * 2, "", sample.name, 1000.0 * ( sample.end - sample.start ) / frequency );
+		labels += line;
+	}
+
+	//Labels change every frame, so keep them out of the layout cache
+	font.renderTextUncached( x, y + ( deepest + 2 ) * PROFILER_BAR_HEIGHT + 2, labels );
+}
+
+LProfileScope::LProfileScope( const char* name )
+{
+	mSample = gProfiler.begin( name );
+}
+
+LProfileScope::~LProfileScope()
+{
+	gProfiler.end( mSample );
+}
+#endif
+
+bool init()
+{
+	//Initialization flag
+	bool success = true;
+
+	//Initialize SDL
+	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+	{
+		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
+		success = false;
+	}
+	else
+	{
+		//Set texture filtering to linear
+		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
+		{
+			printf( "Warning: Linear texture filtering not enabled!" );
+		}
+
+		//Seed random
+		srand( SDL_GetTicks() );
+
+		//Create window
 		gWindow = SDL_CreateWindow( "SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
 		if( gWindow == NULL )
 		{
@@ -647,6 +1727,19 @@ bool loadMedia()
 		printf( "Failed to load bitmap font!\n" );
 		success = false;
 	}
+	else
+	{
+		//Reuse the printable ASCII cells as a second page holding their fullwidth forms
+		if( !gBitmapFont.addPage( "lazyfont.png", FULLWIDTH_OFFSET, '!', '~' - '!' + 1 ) )
+		{
+			printf( "Failed to load fullwidth font page!\n" );
+			success = false;
+		}
+
+		//Tuck the slanted sides of A and V together
+		gBitmapFont.setKerning( 'A', 'V', -3 );
+		gBitmapFont.setKerning( 'V', 'A', -3 );
+	}
 
 	return success;
 }
@@ -667,6 +1760,154 @@ void close()
 	SDL_Quit();
 }
 
+bool findInk( const Uint32* row, int count, Uint32 bgColor, Uint8* columns )
+{
+	int ink = 0;
+	int i = 0;
+
+#ifdef __SSE2__
+	//Compare four pixels at a time
+	const __m128i background = _mm_set1_epi32( bgColor );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		//One bit per pixel that differs from the background
+		__m128i same = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i*)( row + i ) ), background );
+		int differs = ~_mm_movemask_ps( _mm_castsi128_ps( same ) ) & 0xF;
+
+		columns[ i ] |= differs & 1;
+		columns[ i + 1 ] |= ( differs >> 1 ) & 1;
+		columns[ i + 2 ] |= ( differs >> 2 ) & 1;
+		columns[ i + 3 ] |= ( differs >> 3 ) & 1;
+		ink |= differs;
+	}
+#endif
+
+	//Remaining pixels
+	for( ; i < count; ++i )
+	{
+		int differs = row[ i ] != bgColor;
+		columns[ i ] |= differs;
+		ink |= differs;
+	}
+
+	return ink != 0;
+}
+
+Uint32 decodeUTF8( const std::string& text, int& i )
+{
+	Uint8 lead = text[ i ];
+
+	//Sequence length and the lead byte's payload
+	int length = 0;
+	Uint32 codepoint = 0;
+	if( lead < 0x80 )
+	{
+		++i;
+		return lead;
+	}
+	else if( ( lead & 0xE0 ) == 0xC0 )
+	{
+		length = 2;
+		codepoint = lead & 0x1F;
+	}
+	else if( ( lead & 0xF0 ) == 0xE0 )
+	{
+		length = 3;
+		codepoint = lead & 0x0F;
+	}
+	else if( ( lead & 0xF8 ) == 0xF0 )
+	{
+		length = 4;
+		codepoint = lead & 0x07;
+	}
+	else
+	{
+		//Stray continuation or invalid byte
+		++i;
+		return UNICODE_REPLACEMENT;
+	}
+
+	//Continuation bytes carry six bits each
+	for( int j = 1; j < length; ++j )
+	{
+		if( i + j >= text.length() || ( (Uint8)text[ i + j ] & 0xC0 ) != 0x80 )
+		{
+			++i;
+			return UNICODE_REPLACEMENT;
+		}
+		codepoint = ( codepoint << 6 ) | ( (Uint8)text[ i + j ] & 0x3F );
+	}
+	i += length;
+
+	//Reject overlong forms, surrogates, and values past Unicode
+	const Uint32 smallest[ 5 ] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if( codepoint < smallest[ length ] || ( codepoint >= 0xD800 && codepoint <= 0xDFFF ) || codepoint > 0x10FFFF )
+	{
+		return UNICODE_REPLACEMENT;
+	}
+
+	return codepoint;
+}
+
+void runBenchmark()
+{
+	//Lines of printable characters
+	std::string text;
+	for( int i = 0; i < BENCHMARK_CHARACTERS; ++i )
+	{
+		if( i > 0 && i % 80 == 0 )
+		{
+			text += '\n';
+		}
+		text += (char)( '!' + i % ( '~' - '!' + 1 ) );
+	}
+
+	//Run per glyph, batched, then from the layout cache
+	const char* names[ 3 ] = { "Per glyph", "Batched", "Cached layout" };
+	for( int pass = 0; pass < 3; ++pass )
+	{
+		Uint64 submitTime = 0, frameTime = 0;
+		int drawCalls = 0;
+
+		for( int frame = 0; frame < BENCHMARK_FRAMES; ++frame )
+		{
+			Uint64 frameStart = SDL_GetPerformanceCounter();
+
+			//Clear screen
+			SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+			SDL_RenderClear( gRenderer );
+
+			//Submit the text
+			gDrawCalls = 0;
+			if( pass == 2 )
+			{
+				gBitmapFont.renderText( 0, 0, text );
+			}
+			else
+			{
+				gBitmapFont.renderTextUncached( 0, 0, text, pass == 1 );
+			}
+			drawCalls += gDrawCalls;
+			Uint64 submitEnd = SDL_GetPerformanceCounter();
+
+			//Update screen
+			SDL_RenderPresent( gRenderer );
+
+			submitTime += submitEnd - frameStart;
+			frameTime += SDL_GetPerformanceCounter() - frameStart;
+		}
+
+		//Average per frame
+		double frequency = SDL_GetPerformanceFrequency();
+		printf( "%s: %d characters, %d draw calls, %.3f ms submit, %.3f ms frame\n",
+			names[ pass ],
+			BENCHMARK_CHARACTERS,
+			drawCalls / BENCHMARK_FRAMES,
+			1000.0 * submitTime / frequency / BENCHMARK_FRAMES,
+			1000.0 * frameTime / frequency / BENCHMARK_FRAMES );
+	}
+}
+
 int main( int argc, char* args[] )
 {
 	//Start up SDL and create window
@@ -681,6 +1922,10 @@ int main( int argc, char* args[] )
 		{
 			printf( "Failed to load media!\n" );
 		}
+		else if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+		{
+			runBenchmark();
+		}
 		else
 		{	
 			//Main loop flag
@@ -689,28 +1934,69 @@ int main( int argc, char* args[] )
 			//Event handler
 			SDL_Event e;
 
+			//Whether the profiler overlay is shown, toggled with F1
+			bool showProfiler = true;
+
 			//While application is running
 			while( !quit )
 			{
+				PROFILE_FRAME();
+
 				//Handle events on queue
-				while( SDL_PollEvent( &e ) != 0 )
 				{
-					//User requests quit
-					if( e.type == SDL_QUIT )
+					PROFILE_SCOPE( "Events" );
+					while( SDL_PollEvent( &e ) != 0 )
 					{
-						quit = true;
+						//User requests quit
+						if( e.type == SDL_QUIT )
+						{
+							quit = true;
+						}
+						//Toggle the overlay
+						else if( e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F1 )
+						{
+							showProfiler = !showProfiler;
+						}
 					}
 				}
 
-				//Clear screen
-				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
-				SDL_RenderClear( gRenderer );
+				//Update, nothing moves in this scene
+				{
+					PROFILE_SCOPE( "Update" );
+				}
+
+				//Render
+				{
+					PROFILE_SCOPE( "Render" );
+
+					//Clear screen
+					SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+					SDL_RenderClear( gRenderer );
+
+					//Render test text
+					{
+						PROFILE_SCOPE( "Text" );
+						gBitmapFont.renderText( 0, 0, "Bitmap Font:\nABDCEFGHIJKLMNOPQRSTUVWXYZ\nabcdefghijklmnopqrstuvwxyz\n0123456789" );
+
+						//Fullwidth "UTF-8" from the second page beside the title, then a kerned pair
+						gBitmapFont.renderText( SCREEN_WIDTH / 2, 0, "\xEF\xBC\xB5\xEF\xBC\xB4\xEF\xBC\xA6\xEF\xBC\x8D\xEF\xBC\x98 AVA" );
+					}
 
-				//Render test text
-				gBitmapFont.renderText( 0, 0, "Bitmap Font:\nABDCEFGHIJKLMNOPQRSTUVWXYZ\nabcdefghijklmnopqrstuvwxyz\n0123456789" );
+#ifdef PROFILER_ENABLED
+					//Render profiler overlay
+					if( showProfiler )
+					{
+						PROFILE_SCOPE( "Overlay" );
+						gProfiler.render( gBitmapFont, 0, SCREEN_HEIGHT / 2 - 64 );
+					}
+#endif
+				}
 
 				//Update screen
-				SDL_RenderPresent( gRenderer );
+				{
+					PROFILE_SCOPE( "Present" );
+					SDL_RenderPresent( gRenderer );
+				}
 			}
 		}
 	}
@@ -11,6 +11,12 @@ and may not be redistributed without written permission.*/
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Simulation steps per second, independent of the display rate
+const int SIMULATION_RATE = 120;
+
+//Most simulation steps a single frame may catch up before time is dropped
+const int MAX_CATCH_UP_STEPS = 5;
+
 //Texture wrapper class
 class LTexture
 {
@@ -84,7 +90,7 @@ private:
 	int mHeight;
 };
 
-//The application time based timer
+//The application time based timer, counted with the high resolution performance counter
 class LTimer
 {
     public:
@@ -97,25 +103,73 @@ class LTimer
 		void pause();
 		void unpause();
 
-		//Gets the timer's time
+		//Gets the timer's time in milliseconds
 		Uint32 getTicks();
 
+		//Gets the timer's time in nanoseconds and seconds
+		Uint64 getNanoseconds();
+		double getSeconds();
+
 		//Checks the status of the timer
 		bool isStarted();
 		bool isPaused();
 
     private:
-		//The clock time when the timer started
-		Uint32 mStartTicks;
+		//Gets the timer's time in performance counter units
+		Uint64 getCounts();
+
+		//The counter value when the timer started
+		Uint64 mStartCounts;
 
-		//The ticks stored when the timer was paused
-		Uint32 mPausedTicks;
+		//The counts stored when the timer was paused
+		Uint64 mPausedCounts;
 
 		//The timer status
 		bool mPaused;
 		bool mStarted;
 };
 
+//Runs a simulation at a fixed step however fast frames are drawn
+class LFixedStep
+{
+    public:
+		//Initializes variables with the steps per second and the most steps one frame may catch up
+		LFixedStep( int stepsPerSecond = SIMULATION_RATE, int maxSteps = MAX_CATCH_UP_STEPS );
+
+		//Starts timing, dropping any time built up
+		void start();
+
+		//Adds the time since the last frame and returns how many steps to simulate
+		int advance();
+
+		//Gets the fixed step in seconds
+		float getStep();
+
+		//Gets how far the current time is between the last two simulation states, from 0 to 1
+		float getAlpha();
+
+		//Gets the number of steps simulated since starting
+		Uint64 getStepCount();
+
+		//Gets the number of steps dropped because a frame fell too far behind
+		Uint64 getDroppedSteps();
+
+    private:
+		//The counter value at the last frame, each frame's time is measured from it
+		Uint64 mLastCounts;
+
+		//The fixed step and the catch up limit
+		double mStep;
+		int mMaxSteps;
+
+		//Time built up that has not been simulated yet
+		double mAccumulator;
+
+		//Step statistics
+		Uint64 mStepCount;
+		Uint64 mDroppedSteps;
+};
+
 //The dot that will move around on the screen
 class Dot
 {
@@ -136,11 +190,12 @@ class Dot
 		//Moves the dot
 		void move( float timeStep );
 
-		//Shows the dot on the screen
-		void render();
+		//Shows the dot on the screen, blended between its last two positions
+		void render( float alpha = 1.f );
 
     private:
 		float mPosX, mPosY;
+		float mPrevX, mPrevY;
 		float mVelX, mVelY;
 };
 
@@ -484,8 +539,8 @@ void LTexture::copyRawPixels32( void* pixels )
 LTimer::LTimer()
 {
     //Initialize the variables
-    mStartTicks = 0;
-    mPausedTicks = 0;
+    mStartCounts = 0;
+    mPausedCounts = 0;
 
     mPaused = false;
     mStarted = false;
@@ -499,9 +554,9 @@ void LTimer::start()
     //Unpause the timer
     mPaused = false;
 
-    //Get the current clock time
-    mStartTicks = SDL_GetTicks();
-	mPausedTicks = 0;
+    //Get the current counter value
+    mStartCounts = SDL_GetPerformanceCounter();
+	mPausedCounts = 0;
 }
 
 void LTimer::stop()
@@ -512,9 +567,9 @@ void LTimer::stop()
     //Unpause the timer
     mPaused = false;
 
-	//Clear tick variables
-	mStartTicks = 0;
-	mPausedTicks = 0;
+	//Clear count variables
+	mStartCounts = 0;
+	mPausedCounts = 0;
 }
 
 void LTimer::pause()
@@ -525,9 +580,9 @@ void LTimer::pause()
         //Pause the timer
         mPaused = true;
 
-        //Calculate the paused ticks
-        mPausedTicks = SDL_GetTicks() - mStartTicks;
-		mStartTicks = 0;
+        //Calculate the paused counts
+        mPausedCounts = SDL_GetPerformanceCounter() - mStartCounts;
+		mStartCounts = 0;
     }
 }
 
@@ -539,18 +594,37 @@ void LTimer::unpause()
         //Unpause the timer
         mPaused = false;
 
-        //Reset the starting ticks
-        mStartTicks = SDL_GetTicks() - mPausedTicks;
+        //Reset the starting counts
+        mStartCounts = SDL_GetPerformanceCounter() - mPausedCounts;
 
-        //Reset the paused ticks
-        mPausedTicks = 0;
+        //Reset the paused counts
+        mPausedCounts = 0;
     }
 }
 
 Uint32 LTimer::getTicks()
+{
+	//Milliseconds, truncated like SDL_GetTicks
+	return getNanoseconds() / 1000000;
+}
+
+Uint64 LTimer::getNanoseconds()
+{
+	//Split whole seconds off first so the multiply can't overflow
+	Uint64 counts = getCounts();
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	return ( counts / frequency ) * 1000000000 + ( counts % frequency ) * 1000000000 / frequency;
+}
+
+double LTimer::getSeconds()
+{
+	return (double)getCounts() / SDL_GetPerformanceFrequency();
+}
+
+Uint64 LTimer::getCounts()
 {
 	//The actual timer time
-	Uint32 time = 0;
+	Uint64 time = 0;
 
     //If the timer is running
     if( mStarted )
@@ -558,13 +632,13 @@ Uint32 LTimer::getTicks()
         //If the timer is paused
         if( mPaused )
         {
-            //Return the number of ticks when the timer was paused
-            time = mPausedTicks;
+            //Return the number of counts when the timer was paused
+            time = mPausedCounts;
         }
         else
         {
-            //Return the current time minus the start time
-            time = SDL_GetTicks() - mStartTicks;
+            //Return the current counter value minus the start value
+            time = SDL_GetPerformanceCounter() - mStartCounts;
         }
     }
 
@@ -584,11 +658,74 @@ bool LTimer::isPaused()
 }
 
 
+LFixedStep::LFixedStep( int stepsPerSecond, int maxSteps )
+{
+	//Initialize the variables
+	mStep = 1.0 / stepsPerSecond;
+	mMaxSteps = maxSteps;
+	mLastCounts = 0;
+	mAccumulator = 0.0;
+	mStepCount = 0;
+	mDroppedSteps = 0;
+}
+
+void LFixedStep::start()
+{
+	//Drop any time built up and start measuring frames
+	mAccumulator = 0.0;
+	mLastCounts = SDL_GetPerformanceCounter();
+}
+
+int LFixedStep::advance()
+{
+	//Add the time since the last frame, reading the counter once so no time falls between readings
+	Uint64 counts = SDL_GetPerformanceCounter();
+	mAccumulator += (double)( counts - mLastCounts ) / SDL_GetPerformanceFrequency();
+	mLastCounts = counts;
+
+	//Whole steps that are due
+	int steps = (int)( mAccumulator / mStep );
+	mAccumulator -= steps * mStep;
+
+	//Drop what can't be caught up so one slow frame doesn't make the next one slower
+	if( steps > mMaxSteps )
+	{
+		mDroppedSteps += steps - mMaxSteps;
+		steps = mMaxSteps;
+	}
+
+	mStepCount += steps;
+	return steps;
+}
+
+float LFixedStep::getStep()
+{
+	return (float)mStep;
+}
+
+float LFixedStep::getAlpha()
+{
+	return (float)( mAccumulator / mStep );
+}
+
+Uint64 LFixedStep::getStepCount()
+{
+	return mStepCount;
+}
+
+Uint64 LFixedStep::getDroppedSteps()
+{
+	return mDroppedSteps;
+}
+
+
 Dot::Dot()
 {
     //Initialize the position
     mPosX = 0;
     mPosY = 0;
+    mPrevX = 0;
+    mPrevY = 0;
 
     //Initialize the velocity
     mVelX = 0;
@@ -625,6 +762,10 @@ void Dot::handleEvent( SDL_Event& e )
 
 void Dot::move( float timeStep )
 {
+    //Keep the last state to render between
+    mPrevX = mPosX;
+    mPrevY = mPosY;
+
     //Move the dot left or right
     mPosX += mVelX * timeStep;
 
@@ -652,10 +793,12 @@ void Dot::move( float timeStep )
 	}
 }
 
-void Dot::render()
+void Dot::render( float alpha )
 {
-    //Show the dot
-	gDotTexture.render( (int)mPosX, (int)mPosY );
+    //Show the dot between the last two simulation states
+	float x = mPrevX + ( mPosX - mPrevX ) * alpha;
+	float y = mPrevY + ( mPosY - mPrevY ) * alpha;
+	gDotTexture.render( (int)x, (int)y );
 }
 
 bool init()
@@ -768,8 +911,9 @@ int main( int argc, char* args[] )
 			//The dot that will be moving around on the screen
 			Dot dot;
 
-			//Keeps track of time between steps
-			LTimer stepTimer;
+			//Steps the simulation at a fixed rate
+			LFixedStep loop;
+			loop.start();
 
 			//While application is running
 			while( !quit )
@@ -787,21 +931,19 @@ int main( int argc, char* args[] )
 					dot.handleEvent( e );
 				}
 
-				//Calculate time step
-				float timeStep = stepTimer.getTicks() / 1000.f;
-
-				//Move for time step
-				dot.move( timeStep );
-
-				//Restart step timer
-				stepTimer.start();
+				//Simulate every fixed step that is due
+				int steps = loop.advance();
+				for( int i = 0; i < steps; ++i )
+				{
+					dot.move( loop.getStep() );
+				}
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
-				//Render dot
-				dot.render();
+				//Render dot between simulation states
+				dot.render( loop.getAlpha() );
 
 				//Update screen
 				SDL_RenderPresent( gRenderer );
@@ -1,17 +1,29 @@
 /*This source code copyrighted by Lazy Foo' Productions (2004-2022)
 and may not be redistributed without written permission.*/
 
-//Using SDL, SDL Threads, SDL_image, standard IO, and strings
+//Using SDL, SDL Threads, SDL_image, standard IO, math, strings, vectors, and deques
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <cmath>
 #include <string>
+#include <vector>
+#include <deque>
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+//Background decode threads
+const int LOADER_THREADS = 4;
+
+//Milliseconds per frame spent creating textures from decoded images
+const double UPLOAD_BUDGET_MS = 4.0;
+
+//Images loaded behind the splash screen
+const int TOTAL_ASSETS = 128;
+
 //Texture wrapper class
 class LTexture
 {
@@ -31,6 +43,9 @@ public:
 	//Creates image from preloaded pixels
 	bool loadFromPixels();
 
+	//Creates image from a decoded surface and frees the surface
+	bool loadFromSurface( SDL_Surface* surface );
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 	//Creates image from font string
 	bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
@@ -85,6 +100,105 @@ private:
 	int mHeight;
 };
 
+//Asynchronous load states
+enum LoadState
+{
+	LOAD_QUEUED,
+	LOAD_DECODING,
+	LOAD_DECODED,
+	LOAD_READY,
+	LOAD_FAILED
+};
+
+//Handle to an image loading in the background
+class LAsyncTexture
+{
+public:
+	//Initializes variables
+	LAsyncTexture( std::string path );
+
+	//Checks if the texture can be rendered
+	bool isReady();
+
+	//Checks if loading finished, successfully or not
+	bool isDone();
+
+	//Gets the texture, empty until ready
+	LTexture& getTexture();
+
+private:
+	//The loader fills in the result
+	friend class LImageLoader;
+
+	//Image path
+	std::string mPath;
+
+	//Current LoadState, set from decode threads
+	SDL_atomic_t mState;
+
+	//Decoded pixels waiting for upload
+	SDL_Surface* mSurface;
+
+	//The finished texture
+	LTexture mTexture;
+};
+
+//Decodes images on worker threads and uploads them on the render thread
+class LImageLoader
+{
+public:
+	//Initializes variables
+	LImageLoader();
+
+	//Deallocates memory
+	~LImageLoader();
+
+	//Starts the decode threads
+	bool start( int threadCount );
+
+	//Queues image at specified path, the handle stays valid until stop
+	LAsyncTexture* load( std::string path );
+
+	//Decodes and uploads image at specified path on the calling thread, for when no decode threads could start
+	LAsyncTexture* loadNow( std::string path );
+
+	//Creates textures for decoded images until the time budget runs out, called once per frame on the render thread
+	void upload( double budgetMs );
+
+	//Gets how many queued images are done
+	int getDone();
+	int getTotal();
+
+	//Stops the threads and frees all handles
+	void stop();
+
+private:
+	//Decode thread function
+	static int decode( void* data );
+
+	//Decodes image at specified path to a format with alpha, NULL on failure
+	static SDL_Surface* decodeImage( std::string path );
+
+	//Decode threads
+	std::vector<SDL_Thread*> mThreads;
+
+	//Guards the queues and quit flag
+	SDL_mutex* mLock;
+
+	//Signals new work or quitting
+	SDL_cond* mCanDecode;
+
+	//Images waiting to be decoded and waiting to be uploaded
+	std::deque<LAsyncTexture*> mQueue;
+	std::deque<LAsyncTexture*> mDecoded;
+
+	//Every handle given out
+	std::vector<LAsyncTexture*> mRequests;
+
+	//Tells threads to exit
+	bool mQuit;
+};
+
 //Starts up SDL and creates window
 bool init();
 
@@ -106,6 +220,9 @@ SDL_Renderer* gRenderer = NULL;
 //Scene textures
 LTexture gSplashTexture;
 
+//Background image loader
+LImageLoader gLoader;
+
 LTexture::LTexture()
 {
 	//Initialize
@@ -211,6 +328,31 @@ bool LTexture::loadFromPixels()
 	return mTexture != NULL;
 }
 
+bool LTexture::loadFromSurface( SDL_Surface* surface )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Create texture from surface pixels
+	mTexture = SDL_CreateTextureFromSurface( gRenderer, surface );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create texture from decoded surface! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		//Get image dimensions
+		mWidth = surface->w;
+		mHeight = surface->h;
+	}
+
+	//Get rid of decoded surface
+	SDL_FreeSurface( surface );
+
+	//Return success
+	return mTexture != NULL;
+}
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -424,6 +566,295 @@ void LTexture::copyRawPixels32( void* pixels )
 	}
 }
 
+LAsyncTexture::LAsyncTexture( std::string path )
+{
+	//Initialize
+	mPath = path;
+	SDL_AtomicSet( &mState, LOAD_QUEUED );
+	mSurface = NULL;
+}
+
+bool LAsyncTexture::isReady()
+{
+	return SDL_AtomicGet( &mState ) == LOAD_READY;
+}
+
+bool LAsyncTexture::isDone()
+{
+	int state = SDL_AtomicGet( &mState );
+	return state == LOAD_READY || state == LOAD_FAILED;
+}
+
+LTexture& LAsyncTexture::getTexture()
+{
+	return mTexture;
+}
+
+LImageLoader::LImageLoader()
+{
+	//Initialize
+	mLock = NULL;
+	mCanDecode = NULL;
+	mQuit = false;
+}
+
+LImageLoader::~LImageLoader()
+{
+	//Deallocate
+	stop();
+}
+
+bool LImageLoader::start( int threadCount )
+{
+	//Create synchronization
+	mLock = SDL_CreateMutex();
+	mCanDecode = SDL_CreateCond();
+	if( mLock == NULL || mCanDecode == NULL )
+	{
+		printf( "Unable to create loader synchronization! SDL Error: %s\n", SDL_GetError() );
+
+		//Free whatever was created so nothing gets locked later
+		if( mCanDecode != NULL )
+		{
+			SDL_DestroyCond( mCanDecode );
+			mCanDecode = NULL;
+		}
+		if( mLock != NULL )
+		{
+			SDL_DestroyMutex( mLock );
+			mLock = NULL;
+		}
+		return false;
+	}
+
+	//Run the decode threads
+	mQuit = false;
+	for( int i = 0; i < threadCount; ++i )
+	{
+		SDL_Thread* thread = SDL_CreateThread( decode, "Decoder", this );
+		if( thread == NULL )
+		{
+			printf( "Unable to create decode thread! SDL Error: %s\n", SDL_GetError() );
+		}
+		else
+		{
+			mThreads.push_back( thread );
+		}
+	}
+
+	return !mThreads.empty();
+}
+
+LAsyncTexture* LImageLoader::load( std::string path )
+{
+	//Make the handle
+	LAsyncTexture* request = new LAsyncTexture( path );
+	mRequests.push_back( request );
+
+	//Nothing would ever decode it
+	if( mThreads.empty() )
+	{
+		printf( "Unable to queue image %s! No decode threads are running.\n", path.c_str() );
+		SDL_AtomicSet( &request->mState, LOAD_FAILED );
+		return request;
+	}
+
+	//Hand it to a decode thread
+	SDL_LockMutex( mLock );
+	mQueue.push_back( request );
+	SDL_CondSignal( mCanDecode );
+	SDL_UnlockMutex( mLock );
+
+	return request;
+}
+
+LAsyncTexture* LImageLoader::loadNow( std::string path )
+{
+	//Make the handle
+	LAsyncTexture* request = new LAsyncTexture( path );
+	mRequests.push_back( request );
+
+	//Decode and upload right here
+	SDL_Surface* convertedSurface = decodeImage( path );
+	bool loaded = convertedSurface != NULL && request->mTexture.loadFromSurface( convertedSurface );
+	SDL_AtomicSet( &request->mState, loaded ? LOAD_READY : LOAD_FAILED );
+
+	return request;
+}
+
+int LImageLoader::decode( void* data )
+{
+	LImageLoader* loader = static_cast<LImageLoader*>( data );
+
+	while( true )
+	{
+		//Wait for work
+		SDL_LockMutex( loader->mLock );
+		while( loader->mQueue.empty() && !loader->mQuit )
+		{
+			SDL_CondWait( loader->mCanDecode, loader->mLock );
+		}
+		if( loader->mQuit )
+		{
+			SDL_UnlockMutex( loader->mLock );
+			break;
+		}
+		LAsyncTexture* request = loader->mQueue.front();
+		loader->mQueue.pop_front();
+		SDL_UnlockMutex( loader->mLock );
+		SDL_AtomicSet( &request->mState, LOAD_DECODING );
+
+		//Decode
+		SDL_Surface* convertedSurface = decodeImage( request->mPath );
+
+		//Queue for upload
+		SDL_LockMutex( loader->mLock );
+		if( convertedSurface != NULL )
+		{
+			request->mSurface = convertedSurface;
+			SDL_AtomicSet( &request->mState, LOAD_DECODED );
+			loader->mDecoded.push_back( request );
+		}
+		else
+		{
+			SDL_AtomicSet( &request->mState, LOAD_FAILED );
+		}
+		SDL_UnlockMutex( loader->mLock );
+	}
+
+	return 0;
+}
+
+SDL_Surface* LImageLoader::decodeImage( std::string path )
+{
+	//Decode and convert to a format with alpha, so the upload needs no conversion
+	SDL_Surface* convertedSurface = NULL;
+	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
+	if( loadedSurface == NULL )
+	{
+		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+	}
+	else
+	{
+		//Color key image
+		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0xFF, 0xFF ) );
+
+		convertedSurface = SDL_ConvertSurfaceFormat( loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0 );
+		if( convertedSurface == NULL )
+		{
+			printf( "Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+		}
+
+		//Get rid of old loaded surface
+		SDL_FreeSurface( loadedSurface );
+	}
+
+	return convertedSurface;
+}
+
+void LImageLoader::upload( double budgetMs )
+{
+	//Nothing started
+	if( mLock == NULL )
+	{
+		return;
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	Uint64 budget = (Uint64)( budgetMs * SDL_GetPerformanceFrequency() / 1000.0 );
+
+	//Upload at least one image per frame so loading always progresses
+	while( true )
+	{
+		//Take a decoded image
+		LAsyncTexture* request = NULL;
+		SDL_LockMutex( mLock );
+		if( !mDecoded.empty() )
+		{
+			request = mDecoded.front();
+			mDecoded.pop_front();
+		}
+		SDL_UnlockMutex( mLock );
+
+		if( request == NULL )
+		{
+			break;
+		}
+
+		//Textures can only be created on the render thread
+		bool loaded = request->mTexture.loadFromSurface( request->mSurface );
+		request->mSurface = NULL;
+		SDL_AtomicSet( &request->mState, loaded ? LOAD_READY : LOAD_FAILED );
+
+		//Leave the rest for the next frame
+		if( SDL_GetPerformanceCounter() - start >= budget )
+		{
+			break;
+		}
+	}
+}
+
+int LImageLoader::getDone()
+{
+	int done = 0;
+	for( int i = 0; i < mRequests.size(); ++i )
+	{
+		if( mRequests[ i ]->isDone() )
+		{
+			++done;
+		}
+	}
+
+	return done;
+}
+
+int LImageLoader::getTotal()
+{
+	return mRequests.size();
+}
+
+void LImageLoader::stop()
+{
+	//Tell the threads to exit and wait for them
+	if( mLock != NULL )
+	{
+		SDL_LockMutex( mLock );
+		mQuit = true;
+		SDL_CondBroadcast( mCanDecode );
+		SDL_UnlockMutex( mLock );
+	}
+	for( int i = 0; i < mThreads.size(); ++i )
+	{
+		SDL_WaitThread( mThreads[ i ], NULL );
+	}
+	mThreads.clear();
+
+	//Free decoded images that were never uploaded
+	for( int i = 0; i < mDecoded.size(); ++i )
+	{
+		SDL_FreeSurface( mDecoded[ i ]->mSurface );
+		mDecoded[ i ]->mSurface = NULL;
+	}
+	mDecoded.clear();
+	mQueue.clear();
+
+	//Free handles and their textures
+	for( int i = 0; i < mRequests.size(); ++i )
+	{
+		delete mRequests[ i ];
+	}
+	mRequests.clear();
+
+	//Free synchronization
+	if( mLock != NULL )
+	{
+		SDL_DestroyCond( mCanDecode );
+		SDL_DestroyMutex( mLock );
+		mCanDecode = NULL;
+		mLock = NULL;
+	}
+}
+
 bool init()
 {
 	//Initialization flag
@@ -499,6 +930,7 @@ bool loadMedia()
 void close()
 {
 	//Free loaded images
+	gLoader.stop();
 	gSplashTexture.free();
 
 	//Destroy window	
@@ -546,6 +978,26 @@ int main( int argc, char* args[] )
 			int data = 101;
 			SDL_Thread* threadID = SDL_CreateThread( threadFunction, "LazyThread", (void*)data );
 
+			//Load the rest of the images in the background
+			if( gLoader.start( LOADER_THREADS ) )
+			{
+				for( int i = 0; i < TOTAL_ASSETS; ++i )
+				{
+					gLoader.load( "splash.png" );
+				}
+			}
+			//Load them one after another instead
+			else
+			{
+				printf( "Failed to start image loader! Loading images in order instead.\n" );
+				for( int i = 0; i < TOTAL_ASSETS; ++i )
+				{
+					gLoader.loadNow( "splash.png" );
+				}
+			}
+			Uint32 loadStart = SDL_GetTicks();
+			bool loaded = false;
+
 			//While application is running
 			while( !quit )
 			{
@@ -559,6 +1011,14 @@ int main( int argc, char* args[] )
 					}
 				}
 
+				//Create textures for decoded images
+				gLoader.upload( UPLOAD_BUDGET_MS );
+				if( !loaded && gLoader.getDone() == gLoader.getTotal() )
+				{
+					printf( "Loaded %d images in %d ms\n", gLoader.getTotal(), SDL_GetTicks() - loadStart );
+					loaded = true;
+				}
+
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
@@ -566,6 +1026,21 @@ int main( int argc, char* args[] )
 				//Render prompt
 				gSplashTexture.render( 0, 0 );
 
+				//Render loading progress
+				if( !loaded )
+				{
+					//Progress bar
+					SDL_Rect bar = { 20, SCREEN_HEIGHT - 40, ( SCREEN_WIDTH - 40 ) * gLoader.getDone() / SDL_max( gLoader.getTotal(), 1 ), 20 };
+					SDL_SetRenderDrawColor( gRenderer, 0x00, 0x00, 0xFF, 0xFF );
+					SDL_RenderFillRect( gRenderer, &bar );
+
+					//Marker sweeping across to show frames keep coming while loading
+					int sweep = (int)( ( SCREEN_WIDTH - 60 ) * ( 0.5 + 0.5 * sin( SDL_GetTicks() / 300.0 ) ) );
+					SDL_Rect marker = { 20 + sweep, SCREEN_HEIGHT - 70, 20, 20 };
+					SDL_SetRenderDrawColor( gRenderer, 0xFF, 0x00, 0x00, 0xFF );
+					SDL_RenderFillRect( gRenderer, &marker );
+				}
+
 				//Update screen
 				SDL_RenderPresent( gRenderer );
 			}